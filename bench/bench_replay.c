@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replays a stream of msgpack-rpc messages, as neovim writes them on its
+ * standard output, through the redraw code of eovim: the decoder of the
+ * reader thread, the redraw handlers, and the termview. The window is
+ * rendered by the buffer engine of Elementary, so no display is required.
+ *
+ *   bench_replay [-n iterations] stream.msgpack
+ *
+ * The whole stream is replayed as fast as possible, and the following is
+ * reported: messages and bytes per second, the time spent unpacking,
+ * decoding, applying and rendering, and for each redraw handler, the number
+ * of calls, the time spent, and the allocations made by eovim's code.
+ *
+ * bench_replay_nodbg is the same benchmark, with the debug messages of eovim
+ * compiled out (EOVIM_LOG_LEVEL_MIN), so both can be compared on the same
+ * stream.
+ *
+ * Commands that are decoded ahead of time are reported under the name of the
+ * command they are turned into (e.g. grid_scroll is reported as
+ * set_scroll_region and scroll).
+ */
+
+#include "eovim/types.h"
+#include "eovim/nvim.h"
+#include "eovim/nvim_api.h"
+#include "eovim/nvim_event.h"
+#include "eovim/nvim_helper.h"
+#include "eovim/redraw.h"
+#include "eovim/config.h"
+#include "eovim/options.h"
+#include "eovim/gui.h"
+#include "eovim/keymap.h"
+#include "eovim/mode.h"
+#include "eovim/plugin.h"
+#include "eovim/prefs.h"
+#include "eovim/termview.h"
+#include "eovim/utf8.h"
+#include "eovim/main.h"
+#include "eovim/log.h"
+#include "bench.h"
+
+#include <stdio.h>
+
+int _eovim_log_domain = -1;
+
+/*============================================================================*
+ *                       What main.c provides to eovim                        *
+ *============================================================================*/
+
+Eina_Bool
+main_in_tree_is(void)
+{
+   return EINA_TRUE;
+}
+
+const char *
+main_edje_file_get(void)
+{
+   return BENCH_THEME;
+}
+
+Eina_Inlist *
+main_plugins_get(void)
+{
+   return NULL;
+}
+
+/*============================================================================*
+ *                            Allocations counting                            *
+ *============================================================================*/
+
+static unsigned long _allocs = 0;
+
+#ifdef BENCH_ALLOC_WRAP
+/* The linker redirects the allocations of eovim's code to these */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+   __atomic_fetch_add(&_allocs, 1, __ATOMIC_RELAXED);
+   return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb,
+              size_t size)
+{
+   __atomic_fetch_add(&_allocs, 1, __ATOMIC_RELAXED);
+   return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr,
+               size_t size)
+{
+   __atomic_fetch_add(&_allocs, 1, __ATOMIC_RELAXED);
+   return __real_realloc(ptr, size);
+}
+#endif
+
+static inline unsigned long
+_allocs_get(void)
+{
+   return __atomic_load_n(&_allocs, __ATOMIC_RELAXED);
+}
+
+/*============================================================================*
+ *                                 Statistics                                 *
+ *============================================================================*/
+
+typedef struct
+{
+   unsigned long calls;
+   unsigned long allocs;
+   double time; /**< Nanoseconds */
+} s_handler_stats;
+
+static struct {
+   unsigned long messages;
+   unsigned long batches;
+   unsigned long commands;
+   unsigned long bytes;
+   double unpack; /**< Nanoseconds spent unpacking messages */
+   double decode; /**< Nanoseconds spent decoding redraw batches */
+   double apply; /**< Nanoseconds spent applying redraw batches */
+   double render; /**< Nanoseconds spent in the main loop (rendering) */
+   unsigned long decode_allocs;
+   s_handler_stats handlers[__E_REDRAW_LAST];
+} _stats;
+
+static void
+_stats_print(unsigned int iterations)
+{
+   const double total =
+      _stats.unpack + _stats.decode + _stats.apply + _stats.render;
+   const double ms = 1e-6;
+
+   printf("%lu messages (%lu redraw batches, %lu commands), %lu bytes, "
+          "%u iterations\n\n",
+          _stats.messages, _stats.batches, _stats.commands, _stats.bytes,
+          iterations);
+   printf("Debug messages are %s\n\n",
+          (EOVIM_LOG_LEVEL_MIN >= EINA_LOG_LEVEL_DBG)
+          ? "compiled in, and filtered at runtime" : "compiled out");
+   printf("unpack   %10.3f ms\n", _stats.unpack * ms);
+   printf("decode   %10.3f ms (%lu allocations)\n",
+          _stats.decode * ms, _stats.decode_allocs);
+   printf("apply    %10.3f ms\n", _stats.apply * ms);
+   printf("render   %10.3f ms\n", _stats.render * ms);
+   printf("total    %10.3f ms\n\n", total * ms);
+   printf("%.0f commands/s, %.0f bytes/s\n\n",
+          (double)_stats.commands / (total * 1e-9),
+          (double)_stats.bytes / (total * 1e-9));
+
+   printf("%-28s %10s %12s %10s %10s\n",
+          "handler", "calls", "total (ms)", "ns/call", "allocs");
+   for (unsigned int i = 0; i < __E_REDRAW_LAST; i++)
+     {
+        const s_handler_stats *const h = &(_stats.handlers[i]);
+        if (h->calls == 0) { continue; }
+        printf("%-28s %10lu %12.3f %10.0f %10lu\n",
+               nvim_event_redraw_command_name_get((e_redraw_command)i),
+               h->calls, h->time * ms, h->time / (double)h->calls,
+               h->allocs);
+     }
+}
+
+/*============================================================================*
+ *                                   Replay                                   *
+ *============================================================================*/
+
+static const msgpack_object_array *
+_redraw_commands_get(const msgpack_object *obj)
+{
+   /* Redraw notifications are [2, "redraw", [commands...]] */
+   if (obj->type != MSGPACK_OBJECT_ARRAY) { return NULL; }
+   const msgpack_object_array *const args = &(obj->via.array);
+   if ((args->size != 3) ||
+       (args->ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER) ||
+       (args->ptr[0].via.u64 != 2) ||
+       (args->ptr[1].type != MSGPACK_OBJECT_STR) ||
+       (args->ptr[2].type != MSGPACK_OBJECT_ARRAY))
+     return NULL;
+
+   const msgpack_object_str *const method = &(args->ptr[1].via.str);
+   if (nvim_event_method_get(method->ptr, method->size) != E_METHOD_REDRAW)
+     return NULL;
+   return &(args->ptr[2].via.array);
+}
+
+static Eina_Bool
+_size_find(const char *data,
+           size_t size,
+           unsigned int *cols,
+           unsigned int *rows)
+{
+   /*
+    * Puts are dropped by the termview if neovim's grid does not have the
+    * size of the termview. So the window is given the size of the first
+    * resize (or grid_resize) command of the stream.
+    */
+   Eina_Bool found = EINA_FALSE;
+   msgpack_unpacked result;
+   size_t off = 0;
+
+   msgpack_unpacked_init(&result);
+   while ((! found) &&
+          (msgpack_unpack_next(&result, data, size, &off)
+           == MSGPACK_UNPACK_SUCCESS))
+     {
+        const msgpack_object_array *const cmds =
+           _redraw_commands_get(&(result.data));
+        if (! cmds) { continue; }
+
+        for (unsigned int i = 0; (! found) && (i < cmds->size); i++)
+          {
+             if (cmds->ptr[i].type != MSGPACK_OBJECT_ARRAY) { continue; }
+             const msgpack_object_array *const cmd = &(cmds->ptr[i].via.array);
+             if ((cmd->size < 2) || (cmd->ptr[0].type != MSGPACK_OBJECT_STR) ||
+                 (cmd->ptr[cmd->size - 1].type != MSGPACK_OBJECT_ARRAY))
+               continue;
+
+             /* resize is [cols, rows], grid_resize is [grid, cols, rows] */
+             const msgpack_object_str *const name = &(cmd->ptr[0].via.str);
+             const e_redraw_command id =
+                nvim_event_redraw_command_get(name->ptr, name->size);
+             const msgpack_object_array *const params =
+                &(cmd->ptr[cmd->size - 1].via.array);
+             unsigned int first;
+             if ((id == E_REDRAW_RESIZE) && (params->size == 2)) first = 0;
+             else if ((id == E_REDRAW_GRID_RESIZE) && (params->size == 3)) first = 1;
+             else continue;
+
+             *cols = (unsigned int)params->ptr[first].via.u64;
+             *rows = (unsigned int)params->ptr[first + 1].via.u64;
+             found = EINA_TRUE;
+          }
+     }
+   msgpack_unpacked_destroy(&result);
+   return found;
+}
+
+static void
+_batch_apply(s_nvim *nvim,
+             const s_redraw_batch *batch)
+{
+   /* This is redraw_batch_apply(), with a stopwatch around each command */
+   Eina_Bool flushed = EINA_FALSE;
+   const double start = bench_now();
+
+   gui_redraw_begin(&nvim->gui);
+   for (unsigned int i = 0; i < batch->cmds_count; i++)
+     {
+        const s_redraw_cmd *const cmd = &(batch->cmds[i]);
+        const e_redraw_command id = redraw_cmd_command_get(cmd);
+        s_handler_stats *const h = &(_stats.handlers[id]);
+        if (id == E_REDRAW_FLUSH) { flushed = EINA_TRUE; }
+
+        const unsigned long allocs = _allocs_get();
+        const double t0 = bench_now();
+        redraw_cmd_apply(nvim, batch, cmd);
+        h->time += bench_now() - t0;
+        h->allocs += _allocs_get() - allocs;
+        h->calls++;
+     }
+   gui_redraw_end(&nvim->gui);
+
+   /* Streams of neovim before 0.4.0 have no flush. Present each batch, as
+    * the fallback timer would eventually do. */
+   if (! flushed)
+     gui_flush(&nvim->gui);
+
+   _stats.apply += bench_now() - start;
+   _stats.commands += batch->cmds_count;
+}
+
+static void
+_replay(s_nvim *nvim,
+        const char *data,
+        size_t size)
+{
+   msgpack_unpacked result;
+   size_t off = 0;
+
+   msgpack_unpacked_init(&result);
+   for (;;)
+     {
+        const size_t prev = off;
+        double t = bench_now();
+        const msgpack_unpack_return ret =
+           msgpack_unpack_next(&result, data, size, &off);
+        _stats.unpack += bench_now() - t;
+        if (ret != MSGPACK_UNPACK_SUCCESS)
+          {
+             if (ret != MSGPACK_UNPACK_CONTINUE)
+               ERR("Failed to unpack message at offset %zu", prev);
+             break;
+          }
+        _stats.messages++;
+        _stats.bytes += off - prev;
+
+        /* Only redraw notifications are replayed */
+        const msgpack_object_array *const cmds =
+           _redraw_commands_get(&(result.data));
+        if (! cmds) { continue; }
+
+        const unsigned long allocs = _allocs_get();
+        t = bench_now();
+        s_redraw_batch *const batch = redraw_batch_decode(cmds);
+        _stats.decode += bench_now() - t;
+        _stats.decode_allocs += _allocs_get() - allocs;
+        if (EINA_UNLIKELY(! batch)) { continue; }
+
+        _batch_apply(nvim, batch);
+        redraw_batch_free(batch);
+        _stats.batches++;
+
+        /* Let Evas render what was presented */
+        t = bench_now();
+        ecore_main_loop_iterate();
+        _stats.render += bench_now() - t;
+     }
+   msgpack_unpacked_destroy(&result);
+}
+
+/*============================================================================*
+ *                                  Fake nvim                                 *
+ *============================================================================*/
+
+static s_nvim *
+_nvim_new(const s_options *opts)
+{
+   /* Like nvim_new(), but there is no neovim process to talk to */
+   s_nvim *const nvim = calloc(1, sizeof(s_nvim));
+   if (EINA_UNLIKELY(! nvim))
+     {
+        CRI("Failed to create nvim structure");
+        goto fail;
+     }
+   nvim->opts = opts;
+   nvim->mouse_enabled = EINA_TRUE;
+   nvim->hl_group_decode = nvim_helper_highlight_group_decode_noop;
+   msgpack_sbuffer_init(&nvim->sbuffer);
+   msgpack_packer_init(&nvim->packer, &nvim->sbuffer, msgpack_sbuffer_write);
+
+   nvim->config = config_load(opts->config_path);
+   if (EINA_UNLIKELY(! nvim->config))
+     {
+        CRI("Failed to initialize a configuration");
+        goto del_mem;
+     }
+   nvim->true_colors = nvim->config->true_colors;
+
+   nvim->modes = eina_hash_stringshared_new(EINA_FREE_CB(mode_free));
+   nvim->input.keys = eina_strbuf_new();
+   if (EINA_UNLIKELY((! nvim->modes) || (! nvim->input.keys)))
+     {
+        CRI("Failed to allocate memory");
+        goto del_config;
+     }
+
+   if (EINA_UNLIKELY(! gui_add(&nvim->gui, nvim)))
+     {
+        CRI("Failed to set up the graphical user interface");
+        goto del_config;
+     }
+   return nvim;
+
+del_config:
+   if (nvim->input.keys) eina_strbuf_free(nvim->input.keys);
+   if (nvim->modes) eina_hash_free(nvim->modes);
+   config_free(nvim->config);
+del_mem:
+   msgpack_sbuffer_destroy(&nvim->sbuffer);
+   free(nvim);
+fail:
+   return NULL;
+}
+
+static void
+_nvim_free(s_nvim *nvim)
+{
+   gui_del(&nvim->gui);
+   nvim_api_requests_drop(nvim);
+   eina_strbuf_free(nvim->input.keys);
+   msgpack_sbuffer_destroy(&nvim->sbuffer);
+   eina_hash_free(nvim->modes);
+   config_free(nvim->config);
+   free(nvim);
+}
+
+/*============================================================================*
+ *                                    Main                                    *
+ *============================================================================*/
+
+typedef struct
+{
+   const char *const name;
+   Eina_Bool (*const init)(void);
+   void (*const shutdown)(void);
+} s_module;
+
+static const s_module _modules[] =
+{
+#define MODULE(name_) \
+   { .name = #name_, .init = name_ ## _init, .shutdown = name_ ## _shutdown }
+
+   MODULE(utf8),
+   MODULE(config),
+   MODULE(keymap),
+   MODULE(mode),
+   MODULE(nvim_event),
+   MODULE(plugin),
+   MODULE(prefs),
+   MODULE(gui),
+   MODULE(termview),
+
+#undef MODULE
+};
+
+int
+main(int argc,
+     char **argv)
+{
+   int ret = EXIT_FAILURE;
+   unsigned int iterations = 1;
+   const char *path = NULL;
+
+   for (int i = 1; i < argc; i++)
+     {
+        if ((! strcmp(argv[i], "-n")) && (i + 1 < argc))
+          iterations = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else
+          path = argv[i];
+     }
+   if ((! path) || (iterations == 0))
+     {
+        fprintf(stderr, "Usage: %s [-n iterations] stream.msgpack\n", argv[0]);
+        return EXIT_FAILURE;
+     }
+
+   /* Render offscreen, unless told otherwise */
+   setenv("ELM_ENGINE", "buffer", 0);
+   elm_init(argc, argv);
+   _eovim_log_domain = eina_log_domain_register("eovim", EINA_COLOR_RED);
+   plugin_enabled_set(EINA_FALSE);
+
+   const s_module *mod_it;
+   for (mod_it = _modules; mod_it < &(_modules[EINA_C_ARRAY_LENGTH(_modules)]);
+        mod_it++)
+     {
+        if (EINA_UNLIKELY(mod_it->init() != EINA_TRUE))
+          {
+             CRI("Failed to initialize module '%s'", mod_it->name);
+             goto modules_shutdown;
+          }
+     }
+
+   Eina_File *const file = eina_file_open(path, EINA_FALSE);
+   if (EINA_UNLIKELY(! file))
+     {
+        CRI("Failed to open '%s'", path);
+        goto modules_shutdown;
+     }
+   const char *const data = eina_file_map_all(file, EINA_FILE_POPULATE);
+   const size_t size = eina_file_size_get(file);
+   if (EINA_UNLIKELY(! data))
+     {
+        CRI("Failed to map '%s'", path);
+        goto close_file;
+     }
+
+   /* The window is given the size neovim draws for */
+   s_options opts;
+   options_defaults_set(&opts);
+   opts.config_path = BENCH_CONFIG;
+   _size_find(data, size, &opts.geometry.w, &opts.geometry.h);
+   s_nvim *const nvim = _nvim_new(&opts);
+   if (EINA_UNLIKELY(! nvim)) { goto unmap_file; }
+
+   /* Let the termview take its size before starting the clock */
+   for (unsigned int i = 0; i < 100; i++)
+     {
+        unsigned int cols, rows;
+        termview_size_get(nvim->gui.termview, &cols, &rows);
+        if ((cols == opts.geometry.w) && (rows == opts.geometry.h)) { break; }
+        ecore_main_loop_iterate();
+     }
+
+   for (unsigned int i = 0; i < iterations; i++)
+     _replay(nvim, data, size);
+   _stats_print(iterations);
+   ret = EXIT_SUCCESS;
+
+   _nvim_free(nvim);
+unmap_file:
+   eina_file_map_free(file, (void *)data);
+close_file:
+   eina_file_close(file);
+modules_shutdown:
+   for (--mod_it; mod_it >= _modules; mod_it--)
+     mod_it->shutdown();
+   eina_log_domain_unregister(_eovim_log_domain);
+   elm_shutdown();
+   return ret;
+}
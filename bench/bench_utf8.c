@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the throughput of the UTF-8 decoder, for each implementation
+ * the CPU supports, on texts with more or less non-ASCII characters.
+ *
+ *   bench_utf8 [iterations]
+ *
+ * That they all decode the same is checked by tests/unit/test_utf8.c.
+ */
+
+#include "eovim/types.h"
+#include "eovim/utf8.h"
+#include "eovim/log.h"
+#include "bench.h"
+
+#include <stdio.h>
+
+int _eovim_log_domain = -1;
+
+#define TEXT_SIZE (64u * 1024u)
+
+typedef struct
+{
+   const char *const name;
+   const char *const pattern; /**< Repeated to fill the text */
+} s_corpus;
+
+static const s_corpus _corpora[] =
+{
+   { "ascii", "int main(void) { return printf(\"hello, world\\n\"); }\n" },
+   { "source", "/* Décodage */ x = \"naïve\"; // ok → done\n" },
+   { "prose", "Le cœur a ses raisons que la raison ne connaît point. " },
+   { "cjk", "吾輩は猫である。名前はまだ無い。" },
+};
+
+static unsigned int
+_text_fill(char *text,
+           const char *pattern)
+{
+   const size_t len = strlen(pattern);
+   unsigned int size = 0;
+   while (size + len <= TEXT_SIZE)
+     {
+        memcpy(&text[size], pattern, len);
+        size += (unsigned int)len;
+     }
+   return size;
+}
+
+int
+main(int argc,
+     char **argv)
+{
+   const unsigned int iterations =
+      (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 10) : 2000u;
+   int ret = EXIT_FAILURE;
+
+   eina_init();
+   _eovim_log_domain = eina_log_domain_register("bench", EINA_COLOR_RED);
+   char *const text = malloc(TEXT_SIZE);
+   Eina_Unicode *const out = malloc(TEXT_SIZE * sizeof(Eina_Unicode));
+   if (EINA_UNLIKELY((! text) || (! out)))
+     {
+        fprintf(stderr, "Failed to allocate memory\n");
+        goto end;
+     }
+   utf8_init();
+
+   printf("%-8s %-8s %12s\n", "corpus", "impl", "bytes/ns");
+   for (unsigned int c = 0; c < EINA_C_ARRAY_LENGTH(_corpora); c++)
+     {
+        const unsigned int size = _text_fill(text, _corpora[c].pattern);
+        for (int impl = UTF8_IMPL_SCALAR; impl < UTF8_IMPL_LAST; impl++)
+          {
+             if (! utf8_impl_set((e_utf8_impl)impl)) { continue; }
+
+             unsigned int count = 0;
+             const double start = bench_now();
+             for (unsigned int i = 0; i < iterations; i++)
+               count += utf8_decode(text, size, out);
+             const double elapsed = bench_now() - start;
+
+             /* Use the result, so the loop is not optimized out */
+             if (count == 0) { goto end; }
+             printf("%-8s %-8s %12.3f\n", _corpora[c].name,
+                    utf8_impl_name_get((e_utf8_impl)impl),
+                    ((double)size * iterations) / elapsed);
+          }
+     }
+   ret = EXIT_SUCCESS;
+
+end:
+   utf8_shutdown();
+   free(out);
+   free(text);
+   eina_log_domain_unregister(_eovim_log_domain);
+   eina_shutdown();
+   return ret;
+}
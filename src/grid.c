@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/types.h"
+#include "eovim/grid.h"
+#include "eovim/log.h"
+
+static inline Eina_Unicode *
+_row_codepoints(s_grid *grid,
+                unsigned int row)
+{
+   return &(grid->codepoints[grid->index[row] * grid->cols]);
+}
+
+static inline uint16_t *
+_row_attrs(s_grid *grid,
+           unsigned int row)
+{
+   return &(grid->attrs[grid->index[row] * grid->cols]);
+}
+
+static void
+_dirty_add(s_grid *grid,
+           unsigned int col,
+           unsigned int row,
+           unsigned int size)
+{
+   s_grid_span *const span = &(grid->dirty[row]);
+   const unsigned int last = col + size - 1;
+
+   if (span->last < span->first)
+     {
+        span->first = col;
+        span->last = last;
+     }
+   else
+     {
+        if (col < span->first) span->first = col;
+        if (last > span->last) span->last = last;
+     }
+   grid->has_dirty = EINA_TRUE;
+}
+
+static void
+_dirty_rect_add(s_grid *grid,
+                unsigned int col,
+                unsigned int row,
+                unsigned int width,
+                unsigned int height)
+{
+   for (unsigned int y = row; y < row + height; y++)
+     _dirty_add(grid, col, y, width);
+}
+
+static void
+_index_reverse(unsigned int *index,
+               unsigned int first,
+               unsigned int last)
+{
+   while (first < last)
+     {
+        const unsigned int tmp = index[first];
+        index[first++] = index[last];
+        index[last--] = tmp;
+     }
+}
+
+static void
+_index_rotate(unsigned int *index,
+              unsigned int first,
+              unsigned int last,
+              unsigned int shift)
+{
+   /* Rotate index[first..last] by shift entries to the left, in place */
+   _index_reverse(index, first, first + shift - 1);
+   _index_reverse(index, first + shift, last);
+   _index_reverse(index, first, last);
+}
+
+static void
+_cells_clear(s_grid *grid,
+             unsigned int col,
+             unsigned int row,
+             unsigned int size)
+{
+   /* A cleared cell has no codepoint, and the attribute 0 */
+   memset(&(_row_codepoints(grid, row)[col]), 0, size * sizeof(Eina_Unicode));
+   memset(&(_row_attrs(grid, row)[col]), 0, size * sizeof(uint16_t));
+   _dirty_add(grid, col, row, size);
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+s_grid *
+grid_new(unsigned int cols,
+         unsigned int rows)
+{
+   s_grid *const grid = calloc(1, sizeof(s_grid));
+   if (EINA_UNLIKELY(! grid))
+     {
+        CRI("Failed to allocate memory for a grid");
+        return NULL;
+     }
+   if (EINA_UNLIKELY(! grid_resize(grid, cols, rows)))
+     {
+        free(grid);
+        return NULL;
+     }
+   return grid;
+}
+
+void
+grid_free(s_grid *grid)
+{
+   if (grid)
+     {
+        free(grid->codepoints);
+        free(grid->attrs);
+        free(grid->index);
+        free(grid->dirty);
+        free(grid);
+     }
+}
+
+Eina_Bool
+grid_resize(s_grid *grid,
+            unsigned int cols,
+            unsigned int rows)
+{
+   if (EINA_UNLIKELY((cols == 0) || (rows == 0)))
+     {
+        /* An empty grid has no storage at all */
+        free(grid->codepoints);
+        free(grid->attrs);
+        free(grid->index);
+        free(grid->dirty);
+        memset(grid, 0, sizeof(s_grid));
+        return EINA_TRUE;
+     }
+
+   const size_t count = (size_t)cols * rows;
+   Eina_Unicode *const codepoints = calloc(count, sizeof(Eina_Unicode));
+   uint16_t *const attrs = calloc(count, sizeof(uint16_t));
+   unsigned int *const index = malloc(rows * sizeof(unsigned int));
+   s_grid_span *const dirty = malloc(rows * sizeof(s_grid_span));
+   if (EINA_UNLIKELY((! codepoints) || (! attrs) || (! index) || (! dirty)))
+     {
+        CRI("Failed to allocate memory for a grid of %ux%u", cols, rows);
+        free(codepoints);
+        free(attrs);
+        free(index);
+        free(dirty);
+        return EINA_FALSE;
+     }
+
+   /* Keep what can be kept from the previous cells. The rows are stored in
+    * order in the new grid. Everything is dirty. */
+   const unsigned int keep_cols = MIN(cols, grid->cols);
+   const unsigned int keep_rows = MIN(rows, grid->rows);
+   for (unsigned int y = 0; y < keep_rows; y++)
+     {
+        memcpy(&codepoints[y * cols], _row_codepoints(grid, y),
+               keep_cols * sizeof(Eina_Unicode));
+        memcpy(&attrs[y * cols], _row_attrs(grid, y),
+               keep_cols * sizeof(uint16_t));
+     }
+   for (unsigned int y = 0; y < rows; y++)
+     index[y] = y;
+
+   free(grid->codepoints);
+   free(grid->attrs);
+   free(grid->index);
+   free(grid->dirty);
+   grid->codepoints = codepoints;
+   grid->attrs = attrs;
+   grid->index = index;
+   grid->dirty = dirty;
+   grid->cols = cols;
+   grid->rows = rows;
+   grid_dirty_all(grid);
+   return EINA_TRUE;
+}
+
+unsigned int
+grid_put(s_grid *grid,
+         unsigned int col,
+         unsigned int row,
+         const Eina_Unicode *ustring,
+         unsigned int size,
+         uint16_t attr)
+{
+   if (EINA_UNLIKELY((row >= grid->rows) || (col > grid->cols)))
+     {
+        ERR("Attempt to write outside of the grid. Discarding.");
+        return 0;
+     }
+   if (EINA_UNLIKELY(col + size > grid->cols))
+     {
+        ERR("String would overflow the grid. Truncating.");
+        size = grid->cols - col;
+     }
+   if (EINA_UNLIKELY(size == 0)) { return 0; }
+
+   Eina_Unicode *const codepoints = &(_row_codepoints(grid, row)[col]);
+   uint16_t *const attrs = &(_row_attrs(grid, row)[col]);
+   memcpy(codepoints, ustring, size * sizeof(Eina_Unicode));
+   for (unsigned int x = 0; x < size; x++)
+     attrs[x] = attr;
+
+   _dirty_add(grid, col, row, size);
+   return size;
+}
+
+void
+grid_clear(s_grid *grid)
+{
+   const size_t count = (size_t)grid->cols * grid->rows;
+   if (EINA_UNLIKELY(count == 0)) { return; }
+
+   /* The storage is contiguous: the whole grid is reset at once, no matter
+    * in which order the rows are */
+   memset(grid->codepoints, 0, count * sizeof(Eina_Unicode));
+   memset(grid->attrs, 0, count * sizeof(uint16_t));
+   grid_dirty_all(grid);
+}
+
+void
+grid_eol_clear(s_grid *grid,
+               unsigned int col,
+               unsigned int row)
+{
+   if (EINA_UNLIKELY((row >= grid->rows) || (col >= grid->cols)))
+     {
+        ERR("Attempt to clear outside of the grid. Discarding.");
+        return;
+     }
+   _cells_clear(grid, col, row, grid->cols - col);
+}
+
+void
+grid_scroll(s_grid *grid,
+            unsigned int top,
+            unsigned int bot,
+            unsigned int left,
+            unsigned int right,
+            int count)
+{
+   if (EINA_UNLIKELY((top > bot) || (left > right) ||
+                     (bot >= grid->rows) || (right >= grid->cols)))
+     {
+        ERR("Scrolling region is outside of the grid. Ignoring.");
+        return;
+     }
+
+   const unsigned int height = bot - top + 1;
+   const unsigned int width = right - left + 1;
+   const unsigned int shift = (unsigned int)abs(count);
+   if (shift == 0) { return; }
+   if (shift >= height)
+     {
+        /* Everything is scrolled out of the region */
+        for (unsigned int y = top; y <= bot; y++)
+          _cells_clear(grid, left, y, width);
+        return;
+     }
+
+   /*
+    * When scrolling upwards (count > 0), line N will be overwriten by line
+    * N+(count). The last lines are cleared.
+    *
+    * +------------------+     +------------------+
+    * | Line 0           |  ,> | Line 1           |
+    * +------------------+ /   +------------------+
+    * | Line 1           |' ,> | Line 2           |
+    * +------------------+ /   +------------------+
+    * | Line 2           |'    | xxxxxx           |
+    * +------------------+     +------------------+
+    *
+    * When scrolling downwards (count < 0), line N+(count) will be overwriten
+    * by line N. The first lines are cleared.
+    *
+    * +------------------+     +------------------+
+    * | Line 0           |,    | xxxxxx           |
+    * +------------------+ \   +------------------+
+    * | Line 1           |, '> | Line 0           |
+    * +------------------+ \   +------------------+
+    * | Line 2           |  '> | Line 1           |
+    * +------------------+     +------------------+
+    */
+   if ((left == 0) && (right == grid->cols - 1))
+     {
+        /*
+         * The region spans whole rows: no cell is moved, the rows are
+         * rotated in the index table. The rows that went around are the
+         * ones that are cleared.
+         */
+        _index_rotate(grid->index, top, bot,
+                      (count > 0) ? shift : height - shift);
+        const unsigned int cleared = (count > 0) ? bot - shift + 1 : top;
+        for (unsigned int y = cleared; y < cleared + shift; y++)
+          {
+             memset(_row_codepoints(grid, y), 0,
+                    grid->cols * sizeof(Eina_Unicode));
+             memset(_row_attrs(grid, y), 0, grid->cols * sizeof(uint16_t));
+          }
+     }
+   else
+     {
+        /* Only a part of the rows is moved (e.g. a vertical split) */
+        for (unsigned int i = 0; i < height - shift; i++)
+          {
+             const unsigned int dst = (count > 0) ? top + i : bot - i;
+             const unsigned int src = (count > 0) ? dst + shift : dst - shift;
+
+             memmove(&(_row_codepoints(grid, dst)[left]),
+                     &(_row_codepoints(grid, src)[left]),
+                     width * sizeof(Eina_Unicode));
+             memmove(&(_row_attrs(grid, dst)[left]),
+                     &(_row_attrs(grid, src)[left]),
+                     width * sizeof(uint16_t));
+          }
+        const unsigned int cleared = (count > 0) ? bot - shift + 1 : top;
+        for (unsigned int y = cleared; y < cleared + shift; y++)
+          {
+             memset(&(_row_codepoints(grid, y)[left]), 0,
+                    width * sizeof(Eina_Unicode));
+             memset(&(_row_attrs(grid, y)[left]), 0,
+                    width * sizeof(uint16_t));
+          }
+     }
+
+   /* The whole region is damaged, as a single rectangle */
+   _dirty_rect_add(grid, left, top, width, height);
+}
+
+void
+grid_dirty_all(s_grid *grid)
+{
+   if (EINA_UNLIKELY(grid->cols == 0))
+     {
+        grid_dirty_reset(grid);
+        return;
+     }
+   for (unsigned int y = 0; y < grid->rows; y++)
+     {
+        grid->dirty[y].first = 0;
+        grid->dirty[y].last = grid->cols - 1;
+     }
+   grid->has_dirty = (grid->rows > 0);
+}
+
+void
+grid_attr_dirty(s_grid *grid,
+                uint16_t attr)
+{
+   /* Each row is given the smallest span that covers the cells using it */
+   for (unsigned int y = 0; y < grid->rows; y++)
+     {
+        const uint16_t *const attrs = _row_attrs(grid, y);
+        unsigned int first = grid->cols;
+        unsigned int last = 0;
+        for (unsigned int x = 0; x < grid->cols; x++)
+          if (attrs[x] == attr)
+            {
+               if (first == grid->cols) first = x;
+               last = x;
+            }
+        if (first < grid->cols)
+          _dirty_add(grid, first, y, last - first + 1);
+     }
+}
+
+void
+grid_dirty_reset(s_grid *grid)
+{
+   for (unsigned int y = 0; y < grid->rows; y++)
+     {
+        grid->dirty[y].first = 1;
+        grid->dirty[y].last = 0;
+     }
+   grid->has_dirty = EINA_FALSE;
+}
@@ -28,6 +28,8 @@
 #include "eovim/log.h"
 #include "eovim/nvim_api.h"
 #include "eovim/config.h"
+#include "eovim/trace.h"
+#include "eovim/stats.h"
 #include <Elementary.h>
 
 static const char *const _nvim_data_key = "nvim";
@@ -138,6 +140,7 @@ _win_close_cb(void *data,
    s_nvim *const nvim = data;
    const char cmd[] = ":quitall!";
    nvim_api_command(nvim, cmd, sizeof(cmd) - 1);
+   nvim_api_flush(nvim);
 }
 
 Eina_Bool
@@ -171,6 +174,12 @@ gui_add(s_gui *gui,
    evas_object_smart_callback_add(gui->win, "delete,request", _win_close_cb, nvim);
    Evas *const evas = evas_object_evas_get(gui->win);
 
+   gui->latency = latency_new(evas, nvim->opts->latency_log);
+   if (EINA_UNLIKELY(! gui->latency))
+     {
+        CRI("Failed to set up the latency measures");
+        goto fail;
+     }
 
    /* Main Layout setup */
    gui->layout = _layout_item_add(gui->win, "eovim/main");
@@ -261,9 +270,13 @@ gui_add(s_gui *gui,
    evas_object_show(gui->layout);
    evas_object_show(gui->win);
    gui_resize(gui, nvim->opts->geometry.w, nvim->opts->geometry.h);
+   gui_overlay_show(gui, nvim->opts->latency_overlay);
+   trace_evas_attach(evas);
    return EINA_TRUE;
 
 fail:
+   latency_free(gui->latency);
+   gui->latency = NULL;
    if (gui->cache) eina_strbuf_free(gui->cache);
    if (gui->tabs) eina_inarray_free(gui->tabs);
    evas_object_del(gui->win);
@@ -274,6 +287,11 @@ void
 gui_del(s_gui *gui)
 {
    EINA_SAFETY_ON_NULL_RETURN(gui);
+   gui_overlay_show(gui, EINA_FALSE);
+   gui_hud_show(gui, EINA_FALSE);
+   trace_evas_detach(evas_object_evas_get(gui->win));
+   latency_free(gui->latency);
+   gui->latency = NULL;
    eina_inarray_free(gui->tabs);
    eina_strbuf_free(gui->cache);
    evas_object_del(gui->win);
@@ -357,6 +375,12 @@ gui_clear(s_gui *gui)
    termview_clear(gui->termview);
 }
 
+void
+gui_grid_clear(s_gui *gui)
+{
+   termview_grid_clear(gui->termview);
+}
+
 void
 gui_eol_clear(s_gui *gui)
 {
@@ -371,6 +395,17 @@ gui_put(s_gui *gui,
    termview_put(gui->termview, ustring, size);
 }
 
+void
+gui_cells_put(s_gui *gui,
+              unsigned int col,
+              unsigned int row,
+              unsigned int hl_id,
+              const Eina_Unicode *ustring,
+              unsigned int size)
+{
+   termview_cells_put(gui->termview, col, row, hl_id, ustring, size);
+}
+
 void
 gui_cursor_goto(s_gui *gui,
                 unsigned int to_x,
@@ -387,6 +422,14 @@ gui_style_set(s_gui *gui,
    termview_style_set(gui->termview, style);
 }
 
+void
+gui_hl_attr_define(s_gui *gui,
+                   unsigned int id,
+                   const s_termview_style *style)
+{
+   termview_hl_attr_define(gui->termview, id, style);
+}
+
 void
 gui_update_fg(s_gui *gui,
               t_int color)
@@ -445,6 +488,25 @@ gui_scroll(s_gui *gui,
      termview_scroll(gui->termview, scroll);
 }
 
+void
+gui_redraw_begin(s_gui *gui)
+{
+   latency_redraw_received(gui->latency);
+   termview_damage_batch_begin(gui->termview);
+}
+
+void
+gui_redraw_end(s_gui *gui)
+{
+   termview_damage_batch_end(gui->termview);
+}
+
+void
+gui_flush(s_gui *gui)
+{
+   termview_flush(gui->termview);
+}
+
 void
 gui_busy_set(s_gui *gui,
              Eina_Bool busy)
@@ -468,6 +530,97 @@ gui_busy_set(s_gui *gui,
      }
 }
 
+static Eina_Bool
+_overlay_refresh_cb(void *data)
+{
+   s_gui *const gui = data;
+   s_latency_stats stats;
+
+   /* Nothing changed since the last refresh: the text stays as it is */
+   latency_stats_get(gui->latency, &stats);
+   if (stats.samples == gui->overlay.samples)
+     return ECORE_CALLBACK_RENEW;
+   gui->overlay.samples = stats.samples;
+
+   eina_strbuf_reset(gui->cache);
+   if (stats.samples == 0)
+     eina_strbuf_append(gui->cache, "Keypress-to-paint: press a key");
+   else
+     eina_strbuf_append_printf(
+        gui->cache,
+        "Keypress-to-paint (last %u keys)<br>"
+        "p50 %.1f ms  p95 %.1f ms  p99 %.1f ms  max %.1f ms",
+        stats.window, stats.p50, stats.p95, stats.p99, stats.max);
+   elm_layout_text_set(gui->layout, "eovim.overlay",
+                       eina_strbuf_string_get(gui->cache));
+   return ECORE_CALLBACK_RENEW;
+}
+
+void
+gui_overlay_show(s_gui *gui,
+                 Eina_Bool show)
+{
+   if (show && (! gui->overlay.timer))
+     {
+        gui->overlay.timer = ecore_timer_add(0.5, _overlay_refresh_cb, gui);
+        if (EINA_UNLIKELY(! gui->overlay.timer))
+          {
+             CRI("Failed to create timer");
+             return;
+          }
+        gui->overlay.samples = UINT_MAX; /* Forces the refresh */
+        _overlay_refresh_cb(gui);
+        elm_layout_signal_emit(gui->layout, "eovim,overlay,show", "eovim");
+     }
+   else if ((! show) && gui->overlay.timer)
+     {
+        ecore_timer_del(gui->overlay.timer);
+        gui->overlay.timer = NULL;
+        elm_layout_signal_emit(gui->layout, "eovim,overlay,hide", "eovim");
+     }
+}
+
+static Eina_Bool
+_hud_refresh_cb(void *data)
+{
+   s_gui *const gui = data;
+
+   eina_strbuf_reset(gui->cache);
+   stats_text_append(gui->nvim, gui->cache);
+   elm_layout_text_set(gui->layout, "eovim.hud",
+                       eina_strbuf_string_get(gui->cache));
+   return ECORE_CALLBACK_RENEW;
+}
+
+void
+gui_hud_show(s_gui *gui,
+             Eina_Bool show)
+{
+   if (show && (! gui->hud.timer))
+     {
+        gui->hud.timer = ecore_timer_add(0.5, _hud_refresh_cb, gui);
+        if (EINA_UNLIKELY(! gui->hud.timer))
+          {
+             CRI("Failed to create timer");
+             return;
+          }
+        _hud_refresh_cb(gui);
+        elm_layout_signal_emit(gui->layout, "eovim,hud,show", "eovim");
+     }
+   else if ((! show) && gui->hud.timer)
+     {
+        ecore_timer_del(gui->hud.timer);
+        gui->hud.timer = NULL;
+        elm_layout_signal_emit(gui->layout, "eovim,hud,hide", "eovim");
+     }
+}
+
+Eina_Bool
+gui_hud_shown_get(const s_gui *gui)
+{
+   return (gui->hud.timer != NULL);
+}
+
 void
 gui_bg_color_set(s_gui *gui,
                  int r, int g, int b, int a)
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_GRID_H__
+#define __EOVIM_GRID_H__
+
+#include "eovim/types.h"
+
+typedef struct grid s_grid;
+typedef struct grid_span s_grid_span;
+
+/**
+ * A grid is the model of the screen neovim draws on. It does not depend on
+ * any graphical toolkit: each cell is a codepoint and the identifier of a
+ * highlight attribute, and what these identifiers mean is up to the user of
+ * the grid.
+ *
+ * Codepoints and attributes are stored in two separate arrays. Rows are not
+ * addressed directly, but through an index table, so they can be moved
+ * around without moving their cells: scrolling whole rows is only a
+ * rotation of the index table. The grid also keeps track of the cells
+ * that were modified (the dirty span of each row) since the last call to
+ * grid_dirty_reset().
+ */
+struct grid_span
+{
+   unsigned int first; /**< First column */
+   unsigned int last; /**< Last column. The span is empty if last < first */
+};
+
+struct grid
+{
+   unsigned int cols;
+   unsigned int rows;
+   Eina_Unicode *codepoints; /**< rows * cols codepoints */
+   uint16_t *attrs; /**< rows * cols attribute identifiers */
+   unsigned int *index; /**< Storage row of each row of the grid */
+   s_grid_span *dirty; /**< Dirty span of each row of the grid */
+   Eina_Bool has_dirty; /**< At least one span is not empty */
+};
+
+s_grid *grid_new(unsigned int cols, unsigned int rows);
+void grid_free(s_grid *grid);
+Eina_Bool grid_resize(s_grid *grid, unsigned int cols, unsigned int rows);
+unsigned int grid_put(s_grid *grid, unsigned int col, unsigned int row, const Eina_Unicode *ustring, unsigned int size, uint16_t attr);
+void grid_clear(s_grid *grid);
+void grid_eol_clear(s_grid *grid, unsigned int col, unsigned int row);
+void grid_scroll(s_grid *grid, unsigned int top, unsigned int bot, unsigned int left, unsigned int right, int count);
+void grid_dirty_all(s_grid *grid);
+void grid_attr_dirty(s_grid *grid, uint16_t attr);
+void grid_dirty_reset(s_grid *grid);
+
+static inline const Eina_Unicode *
+grid_row_codepoints_get(const s_grid *grid, unsigned int row)
+{
+   return &(grid->codepoints[grid->index[row] * grid->cols]);
+}
+
+static inline const uint16_t *
+grid_row_attrs_get(const s_grid *grid, unsigned int row)
+{
+   return &(grid->attrs[grid->index[row] * grid->cols]);
+}
+
+#endif /* ! __EOVIM_GRID_H__ */
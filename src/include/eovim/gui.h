@@ -27,6 +27,7 @@
 
 #include "eovim/termview.h"
 #include "eovim/prefs.h"
+#include "eovim/latency.h"
 #include "eovim/types.h"
 
 struct gui
@@ -68,6 +69,15 @@ struct gui
 
    s_prefs prefs;
 
+   s_latency *latency; /**< Keypress-to-paint latency measures */
+   struct {
+      Ecore_Timer *timer; /**< Refreshes the overlay while it is shown */
+      unsigned int samples; /**< Latency samples last displayed */
+   } overlay;
+   struct {
+      Ecore_Timer *timer; /**< Refreshes the HUD while it is shown */
+   } hud;
+
    s_nvim *nvim;
    Eina_Inarray *tabs;
 
@@ -86,16 +96,25 @@ void gui_del(s_gui *gui);
 void gui_resize(s_gui *gui, unsigned int cols, unsigned int rows);
 void gui_resized_confirm(s_gui *gui, unsigned int cols, unsigned int rows);
 void gui_clear(s_gui *gui);
+void gui_grid_clear(s_gui *gui);
 void gui_eol_clear(s_gui *gui);
 void gui_put(s_gui *gui, const Eina_Unicode *ustring, unsigned int size);
+void gui_cells_put(s_gui *gui, unsigned int col, unsigned int row, unsigned int hl_id, const Eina_Unicode *ustring, unsigned int size);
 void gui_cursor_goto(s_gui *gui, unsigned int to_x, unsigned int to_y);
 void gui_style_set(s_gui *gui, const s_termview_style *style);
+void gui_hl_attr_define(s_gui *gui, unsigned int id, const s_termview_style *style);
 void gui_update_fg(s_gui *gui, t_int color);
 void gui_update_bg(s_gui *gui, t_int color);
 void gui_update_sp(s_gui *gui, t_int color);
 void gui_scroll_region_set(s_gui *gui, int x, int y, int w, int h);
 void gui_scroll(s_gui *gui, int scroll);
+void gui_redraw_begin(s_gui *gui);
+void gui_redraw_end(s_gui *gui);
+void gui_flush(s_gui *gui);
 void gui_busy_set(s_gui *gui, Eina_Bool busy);
+void gui_overlay_show(s_gui *gui, Eina_Bool show);
+void gui_hud_show(s_gui *gui, Eina_Bool show);
+Eina_Bool gui_hud_shown_get(const s_gui *gui);
 void gui_bg_color_set(s_gui *gui, int r, int g, int b, int a);
 void gui_config_show(s_gui *gui);
 void gui_config_hide(s_gui *gui);
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_LATENCY_H__
+#define __EOVIM_LATENCY_H__
+
+#include <Evas.h>
+
+/**
+ * @file latency.h
+ *
+ * Measure of the keypress-to-paint latency: the time between the moment a
+ * key press is handled by eovim, and the end of the first rendering of the
+ * canvas that follows the first redraw batch received after it.
+ */
+
+typedef struct latency s_latency;
+typedef struct latency_stats s_latency_stats;
+
+struct latency_stats
+{
+   unsigned int samples; /**< Keys measured since the beginning */
+   unsigned int window; /**< Keys the percentiles are computed over */
+   double p50; /**< Milliseconds */
+   double p95; /**< Milliseconds */
+   double p99; /**< Milliseconds */
+   double max; /**< Milliseconds */
+};
+
+s_latency *latency_new(Evas *evas, const char *log_path);
+void latency_free(s_latency *lat);
+void latency_key_pressed(s_latency *lat);
+void latency_redraw_received(s_latency *lat);
+void latency_stats_get(const s_latency *lat, s_latency_stats *stats);
+
+#endif /* ! __EOVIM_LATENCY_H__ */
@@ -23,12 +23,40 @@
 #ifndef __EOVIM_LOG_H__
 #define __EOVIM_LOG_H__
 
+#include <Eina.h>
+
 extern int _eovim_log_domain;
 
-#define DBG(...) EINA_LOG_DOM_DBG(_eovim_log_domain, __VA_ARGS__)
-#define INF(...) EINA_LOG_DOM_INFO(_eovim_log_domain, __VA_ARGS__)
-#define WRN(...) EINA_LOG_DOM_WARN(_eovim_log_domain, __VA_ARGS__)
-#define ERR(...) EINA_LOG_DOM_ERR(_eovim_log_domain, __VA_ARGS__)
-#define CRI(...) EINA_LOG_DOM_CRIT(_eovim_log_domain, __VA_ARGS__)
+/*
+ * Messages that are less severe than EOVIM_LOG_LEVEL_MIN (an Eina_Log_Level,
+ * from 0 for critical errors to 4 for debug) are compiled out. It is set by
+ * the build system, and defaults to keeping all of them.
+ */
+#ifndef EOVIM_LOG_LEVEL_MIN
+# define EOVIM_LOG_LEVEL_MIN 4 /* EINA_LOG_LEVEL_DBG */
+#endif
+
+/*
+ * Tells whether messages of level @p Level are to be printed. Eina would
+ * find it out by itself, but only after the arguments of the message have
+ * been evaluated and passed, and its log lock has been taken. This is
+ * costly for debug messages in hot paths, which are filtered most of the
+ * time. It can also be used to skip the computation of what is logged.
+ */
+#define LOG_CHECK(Level) \
+   (((Level) <= EOVIM_LOG_LEVEL_MIN) && \
+    EINA_UNLIKELY(eina_log_domain_level_check(_eovim_log_domain, (Level))))
+
+#define LOG(Level, ...) \
+   do { \
+      if (LOG_CHECK(Level)) \
+        EINA_LOG(_eovim_log_domain, (Level), __VA_ARGS__); \
+   } while (0)
+
+#define DBG(...) LOG(EINA_LOG_LEVEL_DBG, __VA_ARGS__)
+#define INF(...) LOG(EINA_LOG_LEVEL_INFO, __VA_ARGS__)
+#define WRN(...) LOG(EINA_LOG_LEVEL_WARN, __VA_ARGS__)
+#define ERR(...) LOG(EINA_LOG_LEVEL_ERR, __VA_ARGS__)
+#define CRI(...) LOG(EINA_LOG_LEVEL_CRITICAL, __VA_ARGS__)
 
 #endif /* ! __EOVIM_LOG_H__ */
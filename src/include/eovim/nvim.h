@@ -27,10 +27,15 @@
 #include "eovim/options.h"
 #include "eovim/nvim_helper.h"
 #include "eovim/gui.h"
+#include "eovim/nvim_reader.h"
+#include "eovim/nvim_writer.h"
+#include "eovim/request_table.h"
+#include "eovim/stats.h"
 
 #include <Eina.h>
 #include <Ecore.h>
 #include <msgpack.h>
+#include <sys/types.h>
 
 #define NVIM_VERSION_MAJOR(Nvim) ((Nvim)->version.major)
 #define NVIM_VERSION_MINOR(Nvim) ((Nvim)->version.minor)
@@ -41,6 +46,14 @@
     NVIM_VERSION_MINOR(Nvim) == (Minor) && \
     NVIM_VERSION_PATCH(Nvim) == (Patch))
 
+#define NVIM_VERSION_ENCODE(Major, Minor, Patch) \
+   (((uint64_t)(Major) << 40) | ((uint64_t)(Minor) << 20) | (uint64_t)(Patch))
+
+#define NVIM_VERSION_GE(Nvim, Major, Minor, Patch) \
+   (NVIM_VERSION_ENCODE(NVIM_VERSION_MAJOR(Nvim), NVIM_VERSION_MINOR(Nvim), \
+                        NVIM_VERSION_PATCH(Nvim)) >= \
+    NVIM_VERSION_ENCODE(Major, Minor, Patch))
+
 struct nvim
 {
    s_gui gui;
@@ -48,21 +61,40 @@ struct nvim
    s_config *config;
    const s_options *opts;
 
-   Ecore_Exe *exe;
-   Eina_List *requests;
+   pid_t pid; /**< Neovim's process. 0 when a recorded session is replayed */
+   int exit_code; /**< Neovim's exit status, which is also eovim's */
+   s_nvim_reader *reader; /**< Reads and decodes neovim's stdout */
+   s_nvim_writer *writer; /**< Writes neovim's stdin. NULL when replaying */
+   s_rpc_recorder *recorder; /**< Records the session. May be NULL */
+   s_rpc_replayer *replayer; /**< Replays a session in place of neovim */
+   struct {
+      s_request_table table; /**< Requests waiting for an answer */
+      unsigned int expired; /**< Number of requests that were never answered */
+      double timeout; /**< Seconds before requests expire. 0 if they don't */
+      Ecore_Timer *sweeper; /**< Expires requests, if @p timeout is set */
+   } requests;
    Eina_Hash *modes;
    Eina_Inlist *tabs;
 
-   msgpack_unpacker unpacker;
-   msgpack_sbuffer sbuffer;
+   msgpack_sbuffer sbuffer; /**< Messages waiting to be sent to neovim */
+   Ecore_Idle_Enterer *flusher; /**< Sends @p sbuffer once per loop iteration */
+   uint32_t flush_uid; /**< Identifier of the first request in @p sbuffer */
+   struct {
+      Eina_Strbuf *keys; /**< Input waiting to be sent in one nvim_input */
+      unsigned int pending; /**< Number of inputs accumulated in @p keys */
+      unsigned int inputs; /**< Total number of inputs */
+      unsigned int requests; /**< Total number of nvim_input calls */
+   } input;
+   Eina_Inlist *pastes; /**< Pastes to be sent to neovim, the first one first */
    msgpack_packer packer;
    uint32_t request_id;
+   s_stats stats; /**< Counters of the traffic and of the drawing */
 
    void (*hl_group_decode)(s_nvim *, unsigned int, f_highlight_group_decode);
 
-   Eina_UStrbuf *decode;
    Eina_Bool mouse_enabled;
    Eina_Bool true_colors;
+   Eina_Bool ui_attached; /**< nvim_ui_attach() has been sent */
 };
 
 
@@ -27,13 +27,42 @@
 #include <Eina.h>
 #include <msgpack.h>
 
-typedef void (*f_nvim_api_cb)(s_nvim *nvim, void *data, const msgpack_object *result);
+/** The API functions that eovim calls */
+typedef enum
+{
+   E_API_UI_ATTACH,
+   E_API_UI_SET_OPTION,
+   E_API_UI_TRY_RESIZE,
+   E_API_INPUT,
+   E_API_PASTE,
+   E_API_EVAL,
+   E_API_COMMAND,
+   E_API_COMMAND_OUTPUT,
+   E_API_SET_VAR,
 
+   __E_API_LAST /**< Sentinel */
+} e_api;
+
+/**
+ * Called with the result of a request. If the request failed (neovim reported
+ * an error, answered with garbage, or did not answer in time), @p error tells
+ * why and @p result is NULL. Otherwise @p error is NULL, and @p result is the
+ * result, which may be nil.
+ */
+typedef void (*f_nvim_api_cb)(s_nvim *nvim, void *data, const msgpack_object *result,
+                              const char *error);
+typedef void (*f_nvim_api_pack)(s_nvim *nvim, msgpack_packer *pk);
+
+const char *nvim_api_name_get(e_api api);
 Eina_Bool nvim_api_ui_attach(s_nvim *nvim, unsigned int width, unsigned int height);
 Eina_Bool nvim_api_ui_try_resize(s_nvim *nvim, unsigned int width, unsigned height);
 Eina_Bool nvim_api_ui_ext_cmdline_set(s_nvim *nvim, Eina_Bool externalize);
 Eina_Bool nvim_api_ui_ext_wildmenu_set(s_nvim *nvim, Eina_Bool externalize);
 Eina_Bool nvim_api_input(s_nvim *nvim, const char *input, unsigned int input_size);
+Eina_Bool nvim_api_input_request(s_nvim *nvim, const char *input, unsigned int input_size,
+                                 f_nvim_api_cb func, void *func_data);
+Eina_Bool nvim_api_paste(s_nvim *nvim, const char *data, size_t size, int phase,
+                         f_nvim_api_cb func, void *func_data);
 
 Eina_Bool nvim_api_eval(s_nvim *nvim, const char *input, unsigned int input_size,
                         f_nvim_api_cb func, void *func_data);
@@ -49,12 +78,15 @@ nvim_api_command(s_nvim *nvim,
                  const char *input,
                  unsigned int input_size);
 
-Eina_List *nvim_api_request_find(const s_nvim *nvim, uint32_t req_id);
-void nvim_api_request_free(s_nvim *nvim, Eina_List *req_item);
-void nvim_api_request_call(s_nvim *nvim, const Eina_List *req_item, const msgpack_object *result);
+s_request *nvim_api_request_find(const s_nvim *nvim, uint32_t req_id);
+void nvim_api_request_answered(s_nvim *nvim, const s_request *req);
+void nvim_api_request_free(s_nvim *nvim, s_request *req);
+void nvim_api_request_call(s_nvim *nvim, s_request *req, const msgpack_object *result,
+                           const char *error);
+void nvim_api_requests_drop(s_nvim *nvim);
+Eina_Bool nvim_api_requests_timeout_set(s_nvim *nvim, double timeout);
+Eina_Bool nvim_api_flush(s_nvim *nvim);
 Eina_Bool nvim_api_var_integer_set(s_nvim *nvim, const char *name, int value);
-
-Eina_Bool nvim_api_init(void);
-void nvim_api_shutdown(void);
+Eina_Bool nvim_api_var_set(s_nvim *nvim, const char *name, f_nvim_api_pack pack);
 
 #endif /* ! __EOVIM_API_H__ */
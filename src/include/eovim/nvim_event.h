@@ -26,9 +26,29 @@
 #include "eovim/types.h"
 #include <msgpack.h>
 
+typedef enum
+{
+   E_METHOD_REDRAW, /**< The "redraw" method */
+   E_METHOD_EOVIM, /**< The "eovim" method */
+   E_METHOD_ERROR, /**< The "nvim_error_event" method */
+
+   __E_METHOD_LAST /**< Sentinel. Also denotes unknown methods */
+} e_method;
+
+typedef enum
+{
+#define REDRAW_COMMAND(Id, Name) E_REDRAW_ ## Id,
+#include "eovim/redraw_commands.x"
+
+   __E_REDRAW_LAST /**< Sentinel. Also denotes unknown commands */
+} e_redraw_command;
+
 Eina_Bool nvim_event_plugin_register(const char *command, f_event_cb callback);
-Eina_Bool nvim_event_dispatch(s_nvim *nvim, Eina_Stringshare *method_name,
-                              Eina_Stringshare *command, const msgpack_object_array *args);
+e_method nvim_event_method_get(const char *name, size_t len);
+e_redraw_command nvim_event_redraw_command_get(const char *name, size_t len);
+const char *nvim_event_redraw_command_name_get(e_redraw_command command);
+Eina_Bool nvim_event_redraw_dispatch(s_nvim *nvim, e_redraw_command command, const msgpack_object_array *args);
+Eina_Bool nvim_event_plugin_dispatch(s_nvim *nvim, const msgpack_object_str *command, const msgpack_object_array *args);
 Eina_Bool nvim_event_init(void);
 void nvim_event_shutdown(void);
 
@@ -35,7 +35,10 @@ typedef struct
    } bg, fg;
 } s_hl_group;
 
+typedef struct paste s_paste;
+
 typedef void (*f_highlight_group_decode)(s_nvim *nvim, const s_hl_group *hl_group);
+/** @p version is zeroed if the version of neovim could not be found out */
 typedef void (*f_version_decode)(s_nvim *nvim, const s_version *version);
 
 void
@@ -52,4 +55,12 @@ void
 nvim_helper_version_decode(s_nvim *nvim,
                            f_version_decode func);
 
+Eina_Bool
+nvim_helper_paste(s_nvim *nvim,
+                  const char *data,
+                  size_t size);
+
+void
+nvim_helper_paste_abort(s_nvim *nvim);
+
 #endif /* ! __EOVIM_NVIM_HELPER_H__ */
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_NVIM_READER_H__
+#define __EOVIM_NVIM_READER_H__
+
+#include "eovim/types.h"
+#include "eovim/redraw.h"
+#include "eovim/rpc_record.h"
+#include <msgpack.h>
+
+typedef struct nvim_reader s_nvim_reader;
+typedef struct nvim_msg s_nvim_msg;
+
+/**
+ * A message received from neovim, fully unpacked by the reader thread.
+ */
+struct nvim_msg
+{
+   msgpack_zone *zone; /**< Owns all the memory @p args refers to */
+   msgpack_object_array args; /**< [type, ...] as received from neovim */
+   s_redraw_batch *redraw; /**< Decoded commands of a "redraw" notification */
+};
+
+typedef void (*f_nvim_msg_cb)(s_nvim *nvim, const s_nvim_msg *msg);
+
+s_nvim_reader *nvim_reader_new(s_nvim *nvim, int fd, s_rpc_recorder *recorder, f_nvim_msg_cb func);
+void nvim_reader_free(s_nvim_reader *reader);
+
+#endif /* ! __EOVIM_NVIM_READER_H__ */
@@ -32,10 +32,18 @@ typedef struct
    const char *config_path;
    const char *nvim_prog;
    const char *theme;
+   const char *record_rpc; /**< Where to record the session with neovim */
+   const char *replay_rpc; /**< Recorded session to replay instead of neovim */
+   const char *latency_log; /**< Where to log the latency of each key */
+   const char *trace; /**< Where to write the trace. NULL if not tracing */
+   double request_timeout; /**< Seconds before requests expire. 0: never */
 
    Eina_Bool no_plugins;
    Eina_Bool fullscreen;
    Eina_Bool forbidden;
+   Eina_Bool replay_fast; /**< Replay as fast as possible */
+   Eina_Bool latency_overlay; /**< Display the latency percentiles */
+   Eina_Bool rpc_errors; /**< Send ignored calls as requests, not notifications */
 } s_options;
 
 typedef enum
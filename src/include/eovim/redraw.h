@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_REDRAW_H__
+#define __EOVIM_REDRAW_H__
+
+#include "eovim/types.h"
+#include "eovim/termview.h"
+#include "eovim/nvim_event.h"
+#include <msgpack.h>
+
+typedef struct redraw_cmd s_redraw_cmd;
+typedef struct redraw_batch s_redraw_batch;
+
+/**
+ * Kinds of redraw commands that are decoded ahead of time, outside of the
+ * main loop. Everything that is not performance-critical is kept as the raw
+ * msgpack command, and dispatched through nvim_event_redraw_dispatch().
+ */
+typedef enum
+{
+   REDRAW_CMD_PUT,
+   REDRAW_CMD_CURSOR_GOTO,
+   REDRAW_CMD_HIGHLIGHT_SET,
+   REDRAW_CMD_SCROLL,
+   REDRAW_CMD_SCROLL_REGION,
+   REDRAW_CMD_CLEAR,
+   REDRAW_CMD_EOL_CLEAR,
+   REDRAW_CMD_GRID_LINE,
+   REDRAW_CMD_GRID_CLEAR,
+   REDRAW_CMD_GENERIC,
+} e_redraw_cmd;
+
+struct redraw_cmd
+{
+   e_redraw_cmd type;
+   union {
+      struct {
+         unsigned int start; /**< Index of the first codepoint in the batch */
+         unsigned int count; /**< Number of codepoints to be put */
+      } put;
+      struct {
+         unsigned int row;
+         unsigned int col;
+         unsigned int hl_id; /**< Highlight attribute of the whole segment */
+         unsigned int start; /**< Index of the first codepoint in the batch */
+         unsigned int count; /**< Number of cells to be written */
+      } line;
+      struct {
+         unsigned int x;
+         unsigned int y;
+      } cursor;
+      struct {
+         int top;
+         int bot;
+         int left;
+         int right;
+      } region;
+      s_termview_style style;
+      int scroll;
+      struct {
+         e_redraw_command id;
+         const msgpack_object_array *args; /**< [name, args...] */
+      } generic;
+   } u;
+};
+
+/**
+ * A redraw batch is the result of the decoding of one "redraw" notification.
+ * It is created by the reader thread, and applied (then freed) by the main
+ * loop.
+ */
+struct redraw_batch
+{
+   s_redraw_cmd *cmds;
+   unsigned int cmds_count;
+   unsigned int cmds_alloc;
+
+   Eina_Unicode *codepoints; /**< Characters of all the put commands */
+   unsigned int cp_count;
+   unsigned int cp_alloc;
+};
+
+s_redraw_batch *redraw_batch_decode(const msgpack_object_array *commands);
+void redraw_batch_apply(s_nvim *nvim, const s_redraw_batch *batch);
+void redraw_cmd_apply(s_nvim *nvim, const s_redraw_batch *batch, const s_redraw_cmd *cmd);
+e_redraw_command redraw_cmd_command_get(const s_redraw_cmd *cmd);
+void redraw_batch_free(s_redraw_batch *batch);
+Eina_Bool redraw_style_decode(const msgpack_object_map *map, s_termview_style *style);
+
+#endif /* ! __EOVIM_REDRAW_H__ */
@@ -0,0 +1,60 @@
+/*
+ * List of the redraw commands neovim may send us. This file is meant to be
+ * included after having defined the macro REDRAW_COMMAND(Id, Name), where
+ * Id is the suffix of the e_redraw_command enumerator, and Name the name of
+ * the command, as sent by neovim. The macro is undefined afterwards.
+ *
+ * When adding a command here, nvim_event_redraw_command_get() must be
+ * updated accordingly. This is checked when eovim starts.
+ */
+
+REDRAW_COMMAND(RESIZE, resize)
+REDRAW_COMMAND(CLEAR, clear)
+REDRAW_COMMAND(EOL_CLEAR, eol_clear)
+REDRAW_COMMAND(CURSOR_GOTO, cursor_goto)
+REDRAW_COMMAND(MODE_INFO_SET, mode_info_set)
+REDRAW_COMMAND(UPDATE_MENU, update_menu)
+REDRAW_COMMAND(BUSY_START, busy_start)
+REDRAW_COMMAND(BUSY_STOP, busy_stop)
+REDRAW_COMMAND(MOUSE_ON, mouse_on)
+REDRAW_COMMAND(MOUSE_OFF, mouse_off)
+REDRAW_COMMAND(MODE_CHANGE, mode_change)
+REDRAW_COMMAND(SET_SCROLL_REGION, set_scroll_region)
+REDRAW_COMMAND(SCROLL, scroll)
+REDRAW_COMMAND(HIGHLIGHT_SET, highlight_set)
+REDRAW_COMMAND(PUT, put)
+REDRAW_COMMAND(BELL, bell)
+REDRAW_COMMAND(VISUAL_BELL, visual_bell)
+REDRAW_COMMAND(UPDATE_FG, update_fg)
+REDRAW_COMMAND(UPDATE_BG, update_bg)
+REDRAW_COMMAND(UPDATE_SP, update_sp)
+REDRAW_COMMAND(SUSPEND, suspend)
+REDRAW_COMMAND(SET_TITLE, set_title)
+REDRAW_COMMAND(SET_ICON, set_icon)
+REDRAW_COMMAND(POPUPMENU_SHOW, popupmenu_show)
+REDRAW_COMMAND(POPUPMENU_HIDE, popupmenu_hide)
+REDRAW_COMMAND(POPUPMENU_SELECT, popupmenu_select)
+REDRAW_COMMAND(TABLINE_UPDATE, tabline_update)
+REDRAW_COMMAND(CMDLINE_SHOW, cmdline_show)
+REDRAW_COMMAND(CMDLINE_POS, cmdline_pos)
+REDRAW_COMMAND(CMDLINE_SPECIAL_CHAR, cmdline_special_char)
+REDRAW_COMMAND(CMDLINE_HIDE, cmdline_hide)
+REDRAW_COMMAND(CMDLINE_BLOCK_SHOW, cmdline_block_show)
+REDRAW_COMMAND(CMDLINE_BLOCK_APPEND, cmdline_block_append)
+REDRAW_COMMAND(CMDLINE_BLOCK_HIDE, cmdline_block_hide)
+REDRAW_COMMAND(WILDMENU_SHOW, wildmenu_show)
+REDRAW_COMMAND(WILDMENU_HIDE, wildmenu_hide)
+REDRAW_COMMAND(WILDMENU_SELECT, wildmenu_select)
+REDRAW_COMMAND(FLUSH, flush)
+
+/* Line-based grid events, sent when ext_linegrid is negotiated */
+REDRAW_COMMAND(GRID_RESIZE, grid_resize)
+REDRAW_COMMAND(GRID_LINE, grid_line)
+REDRAW_COMMAND(GRID_SCROLL, grid_scroll)
+REDRAW_COMMAND(GRID_CLEAR, grid_clear)
+REDRAW_COMMAND(GRID_CURSOR_GOTO, grid_cursor_goto)
+REDRAW_COMMAND(HL_ATTR_DEFINE, hl_attr_define)
+REDRAW_COMMAND(HL_GROUP_SET, hl_group_set)
+REDRAW_COMMAND(DEFAULT_COLORS_SET, default_colors_set)
+
+#undef REDRAW_COMMAND
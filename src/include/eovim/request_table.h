@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_REQUEST_TABLE_H__
+#define __EOVIM_REQUEST_TABLE_H__
+
+#include "eovim/types.h"
+#include "eovim/nvim_api.h"
+
+/* Smallest size of the table of pending requests. A power of two. */
+#define REQUEST_TABLE_MIN_SIZE 64u
+
+typedef struct request_table s_request_table;
+
+struct request
+{
+   struct {
+      f_nvim_api_cb func;
+      void *data;
+   } cb;
+   e_api api; /**< API function that was called */
+   double sent; /**< Time at which the request was made */
+   uint32_t uid;
+   Eina_Bool pending; /**< Is the slot in use? */
+};
+
+/**
+ * Requests waiting for the answer of neovim, found by their identifier.
+ *
+ * This is an open addressing hash table with linear probing: a request is
+ * stored in the first free slot from (uid & mask). As identifiers are
+ * consecutive, requests rarely share that slot. The table is sized by the
+ * number of pending requests, which keep it at most 3/4 full, and not by
+ * the range of their identifiers: a request that neovim never answers
+ * only holds its own slot, however many requests are answered meanwhile.
+ *
+ * Adding or removing a request may move the other ones, so a pointer to a
+ * request is only valid until the table is modified again.
+ */
+struct request_table
+{
+   s_request *slots; /**< NULL until the first request is added */
+   uint32_t mask; /**< Number of slots minus one */
+   unsigned int count; /**< Number of pending requests */
+};
+
+s_request *request_table_add(s_request_table *table, uint32_t uid);
+s_request *request_table_find(const s_request_table *table, uint32_t uid);
+void request_table_del(s_request_table *table, s_request *req);
+void request_table_clear(s_request_table *table);
+
+#endif /* ! __EOVIM_REQUEST_TABLE_H__ */
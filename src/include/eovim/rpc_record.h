@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_RPC_RECORD_H__
+#define __EOVIM_RPC_RECORD_H__
+
+#include <Eina.h>
+#include <stdint.h>
+
+/**
+ * @file rpc_record.h
+ *
+ * Recording of the msgpack-rpc session with neovim, and replay of a recorded
+ * session in place of a neovim process.
+ *
+ * A recording starts with the 8 bytes magic @c RPC_RECORD_MAGIC, followed by
+ * records made of a header and of the bytes that were transferred:
+ *
+ *   - the direction of the transfer (one byte, see @ref e_rpc_dir),
+ *   - the time of the transfer, in nanoseconds since the beginning of the
+ *     recording (64 bits),
+ *   - the amount of bytes transferred (32 bits).
+ *
+ * Integers are stored in the byte order of the recording machine.
+ */
+
+#define RPC_RECORD_MAGIC "EORPC\0\0\1"
+
+typedef enum
+{
+   RPC_DIR_RECEIVED = 0, /**< Bytes neovim sent to eovim */
+   RPC_DIR_SENT = 1, /**< Bytes eovim sent to neovim */
+} e_rpc_dir;
+
+typedef struct rpc_recorder s_rpc_recorder;
+typedef struct rpc_replayer s_rpc_replayer;
+
+s_rpc_recorder *rpc_recorder_new(const char *path);
+void rpc_recorder_free(s_rpc_recorder *rec);
+void rpc_recorder_write(s_rpc_recorder *rec, e_rpc_dir dir, const void *data, size_t size);
+
+s_rpc_replayer *rpc_replayer_new(const char *path, Eina_Bool paced, int *fd);
+void rpc_replayer_free(s_rpc_replayer *rep);
+
+#endif /* ! __EOVIM_RPC_RECORD_H__ */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_STATS_H__
+#define __EOVIM_STATS_H__
+
+#include "eovim/types.h"
+#include "eovim/nvim_event.h"
+#include "eovim/nvim_api.h"
+
+#include <Eina.h>
+#include <msgpack.h>
+#include <stdatomic.h>
+
+/**
+ * @file stats.h
+ *
+ * Counters of the traffic with neovim and of the work done to display it.
+ * They are cheap enough to be always maintained. They can be displayed in
+ * a HUD, and neovim can query them with :call Eovim("stats").
+ */
+
+typedef struct stats s_stats;
+typedef struct stats_api s_stats_api;
+
+/*
+ * Response times are counted in a histogram of microseconds, in the manner
+ * of HDR histograms: each power of two is split in (1 << STATS_HIST_SUB_BITS)
+ * buckets of the same width, so a value is known with a relative error of
+ * at most 25%, from one microsecond to more than an hour, in 124 counters.
+ */
+#define STATS_HIST_SUB_BITS 2u
+#define STATS_HIST_BUCKETS ((32u - STATS_HIST_SUB_BITS + 1u) << STATS_HIST_SUB_BITS)
+
+struct stats_api
+{
+   unsigned long answered; /**< Responses received */
+   unsigned long expired; /**< Requests that were never answered in time */
+   double total; /**< Seconds spent waiting for the responses */
+   double max; /**< Longest wait for a response, in seconds */
+   unsigned int hist[STATS_HIST_BUCKETS]; /**< Responses per wait time */
+};
+
+struct stats
+{
+   atomic_ulong bytes_in; /**< Read from neovim, by the reader thread */
+   atomic_ulong messages; /**< Decoded, by the reader thread */
+   unsigned long bytes_out; /**< Sent to neovim */
+   unsigned long redraw[__E_REDRAW_LAST]; /**< Commands applied, per type */
+   s_stats_api apis[__E_API_LAST]; /**< Requests, per API function */
+};
+
+Eina_Bool stats_init(void);
+void stats_shutdown(void);
+void stats_api_answered(s_stats_api *api, double elapsed);
+void stats_api_expired(s_stats_api *api);
+double stats_api_percentile_get(const s_stats_api *api, double percentile);
+void stats_pack(s_nvim *nvim, msgpack_packer *pk);
+void stats_text_append(const s_nvim *nvim, Eina_Strbuf *buf);
+
+#endif /* ! __EOVIM_STATS_H__ */
@@ -28,6 +28,8 @@
 
 typedef struct termview_style s_termview_style;
 typedef struct termview_color s_termview_color;
+typedef struct termview_palette_stats s_termview_palette_stats;
+typedef struct termview_damage_stats s_termview_damage_stats;
 
 struct termview_color
 {
@@ -49,6 +51,26 @@ struct termview_style
    Eina_Bool undercurl;
 };
 
+struct termview_palette_stats
+{
+   unsigned int used; /**< Palettes currently allocated */
+   unsigned int allocations; /**< Palettes that were (re)allocated */
+   unsigned int sweeps; /**< Times the textgrid was scanned for palettes */
+   unsigned int evictions; /**< Palettes that were recycled */
+   unsigned int forced_evictions; /**< Recycled while being displayed */
+   unsigned int repainted_attrs; /**< Attributes given back default colors */
+};
+
+struct termview_damage_stats
+{
+   unsigned int requested; /**< Damaged areas, as they were reported */
+   unsigned int submitted; /**< Rectangles actually sent to the textgrid */
+   unsigned int cells; /**< Cells that differed from the presented ones */
+   unsigned int batches; /**< Redraw batches that were applied */
+   unsigned int frames; /**< Times the shadow grid was presented */
+   unsigned int fallbacks; /**< Frames presented without a flush */
+};
+
 
 Eina_Bool termview_init(void);
 void termview_shutdown(void);
@@ -60,14 +82,22 @@ void termview_cell_size_get(const Evas_Object *obj, unsigned int *w, unsigned in
 void termview_size_get(const Evas_Object *obj, unsigned int *cols, unsigned int *rows);
 void termview_refresh(Evas_Object *obj);
 void termview_clear(Evas_Object *obj);
+void termview_grid_clear(Evas_Object *obj);
 void termview_eol_clear(Evas_Object *obj);
 void termview_put(Evas_Object *obj, const Eina_Unicode *ustring, unsigned int size);
+void termview_cells_put(Evas_Object *obj, unsigned int col, unsigned int row, unsigned int hl_id, const Eina_Unicode *ustring, unsigned int size);
 void termview_cursor_goto(Evas_Object *obj, unsigned int to_x, unsigned int to_y);
 void termview_style_set(Evas_Object *obj, const s_termview_style *style);
+void termview_hl_attr_define(Evas_Object *obj, unsigned int id, const s_termview_style *style);
 void termview_scroll_region_set(Evas_Object *obj, const Eina_Rectangle *region);
 void termview_scroll(Evas_Object *obj, int count);
 void termview_fg_color_set(Evas_Object *obj, int r, int g, int b, int a);
 void termview_fg_color_get(const Evas_Object *obj, int *r, int *g, int *b, int *a);
+void termview_damage_batch_begin(Evas_Object *obj);
+void termview_damage_batch_end(Evas_Object *obj);
+void termview_flush(Evas_Object *obj);
+void termview_damage_stats_get(const Evas_Object *obj, s_termview_damage_stats *stats);
+void termview_palette_stats_get(const Evas_Object *obj, s_termview_palette_stats *stats);
 s_termview_color termview_color_decompose(uint32_t col, Eina_Bool true_colors);
 void termview_cell_to_coords(const Evas_Object *obj, unsigned int cell_x, unsigned int cell_y, int *px, int *py);
 void termview_cursor_mode_set(Evas_Object *obj, const s_mode *mode);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_TRACE_H__
+#define __EOVIM_TRACE_H__
+
+#include <Eina.h>
+#include <Evas.h>
+
+/**
+ * @file trace.h
+ *
+ * Lightweight tracing of what eovim spends its time on. Begin and end events
+ * are timestamped in a ring buffer, which can be dumped as a Chrome trace
+ * (chrome://tracing, Perfetto) when eovim exits, or when it receives
+ * SIGUSR1.
+ *
+ * Tracing is disabled unless trace_start() is called. The instrumentation
+ * then costs a test of a global boolean.
+ */
+
+/** Do not read directly. Use TRACE_BEGIN(), TRACE_END() or TRACE_ENABLED() */
+extern Eina_Bool _trace_enabled;
+
+/**
+ * Whether events are recorded. Spans whose name has to be looked up test it
+ * once, and then call trace_event_add() themselves.
+ */
+#define TRACE_ENABLED() EINA_UNLIKELY(_trace_enabled)
+
+/**
+ * Open a trace span named @p Name. It must be a static string.
+ */
+#define TRACE_BEGIN(Name) \
+   do { if (EINA_UNLIKELY(_trace_enabled)) trace_event_add((Name), 'B'); } while (0)
+
+/**
+ * Close the trace span named @p Name, opened in the same thread.
+ */
+#define TRACE_END(Name) \
+   do { if (EINA_UNLIKELY(_trace_enabled)) trace_event_add((Name), 'E'); } while (0)
+
+Eina_Bool trace_init(void);
+void trace_shutdown(void);
+Eina_Bool trace_start(const char *path);
+Eina_Bool trace_dump(void);
+void trace_event_add(const char *name, char phase);
+void trace_thread_name_set(const char *name);
+void trace_evas_attach(Evas *evas);
+void trace_evas_detach(Evas *evas);
+
+#endif /* ! __EOVIM_TRACE_H__ */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_UTF8_H__
+#define __EOVIM_UTF8_H__
+
+#include "eovim/types.h"
+
+/*
+ * The bulk decoders are only built with EOVIM_UTF8_BULK, by the benchmark
+ * and the tests: neovim sends one string per cell, so eovim itself has no
+ * run of text to decode in bulk.
+ */
+#ifdef EOVIM_UTF8_BULK
+typedef enum
+{
+   UTF8_IMPL_SCALAR,
+   UTF8_IMPL_SSE2,
+   UTF8_IMPL_AVX2,
+   UTF8_IMPL_LAST /* Sentinel */
+} e_utf8_impl;
+
+Eina_Bool utf8_init(void);
+void utf8_shutdown(void);
+Eina_Bool utf8_impl_set(e_utf8_impl impl);
+e_utf8_impl utf8_impl_get(void);
+const char *utf8_impl_name_get(e_utf8_impl impl);
+unsigned int utf8_decode(const char *str, unsigned int size, Eina_Unicode *out);
+#endif
+
+Eina_Unicode utf8_next_get(const char *str, unsigned int size, unsigned int *index);
+
+/**
+ * Decode the first codepoint of @p str, which is @p size bytes long and is
+ * not required to be NUL-terminated. Neovim sends one string per cell, and
+ * most of them are a single ASCII character.
+ *
+ * @return The codepoint, or 0 if @p str is empty
+ */
+static inline Eina_Unicode
+utf8_first_get(const char *str,
+               unsigned int size)
+{
+   if (EINA_LIKELY((size > 0) && ((unsigned char)str[0] < 0x80)))
+     return (Eina_Unicode)(unsigned char)str[0];
+
+   unsigned int index = 0;
+   return utf8_next_get(str, size, &index);
+}
+
+#endif /* ! __EOVIM_UTF8_H__ */
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/latency.h"
+#include "eovim/log.h"
+
+#include <Ecore.h>
+#include <stdio.h>
+#include <errno.h>
+
+/*
+ * Each key press that is sent to neovim is timestamped and queued. The
+ * first redraw batch that is applied afterwards is considered to be the
+ * answer to all the keys that were waiting for one, and the first rendering
+ * of the canvas that follows paints them. The latency of these keys is then
+ * recorded.
+ *
+ * This is cheap enough to be always enabled: a timestamp per key and per
+ * redraw batch. Percentiles are only computed when they are requested.
+ */
+
+/* Keys waiting to be painted. When full, the oldest ones are forgotten. */
+#define LATENCY_PENDING_MAX 64u
+
+/* Latest samples the percentiles are computed over. Must be a power of 2. */
+#define LATENCY_SAMPLES_MAX 4096u
+
+typedef struct
+{
+   double pressed; /**< Time of the key press */
+   double redrawn; /**< Time of the redraw batch, if @p answered */
+   Eina_Bool answered; /**< A redraw batch was received */
+} s_key;
+
+struct latency
+{
+   Evas *evas;
+   FILE *log; /**< One line per measured key. May be NULL */
+   double start; /**< Time of the creation, the origin of the log */
+
+   s_key pending[LATENCY_PENDING_MAX]; /**< Ring of keys to be painted */
+   unsigned int pending_first;
+   unsigned int pending_count;
+   unsigned int dropped; /**< Keys forgotten because too many were pending */
+
+   double samples[LATENCY_SAMPLES_MAX]; /**< Ring of latencies, in ms */
+   unsigned int samples_count; /**< Total of samples ever recorded */
+};
+
+static inline s_key *
+_pending_get(s_latency *lat,
+             unsigned int index)
+{
+   return &(lat->pending[(lat->pending_first + index) % LATENCY_PENDING_MAX]);
+}
+
+static void
+_sample_add(s_latency *lat,
+            const s_key *key,
+            double painted)
+{
+   const double ms = (painted - key->pressed) * 1000.0;
+   lat->samples[lat->samples_count & (LATENCY_SAMPLES_MAX - 1)] = ms;
+   lat->samples_count++;
+
+   if (lat->log)
+     fprintf(lat->log, "%.6f %.3f %.3f\n", key->pressed - lat->start,
+             (key->redrawn - key->pressed) * 1000.0, ms);
+}
+
+static void
+_render_post_cb(void *data,
+                Evas *e EINA_UNUSED,
+                void *event EINA_UNUSED)
+{
+   s_latency *const lat = data;
+   if (lat->pending_count == 0) { return; }
+
+   /* Keys are answered in order: the ones that got a redraw batch are the
+    * first ones of the queue. This rendering painted them. */
+   const double now = ecore_time_get();
+   while (lat->pending_count > 0)
+     {
+        const s_key *const key = _pending_get(lat, 0);
+        if (! key->answered) { break; }
+        _sample_add(lat, key, now);
+        lat->pending_first = (lat->pending_first + 1) % LATENCY_PENDING_MAX;
+        lat->pending_count--;
+     }
+}
+
+static int
+_double_cmp(const void *a,
+            const void *b)
+{
+   const double da = *(const double *)a;
+   const double db = *(const double *)b;
+   return (da > db) - (da < db);
+}
+
+s_latency *
+latency_new(Evas *evas,
+            const char *log_path)
+{
+   s_latency *const lat = calloc(1, sizeof(s_latency));
+   if (EINA_UNLIKELY(! lat))
+     {
+        CRI("Failed to allocate memory for latency measures");
+        goto fail;
+     }
+   lat->evas = evas;
+   lat->start = ecore_time_get();
+
+   if (log_path)
+     {
+        lat->log = fopen(log_path, "w");
+        if (EINA_UNLIKELY(! lat->log))
+          {
+             CRI("Failed to open '%s': %s", log_path, strerror(errno));
+             goto free_lat;
+          }
+        fputs("# time_s key_to_redraw_ms key_to_paint_ms\n", lat->log);
+     }
+
+   evas_event_callback_add(evas, EVAS_CALLBACK_RENDER_POST,
+                           _render_post_cb, lat);
+   return lat;
+
+free_lat:
+   free(lat);
+fail:
+   return NULL;
+}
+
+void
+latency_free(s_latency *lat)
+{
+   if (! lat) { return; }
+
+   s_latency_stats stats;
+   latency_stats_get(lat, &stats);
+   if (stats.samples > 0)
+     INF("Keypress-to-paint latency over the last %u keys: p50 %.1f ms, "
+         "p95 %.1f ms, p99 %.1f ms, max %.1f ms",
+         stats.window, stats.p50, stats.p95, stats.p99, stats.max);
+   if (lat->dropped > 0)
+     INF("%u keys were not measured: too many were waiting to be painted",
+         lat->dropped);
+
+   evas_event_callback_del_full(lat->evas, EVAS_CALLBACK_RENDER_POST,
+                                _render_post_cb, lat);
+   if (lat->log)
+     {
+        if (EINA_UNLIKELY(fclose(lat->log) != 0))
+          ERR("Failed to close the latency log: %s", strerror(errno));
+     }
+   free(lat);
+}
+
+void
+latency_key_pressed(s_latency *lat)
+{
+   if (EINA_UNLIKELY(lat->pending_count == LATENCY_PENDING_MAX))
+     {
+        /* Nothing is painted anymore. Forget the oldest key. */
+        lat->pending_first = (lat->pending_first + 1) % LATENCY_PENDING_MAX;
+        lat->pending_count--;
+        lat->dropped++;
+     }
+
+   s_key *const key = _pending_get(lat, lat->pending_count);
+   key->pressed = ecore_time_get();
+   key->answered = EINA_FALSE;
+   lat->pending_count++;
+}
+
+void
+latency_redraw_received(s_latency *lat)
+{
+   /* The keys that got a batch are the first ones of the queue, so the last
+    * one tells if there is anything to do */
+   if ((lat->pending_count == 0) ||
+       (_pending_get(lat, lat->pending_count - 1)->answered))
+     return;
+
+   const double now = ecore_time_get();
+   for (unsigned int i = lat->pending_count; i > 0; i--)
+     {
+        s_key *const key = _pending_get(lat, i - 1);
+        if (key->answered) { break; }
+        key->redrawn = now;
+        key->answered = EINA_TRUE;
+     }
+}
+
+void
+latency_stats_get(const s_latency *lat,
+                  s_latency_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   stats->samples = lat->samples_count;
+   stats->window = (lat->samples_count < LATENCY_SAMPLES_MAX)
+      ? lat->samples_count : LATENCY_SAMPLES_MAX;
+   if (stats->window == 0) { return; }
+
+   /* Nearest-rank percentiles of the latest samples */
+   double *const sorted = malloc(stats->window * sizeof(double));
+   if (EINA_UNLIKELY(! sorted))
+     {
+        CRI("Failed to allocate memory");
+        return;
+     }
+   memcpy(sorted, lat->samples, stats->window * sizeof(double));
+   qsort(sorted, stats->window, sizeof(double), _double_cmp);
+
+   const unsigned int last = stats->window - 1;
+   stats->p50 = sorted[(last * 50u) / 100u];
+   stats->p95 = sorted[(last * 95u) / 100u];
+   stats->p99 = sorted[(last * 99u) / 100u];
+   stats->max = sorted[last];
+   free(sorted);
+}
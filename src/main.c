@@ -24,7 +24,6 @@
 #include "eovim/config.h"
 #include "eovim/mode.h"
 #include "eovim/nvim.h"
-#include "eovim/nvim_api.h"
 #include "eovim/nvim_event.h"
 #include "eovim/termview.h"
 #include "eovim/main.h"
@@ -32,6 +31,8 @@
 #include "eovim/log.h"
 #include "eovim/prefs.h"
 #include "eovim/options.h"
+#include "eovim/trace.h"
+#include "eovim/stats.h"
 
 int _eovim_log_domain = -1;
 
@@ -51,11 +52,12 @@ static const s_module _modules[] =
 #define MODULE(name_) \
    { .name = #name_, .init = name_ ## _init, .shutdown = name_ ## _shutdown }
 
+   MODULE(trace),
    MODULE(config),
    MODULE(keymap),
    MODULE(mode),
-   MODULE(nvim_api),
    MODULE(nvim_event),
+   MODULE(stats),
    MODULE(plugin),
    MODULE(prefs),
    MODULE(gui),
@@ -198,6 +200,14 @@ elm_main(int argc,
           }
      }
 
+   /* Tracing starts as soon as possible, to see eovim starting up. The trace
+    * is written when the trace module is shut down. */
+   if (opts.trace && EINA_UNLIKELY(! trace_start(opts.trace)))
+     {
+        CRI("Failed to start tracing");
+        goto modules_shutdown;
+     }
+
    /*=========================================================================
     * Load the plugins
     *========================================================================*/
@@ -218,10 +228,9 @@ elm_main(int argc,
     *========================================================================*/
    elm_run();
 
+   /* Like in a terminal, :cquit makes eovim fail */
+   return_code = nvim->exit_code;
    nvim_free(nvim);
-
-   /* Everything seemed to have run fine :) */
-   return_code = EXIT_SUCCESS;
 plugins_shutdown:
    plugin_list_free(_plugins);
 modules_shutdown:
@@ -26,17 +26,25 @@
 #include "eovim/config.h"
 #include "eovim/nvim_api.h"
 #include "eovim/nvim_event.h"
+#include "eovim/nvim_reader.h"
+#include "eovim/nvim_writer.h"
+#include "eovim/redraw.h"
 #include "eovim/nvim_helper.h"
 #include "eovim/log.h"
 #include "eovim/mode.h"
 #include "eovim/main.h"
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+
+extern char **environ;
+
 enum
 {
-   HANDLER_ADD,
    HANDLER_DEL,
-   HANDLER_DATA,
-   HANDLER_ERROR,
    __HANDLERS_LAST /* Sentinel */
 };
 
@@ -79,18 +87,25 @@ _handle_request_response(s_nvim *nvim,
 
    /* Get the request from the pending requests list. */
    const uint32_t req_id = (uint32_t)args->ptr[1].via.u64;
-   Eina_List *const req_item = nvim_api_request_find(nvim, req_id);
-   if (EINA_UNLIKELY(! req_item))
+   s_request *const req = nvim_api_request_find(nvim, req_id);
+   if (EINA_UNLIKELY(! req))
      {
         /* We probably should wait for the error message to be fetched back.
          * So we start by throwing an error, then we tell that the response
          * shall not be processed. */
-        CRI("Uh... received a response to request %"PRIu32", but it was not "
-            "registered. Something wrong happend somewhere!", req_id);
+        if (nvim->requests.expired)
+          WRN("Received a response to request %"PRIu32", which is unknown. "
+              "It may have expired.", req_id);
+        else
+          CRI("Uh... received a response to request %"PRIu32", but it was "
+              "not registered. Something wrong happend somewhere!", req_id);
         do_not_process = EINA_TRUE;
      }
    else
-     DBG("Received response to request %"PRIu32, req_id);
+     {
+        DBG("Received response to request %"PRIu32, req_id);
+        nvim_api_request_answered(nvim, req);
+     }
 
    /* If 3rd arg is an array, this is an error message. */
    const msgpack_object_type err_type = args->ptr[2].type;
@@ -117,8 +132,9 @@ _handle_request_response(s_nvim *nvim,
           }
 
         CRI("Neovim reported an error: %s", err);
+        if (req) nvim_api_request_call(nvim, req, NULL, err);
         eina_stringshare_del(err);
-        goto fail_req;
+        goto fail;
      }
    else if (err_type != MSGPACK_OBJECT_NIL)
      {
@@ -129,43 +145,56 @@ _handle_request_response(s_nvim *nvim,
    /* At this point, we have had the chance to read the error message. If we
     * did, we would have exited earlier. If not, exit right now. */
    if (EINA_UNLIKELY(do_not_process == EINA_TRUE))
-     goto fail_req;
+     goto fail;
 
    /* 4th argment, which contain the returned parameters */
+   /* The request is removed before its callback is called */
    const msgpack_object *const result = &(args->ptr[3]);
-   nvim_api_request_call(nvim, req_item, result);
-
-   /* Now that we have found the request, we can remove it */
-   nvim_api_request_free(nvim, req_item);
+   nvim_api_request_call(nvim, req, result, NULL);
    return EINA_TRUE;
 
 fail_req:
-   nvim_api_request_free(nvim, req_item);
+   /* The callback is told, so it does not wait for a result forever */
+   if (req) nvim_api_request_call(nvim, req, NULL, "invalid response");
 fail:
    return EINA_FALSE;
 }
 
-static Eina_Stringshare *
-_stringshare_extract(const msgpack_object *obj)
+static const msgpack_object_str *
+_string_extract(const msgpack_object *obj)
 {
-   if (obj->type == MSGPACK_OBJECT_STR)
-     {
-        const msgpack_object_str *const str = &(obj->via.str);
-        return eina_stringshare_add_length(str->ptr, str->size);
-     }
-   else if (obj->type == MSGPACK_OBJECT_BIN)
-     {
-        const msgpack_object_bin *const bin = &(obj->via.bin);
-        return eina_stringshare_add_length(bin->ptr, bin->size);
-     }
+   /* STR and BIN objects share the same layout */
+   if ((obj->type == MSGPACK_OBJECT_STR) || (obj->type == MSGPACK_OBJECT_BIN))
+     return &(obj->via.str);
    else
      {
-        ERR("Second argument in notification is expected to be a string "
-            "(or BIN string), but it is of type 0x%x", obj->type);
+        ERR("Expected a string (or BIN string), but got an object of type "
+            "0x%x", obj->type);
         return NULL;
      }
 }
 
+static Eina_Bool
+_handle_error_event(const msgpack_object_array *args)
+{
+   /*
+    * Neovim sends this notification when a notification we sent failed, as it
+    * cannot answer it. Its arguments are [ type, message ].
+    */
+   const msgpack_object_array *const params = &(args->ptr[2].via.array);
+   if (EINA_UNLIKELY((args->ptr[2].type != MSGPACK_OBJECT_ARRAY) ||
+                     (params->size != 2)))
+     {
+        ERR("Malformed nvim_error_event notification");
+        return EINA_FALSE;
+     }
+   const msgpack_object_str *const msg = _string_extract(&(params->ptr[1]));
+   if (EINA_UNLIKELY(! msg)) { return EINA_FALSE; }
+
+   ERR("Neovim reported an error: %.*s", (int)msg->size, msg->ptr);
+   return EINA_TRUE;
+}
+
 static Eina_Bool
 _handle_notification(s_nvim *nvim,
                      const msgpack_object_array *args)
@@ -173,16 +202,21 @@ _handle_notification(s_nvim *nvim,
    /*
     * 2nd argument must be a string (or bin string).
     * It contains the METHOD to be called for the notification.
-    * We decore the string as a stringshare, to feed it to our table of
-    * methods.
+    * Redraw notifications have already been handled by the reader, so we
+    * only expect plugin commands and errors here.
     */
-   Eina_Stringshare *const method = _stringshare_extract(&(args->ptr[1]));
-   if (EINA_UNLIKELY(! method))
+   const msgpack_object_str *const method = _string_extract(&(args->ptr[1]));
+   if (EINA_UNLIKELY(! method)) { goto fail; }
+   DBG("Received notification '%.*s'", (int)method->size, method->ptr);
+
+   const e_method method_id = nvim_event_method_get(method->ptr, method->size);
+   if (method_id == E_METHOD_ERROR)
+     return _handle_error_event(args);
+   if (EINA_UNLIKELY(method_id != E_METHOD_EOVIM))
      {
-        CRI("Failed to create stringshare from Neovim method");
+        CRI("Unknown method '%.*s'", (int)method->size, method->ptr);
         goto fail;
      }
-   DBG("Received notification '%s'", method);
 
    /*
     * 3rd argument must be an array of objects
@@ -190,7 +224,7 @@ _handle_notification(s_nvim *nvim,
    if (EINA_UNLIKELY(args->ptr[2].type != MSGPACK_OBJECT_ARRAY))
      {
         ERR("Third argument in notification is expected to be an array");
-        goto del_method;
+        goto fail;
      }
    const msgpack_object_array *const args_arr = &(args->ptr[2].via.array);
    /*
@@ -213,21 +247,14 @@ _handle_notification(s_nvim *nvim,
              CRI("Expected at least one argument. Got zero.");
              continue; /* Try next element */
           }
-        Eina_Stringshare *const command = _stringshare_extract(&(cmd->ptr[0]));
+        const msgpack_object_str *const command = _string_extract(&(cmd->ptr[0]));
         if (EINA_UNLIKELY(! command))
-          {
-             CRI("Failed to create stringshare from command object");
-             continue; /* Try next element */
-          }
-        nvim_event_dispatch(nvim, method, command, cmd);
-        eina_stringshare_del(command);
+          continue; /* Try next element */
+        nvim_event_plugin_dispatch(nvim, command, cmd);
      }
 
-   eina_stringshare_del(method);
    return EINA_TRUE;
 
-del_method:
-   eina_stringshare_del(method);
 fail:
    return EINA_FALSE;
 }
@@ -237,30 +264,26 @@ fail:
  *                       Nvim Processes Events Handlers                       *
  *============================================================================*/
 
-static Eina_Bool
-_nvim_added_cb(void *data EINA_UNUSED,
-               int   type EINA_UNUSED,
-               void *event)
-{
-   const Ecore_Exe_Event_Add *const info = event;
-   INF("Process with PID %i was created", ecore_exe_pid_get(info->exe));
-   return ECORE_CALLBACK_PASS_ON;
-}
-
 static Eina_Bool
 _nvim_deleted_cb(void *data EINA_UNUSED,
                  int   type EINA_UNUSED,
                  void *event)
 {
+   /*
+    * Ecore reaps all the children of the process, not only the ones it
+    * spawned itself, and reports them with this event.
+    */
    const Ecore_Exe_Event_Del *const info = event;
    s_nvim *const nvim = _nvim_get();
-   const int pid = ecore_exe_pid_get(info->exe);
+   const int pid = info->pid;
+   if ((! nvim) || (nvim->pid != pid)) { return ECORE_CALLBACK_PASS_ON; }
 
    /* We consider that neovim crashed if it receives an uncaught signal */
    if (info->signalled)
      {
         ERR("Process with PID %i died of uncaught signal %i",
             pid, info->exit_signal);
+        nvim->exit_code = EXIT_FAILURE;
         gui_die(
            &nvim->gui,
            "The Neovim process %i died. Eovim cannot continue its execution",
@@ -271,112 +294,36 @@ _nvim_deleted_cb(void *data EINA_UNUSED,
      {
         INF("Process with PID %i terminated with exit code %i",
             pid, info->exit_code);
+        nvim->exit_code = info->exit_code;
         gui_del(&nvim->gui);
      }
    return ECORE_CALLBACK_PASS_ON;
 }
 
-static Eina_Bool
-_nvim_received_data_cb(void *data EINA_UNUSED,
-                       int   type EINA_UNUSED,
-                       void *event)
+static void
+_nvim_message_cb(s_nvim *nvim,
+                 const s_nvim_msg *msg)
 {
-   const Ecore_Exe_Event_Data *const info = event;
-   s_nvim *const nvim = _nvim_get();
-   msgpack_unpacker *const unpacker = &nvim->unpacker;
-   const size_t recv_size = (size_t)info->size;
-
-   DBG("Incoming data from PID %u (size %zu)", ecore_exe_pid_get(info->exe), recv_size);
+   const msgpack_object_array *const args = &(msg->args);
 
-
-   /*
-    * We have received something from NeoVim. We now must deserialize this.
-    */
-   msgpack_unpacked result;
-
-   /* Resize the unpacking buffer if need be */
-   if (msgpack_unpacker_buffer_capacity(unpacker) < recv_size)
-     {
-        const bool ret = msgpack_unpacker_reserve_buffer(unpacker, recv_size);
-        if (! ret)
-          {
-             ERR("Memory reallocation of %zu bytes failed", recv_size);
-             goto end;
-          }
-     }
-   /* This seems to be required, but that's plain inefficiency */
-   memcpy(msgpack_unpacker_buffer(unpacker), info->data, recv_size);
-   msgpack_unpacker_buffer_consumed(unpacker, recv_size);
-
-   msgpack_unpacked_init(&result);
-   for (;;)
+   switch (args->ptr[0].via.u64)
      {
-        const msgpack_unpack_return ret = msgpack_unpacker_next(unpacker, &result);
-        if (ret == MSGPACK_UNPACK_CONTINUE) { break; }
-        else if (ret != MSGPACK_UNPACK_SUCCESS)
-          {
-             ERR("Error while unpacking data from neovim (0x%x)", ret);
-             goto end_unpack;
-          }
-        msgpack_object obj = result.data;
-
-#if 0 /* Uncomment to roughly dump the received messages */
-        msgpack_object_print(stderr, obj);
-        fprintf(stderr, "\n--------\n");
-#endif
-
-        if (EINA_UNLIKELY(obj.type != MSGPACK_OBJECT_ARRAY))
-          {
-             ERR("Unexpected msgpack type 0x%x", obj.type);
-             goto end_unpack;
-          }
-
-        const msgpack_object_array *const args = &obj.via.array;
-        const unsigned int response_args_count = 4;
-        const unsigned int notif_args_count = 3;
-        if ((args->size != response_args_count) &&
-            (args->size != notif_args_count))
-          {
-             ERR("Unexpected count of arguments: %u.", args->size);
-             goto end_unpack;
-          }
-
-        if (EINA_UNLIKELY(args->ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER))
-          {
-             ERR("First argument in response is expected to be an integer");
-             goto end_unpack;
-          }
-        switch (args->ptr[0].via.u64)
-          {
-           case 1:
-              _handle_request_response(nvim, args);
-              break;
-
-           case 2:
-              _handle_notification(nvim, args);
-              break;
-
-           default:
-              ERR("Invalid message identifier %"PRIu64, args->ptr[0].via.u64);
-              goto end_unpack;
-          }
-     } /* End of message unpacking */
+      case 1:
+         _handle_request_response(nvim, args);
+         break;
 
-end_unpack:
-   msgpack_unpacked_destroy(&result);
-end:
-   return ECORE_CALLBACK_PASS_ON;
-}
+      case 2:
+         /* Redraw notifications have already been decoded by the reader */
+         if (msg->redraw)
+           redraw_batch_apply(nvim, msg->redraw);
+         else
+           _handle_notification(nvim, args);
+         break;
 
-static Eina_Bool
-_nvim_received_error_cb(void *data EINA_UNUSED,
-                        int   type EINA_UNUSED,
-                        void *event)
-{
-   const Ecore_Exe_Event_Data *const info = event;
-   const char *const msg = info->data;
-   ERR("Error: %s", msg);
-   return ECORE_CALLBACK_PASS_ON;
+      default:
+         ERR("Invalid message identifier %"PRIu64, args->ptr[0].via.u64);
+         break;
+     }
 }
 
 static void
@@ -452,14 +399,37 @@ _version_decode_cb(s_nvim *nvim,
             version->extra[0] == '\0' ? '\0' : '-',
             version->extra);
 
-   INF("Running Neovim version %s", vstr);
-   if ((NVIM_VERSION_MAJOR(nvim) == 0) && (NVIM_VERSION_MINOR(nvim) < 2))
+   /* A zeroed version is one that could not be found out. Neovim is then
+    * given the benefit of the doubt, and the legacy protocol is used. */
+   const Eina_Bool unknown =
+      (version->major == 0) && (version->minor == 0) && (version->patch == 0);
+   if (unknown)
+     WRN("Failed to find out the version of Neovim. Assuming it is supported.");
+   else
+     INF("Running Neovim version %s", vstr);
+   if ((! unknown) &&
+       (NVIM_VERSION_MAJOR(nvim) == 0) && (NVIM_VERSION_MINOR(nvim) < 2))
      {
         gui_die(&nvim->gui,
                 "You are running neovim %s, which is unsupported. "
                 "Please consider upgrading Neovim.", vstr);
      }
-   /* We are now sure that we are running at least 0.2.0. */
+   /* Unless it is unknown, we are now sure that we are running at least
+    * 0.2.0. */
+
+   /*
+    * The UI is attached only now, as the redraw protocol we can negotiate
+    * depends on neovim's version. The termview may have been resized in the
+    * meantime, so it is its current size that is requested.
+    */
+   unsigned int cols, rows;
+   termview_size_get(nvim->gui.termview, &cols, &rows);
+   if ((cols == 0) || (rows == 0))
+     {
+        cols = nvim->opts->geometry.w;
+        rows = nvim->opts->geometry.h;
+     }
+   nvim_api_ui_attach(nvim, cols, rows);
 
    /* From neovim 0.2.1, the command-line can be externalized */
    if (NVIM_VERSION_PATCH(nvim) >= 1)
@@ -490,6 +460,130 @@ _nvim_plugins_load(s_nvim *nvim)
      INF("Loaded %u plugins out of %u", loaded, expect);
 }
 
+static Eina_Bool
+_pipe_new(int fds[2])
+{
+   if (EINA_UNLIKELY(pipe(fds) != 0))
+     {
+        CRI("Failed to create pipe: %s", strerror(errno));
+        return EINA_FALSE;
+     }
+   /* Neither end shall leak into the processes we spawn */
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_nvim_spawn(s_nvim *nvim,
+            const char *argv[])
+{
+   /*
+    * Ecore_Exe is perfectly able to read what the process writes on its
+    * stdout (ECORE_EXE_PIPE_READ), but it buffers the data on its own, then
+    * hands us a copy through ECORE_EXE_EVENT_DATA, that we must copy again in
+    * the msgpack unpacker. That's two copies too many for the amount of data
+    * neovim sends us when redrawing. So we create neovim's pipes ourselves:
+    * the reader thread reads its stdout directly into its unpacker, and the
+    * writer writes its stdin without intermediate buffer.
+    *
+    * The pipes are close-on-exec, and are given to neovim as its stdin and
+    * stdout by the file actions of posix_spawn(). So they never leak in
+    * another process, and neither do they in the processes neovim spawns.
+    * Neovim shares our stderr. When we die, its stdin is closed, which makes
+    * it terminate.
+    */
+   int in[2], out[2];
+   posix_spawn_file_actions_t actions;
+   pid_t pid;
+
+   if (EINA_UNLIKELY(! _pipe_new(in))) { goto fail; }
+   if (EINA_UNLIKELY(! _pipe_new(out))) { goto close_in; }
+
+   int err = posix_spawn_file_actions_init(&actions);
+   if (EINA_UNLIKELY(err != 0))
+     {
+        CRI("Failed to initialize spawn actions: %s", strerror(err));
+        goto close_out;
+     }
+   err = posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+   if (EINA_LIKELY(err == 0))
+     err = posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+   if (EINA_LIKELY(err == 0))
+     err = posix_spawnp(&pid, argv[0], &actions, NULL,
+                        (char *const *)argv, environ);
+   posix_spawn_file_actions_destroy(&actions);
+   if (EINA_UNLIKELY(err != 0))
+     {
+        CRI("Failed to execute '%s': %s", argv[0], strerror(err));
+        goto close_out;
+     }
+   INF("Process with PID %i was created", pid);
+   nvim->pid = pid;
+
+   /* The child has its own copy of these */
+   close(in[0]);
+   close(out[1]);
+
+   /* The writer and the reader take ownership of the other ends */
+   nvim->writer = nvim_writer_new(in[1]);
+   if (EINA_UNLIKELY(! nvim->writer))
+     {
+        CRI("Failed to create the writer of neovim's input");
+        close(out[0]);
+        goto kill;
+     }
+   nvim->reader = nvim_reader_new(nvim, out[0], nvim->recorder,
+                                  _nvim_message_cb);
+   if (EINA_UNLIKELY(! nvim->reader))
+     {
+        CRI("Failed to create the reader of neovim's output");
+        nvim_writer_free(nvim->writer);
+        nvim->writer = NULL;
+        goto kill;
+     }
+
+   return EINA_TRUE;
+
+kill:
+   kill(nvim->pid, SIGKILL);
+   return EINA_FALSE;
+close_out:
+   close(out[0]);
+   close(out[1]);
+close_in:
+   close(in[0]);
+   close(in[1]);
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_nvim_replay(s_nvim *nvim,
+             const char *path)
+{
+   /*
+    * No neovim process is spawned: the reader is fed with what neovim sent
+    * during a recorded session, and what we send is dropped. There is no
+    * process to terminate either, so the window has to be closed by the
+    * user once the replay is over.
+    */
+   int fd;
+   nvim->replayer = rpc_replayer_new(path, ! nvim->opts->replay_fast, &fd);
+   if (EINA_UNLIKELY(! nvim->replayer))
+     return EINA_FALSE;
+
+   nvim->reader = nvim_reader_new(nvim, fd, nvim->recorder, _nvim_message_cb);
+   if (EINA_UNLIKELY(! nvim->reader))
+     {
+        CRI("Failed to create the reader of the replayed session");
+        rpc_replayer_free(nvim->replayer);
+        nvim->replayer = NULL;
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
 /*============================================================================*
  *                                 Public API                                 *
  *============================================================================*/
@@ -501,22 +595,10 @@ nvim_init(void)
       const int event;
       const Ecore_Event_Handler_Cb callback;
    } const ctor[__HANDLERS_LAST] = {
-      [HANDLER_ADD] = {
-         .event = ECORE_EXE_EVENT_ADD,
-         .callback = _nvim_added_cb,
-      },
       [HANDLER_DEL] = {
          .event = ECORE_EXE_EVENT_DEL,
          .callback = _nvim_deleted_cb,
       },
-      [HANDLER_DATA] = {
-         .event = ECORE_EXE_EVENT_DATA,
-         .callback = _nvim_received_data_cb,
-      },
-      [HANDLER_ERROR] = {
-         .event = ECORE_EXE_EVENT_ERROR,
-         .callback = _nvim_received_error_cb,
-      },
    };
    unsigned int i;
 
@@ -559,39 +641,33 @@ nvim_new(const s_options *opts,
 {
    EINA_SAFETY_ON_NULL_RETURN_VAL(opts, NULL);
 
-   Eina_Bool ok;
-
-   /* Forge the command-line for the nvim program. We manually enforce
+   /* Forge the arguments of the nvim program. We manually enforce
     * --embed and --headless, because we are the gui client, and forward all
-    * the options to the command-line. We are using an Eina_Strbuf to make no
-    * assumption on the size of the command-line.
+    * the options to the command-line. It is NULL-terminated, as execvp()
+    * expects.
     */
-   Eina_Strbuf *const cmdline = eina_strbuf_new();
-   if (EINA_UNLIKELY(! cmdline))
+   unsigned int args_count = 0;
+   while (args[args_count]) { args_count++; }
+   const char **const argv = calloc(args_count + 5, sizeof(char *));
+   if (EINA_UNLIKELY(! argv))
      {
-        CRI("Failed to create strbuf");
+        CRI("Failed to allocate memory for the command line");
         goto fail;
      }
-   ok = eina_strbuf_append_printf(cmdline, "\"%s\"", opts->nvim_prog);
-   ok &= eina_strbuf_append(cmdline, " --embed --headless");
-   if (opts->no_plugins) ok &= eina_strbuf_append(cmdline, " --noplugin");
-
-   for (const char *arg = *args; arg != NULL; arg = *(++args))
-     {
-        ok &= eina_strbuf_append_printf(cmdline, " \"%s\"", arg);
-     }
-   if (EINA_UNLIKELY(! ok))
-     {
-        CRI("Failed to correctly format the command line");
-        goto del_strbuf;
-     }
+   unsigned int argc = 0;
+   argv[argc++] = opts->nvim_prog;
+   argv[argc++] = "--embed";
+   argv[argc++] = "--headless";
+   if (opts->no_plugins) argv[argc++] = "--noplugin";
+   for (unsigned int i = 0; i < args_count; i++)
+     argv[argc++] = args[i];
 
    /* First, create the nvim data */
    s_nvim *const nvim = calloc(1, sizeof(s_nvim));
    if (! nvim)
      {
         CRI("Failed to create nvim structure");
-        goto del_strbuf;
+        goto del_argv;
      }
    nvim->opts = opts;
 
@@ -599,19 +675,12 @@ nvim_new(const s_options *opts,
     * information from neovim unless we change mode. This is annoying. */
    nvim->mouse_enabled = EINA_TRUE;
 
-   nvim->decode = eina_ustrbuf_new();
-   if (EINA_UNLIKELY(! nvim->decode))
-     {
-        CRI("Failed to create unicode string buffer");
-        goto del_mem;
-     }
-
    /* Create the config */
    nvim->config = config_load(opts->config_path);
    if (EINA_UNLIKELY(! nvim->config))
      {
         CRI("Failed to initialize a configuration");
-        goto del_ustrbuf;
+        goto del_mem;
      }
 
    /* Load the plugins requested by the config */
@@ -620,7 +689,6 @@ nvim_new(const s_options *opts,
    /* Initialze msgpack for RPC */
    msgpack_sbuffer_init(&nvim->sbuffer);
    msgpack_packer_init(&nvim->packer, &nvim->sbuffer, msgpack_sbuffer_write);
-   msgpack_unpacker_init(&nvim->unpacker, 2048);
 
    /* Create the hash map that will contain the modes */
    nvim->modes = eina_hash_stringshared_new(EINA_FREE_CB(mode_free));
@@ -630,25 +698,50 @@ nvim_new(const s_options *opts,
         goto del_config;
      }
 
+   /* Create the buffer in which the input is accumulated */
+   nvim->input.keys = eina_strbuf_new();
+   if (EINA_UNLIKELY(! nvim->input.keys))
+     {
+        CRI("Failed to create strbuf");
+        goto del_hash;
+     }
+
    /* Initialize the virtual interface to safe values (non-NULL pointers) */
    _virtual_interface_init(nvim);
 
-   /* Create the neovim process */
-   nvim->exe = ecore_exe_pipe_run(
-      eina_strbuf_string_get(cmdline),
-      ECORE_EXE_PIPE_READ | ECORE_EXE_PIPE_WRITE | ECORE_EXE_PIPE_ERROR  |
-      ECORE_EXE_TERM_WITH_PARENT,
-      nvim
-   );
-   if (EINA_UNLIKELY(! nvim->exe))
+   /* Record the session, if requested */
+   if (opts->record_rpc)
      {
-        CRI("Failed to execute nvim instance");
-        goto del_hash;
+        nvim->recorder = rpc_recorder_new(opts->record_rpc);
+        if (EINA_UNLIKELY(! nvim->recorder))
+          {
+             CRI("Failed to record the session with neovim");
+             goto del_input;
+          }
+     }
+
+   /* Create the neovim process, or replay one */
+   if (opts->replay_rpc)
+     {
+        if (EINA_UNLIKELY(! _nvim_replay(nvim, opts->replay_rpc)))
+          {
+             CRI("Failed to replay the session in '%s'", opts->replay_rpc);
+             goto del_recorder;
+          }
+     }
+   else if (EINA_UNLIKELY(! _nvim_spawn(nvim, argv)))
+     {
+        CRI("Failed to spawn the neovim process");
+        goto del_recorder;
      }
    _nvim_instance = nvim;
-   DBG("Running %s", eina_strbuf_string_get(cmdline));
-   eina_strbuf_free(cmdline);
-   nvim_api_ui_attach(nvim, opts->geometry.w, opts->geometry.h);
+   DBG("Running %s with %u arguments", argv[0], argc - 1);
+   if (EINA_UNLIKELY(! nvim_api_requests_timeout_set(nvim,
+                                                     opts->request_timeout)))
+     {
+        CRI("Failed to set up the expiration of the requests");
+        goto del_process;
+     }
    nvim_helper_version_decode(nvim, _version_decode_cb);
    nvim_api_var_integer_set(nvim, "eovim_running", 1);
    _nvim_runtime_load(nvim);
@@ -661,20 +754,27 @@ nvim_new(const s_options *opts,
      }
    gui_fullscreen_set(&nvim->gui, opts->fullscreen);
 
+   free(argv);
    return nvim;
 
 del_process:
-   ecore_exe_kill(nvim->exe);
+   if (nvim->pid) kill(nvim->pid, SIGKILL);
+   nvim_reader_free(nvim->reader);
+   nvim_writer_free(nvim->writer);
+   rpc_replayer_free(nvim->replayer);
+   nvim_api_requests_drop(nvim);
+del_recorder:
+   rpc_recorder_free(nvim->recorder);
+del_input:
+   eina_strbuf_free(nvim->input.keys);
 del_hash:
    eina_hash_free(nvim->modes);
 del_config:
    config_free(nvim->config);
-del_ustrbuf:
-   eina_ustrbuf_free(nvim->decode);
 del_mem:
    free(nvim);
-del_strbuf:
-   eina_strbuf_free(cmdline);
+del_argv:
+   free(argv);
 fail:
    _nvim_instance = NULL;
    return NULL;
@@ -685,11 +785,18 @@ nvim_free(s_nvim *nvim)
 {
    if (nvim)
      {
+        nvim_reader_free(nvim->reader);
+        nvim_writer_free(nvim->writer);
+        rpc_replayer_free(nvim->replayer);
+        nvim_helper_paste_abort(nvim);
+        nvim_api_requests_drop(nvim);
+        rpc_recorder_free(nvim->recorder);
+        INF("%u inputs were sent in %u requests",
+            nvim->input.inputs, nvim->input.requests);
+        eina_strbuf_free(nvim->input.keys);
         msgpack_sbuffer_destroy(&nvim->sbuffer);
-        msgpack_unpacker_destroy(&nvim->unpacker);
         eina_hash_free(nvim->modes);
         config_free(nvim->config);
-        eina_ustrbuf_free(nvim->decode);
         free(nvim);
         _nvim_instance = NULL;
      }
@@ -26,41 +26,51 @@
 #include "eovim/nvim_api.h"
 #include "eovim/nvim_event.h"
 #include "eovim/nvim.h"
+#include "eovim/request_table.h"
 
-struct request
+/* Amount of queued bytes above which messages are sent without waiting for
+ * the end of the main loop iteration */
+#define FLUSH_THRESHOLD (64u * 1024u)
+
+/* Names of the API functions, as they are packed */
+static const struct {
+   const char *const name;
+   const unsigned int size;
+} _api_names[__E_API_LAST] =
 {
-   struct {
-      f_nvim_api_cb func;
-      void *data;
-   } cb;
-   uint32_t uid;
+#define API(Id, Name) [E_API_ ## Id] = { .name = #Name, .size = sizeof(#Name) - 1 }
+   API(UI_ATTACH, nvim_ui_attach),
+   API(UI_SET_OPTION, nvim_ui_set_option),
+   API(UI_TRY_RESIZE, nvim_ui_try_resize),
+   API(INPUT, nvim_input),
+   API(PASTE, nvim_paste),
+   API(EVAL, nvim_eval),
+   API(COMMAND, nvim_command),
+   API(COMMAND_OUTPUT, nvim_command_output),
+   API(SET_VAR, nvim_set_var),
+#undef API
 };
 
-/* Mempool to allocate the requests */
-static Eina_Mempool *_mempool = NULL;
-
-
 static s_request *
-_request_new(s_nvim *nvim,
-             const char *rpc_name,
-             size_t rpc_name_len)
+_request_prepare(s_nvim *nvim,
+                 e_api api)
 {
-   s_request *const req = eina_mempool_calloc(_mempool, sizeof(s_request));
+   const uint32_t uid = nvim_next_uid_get(nvim);
+
+   /* Keep the request around */
+   s_request *const req = request_table_add(&(nvim->requests.table), uid);
    if (EINA_UNLIKELY(! req))
      {
         CRI("Failed to allocate memory for a request object");
         return NULL;
      }
+   req->cb.func = NULL;
+   req->cb.data = NULL;
+   req->api = api;
+   req->sent = ecore_time_get();
+   DBG("Preparing request '%s' with id %"PRIu32, _api_names[api].name, req->uid);
 
-   req->uid = nvim_next_uid_get(nvim);
-   DBG("Preparing request '%s' with id %"PRIu32, rpc_name, req->uid);
-
-   /* Clear the serialization buffer before pushing a new request */
-   msgpack_sbuffer_clear(&nvim->sbuffer);
-
-   /* Keep the request around */
-   nvim->requests = eina_list_append(nvim->requests, req);
-
+   /* The request is appended to the messages that are waiting to be sent */
    msgpack_packer *const pk = &nvim->packer;
    /*
     * Pack the message! It is an array of four (4) items:
@@ -73,70 +83,308 @@ _request_new(s_nvim *nvim,
    msgpack_pack_array(pk, 4);
    msgpack_pack_int(pk, 0);
    msgpack_pack_uint32(pk, req->uid);
-   msgpack_pack_bin(pk, rpc_name_len);
-   msgpack_pack_bin_body(pk, rpc_name, rpc_name_len);
+   msgpack_pack_bin(pk, _api_names[api].size);
+   msgpack_pack_bin_body(pk, _api_names[api].name, _api_names[api].size);
 
    return req;
 }
 
+/*
+ * Calls whose result nobody reads are sent as notifications. Neovim does
+ * not answer them, so they take no slot in the table of pending requests,
+ * and there is no response to receive and decode. If such a call fails,
+ * neovim sends a nvim_error_event notification, which tells what went wrong
+ * but not which call failed. With --rpc-errors, they are sent as requests,
+ * so their failures are reported as the ones of the requests are.
+ */
+static Eina_Bool
+_notification_prepare(s_nvim *nvim,
+                      e_api api)
+{
+   if (nvim->opts->rpc_errors)
+     return (_request_prepare(nvim, api) != NULL);
+
+   DBG("Preparing notification '%s'", _api_names[api].name);
+
+   /*
+    * Pack the message! It is an array of three (3) items:
+    *  - the rpc type:
+    *    - 2 is a notification
+    *  - the method (API string)
+    *  - the arguments count as an array.
+    */
+   msgpack_packer *const pk = &nvim->packer;
+   msgpack_pack_array(pk, 3);
+   msgpack_pack_int(pk, 2);
+   msgpack_pack_bin(pk, _api_names[api].size);
+   msgpack_pack_bin_body(pk, _api_names[api].name, _api_names[api].size);
+   return EINA_TRUE;
+}
+
 static void
-_request_cleanup(s_nvim *nvim,
-                 s_request *req)
+_input_pack(s_nvim *nvim)
 {
-   Eina_List *const list = nvim_api_request_find(nvim, req->uid);
-   if (EINA_LIKELY(list != NULL))
+   Eina_Strbuf *const keys = nvim->input.keys;
+   const size_t size = eina_strbuf_length_get(keys);
+   if (size == 0) { return; }
+
+   /*
+    * All the keys that were accumulated since the last time are sent in a
+    * single nvim_input call. We use _notification_prepare() and not
+    * _notification_new(), as the latter would pack the input again.
+    */
+   if (EINA_UNLIKELY(! _notification_prepare(nvim, E_API_INPUT)))
      {
-        nvim_api_request_free(nvim, list);
+        CRI("Failed to create request. %zu bytes of input are lost.", size);
+        goto end;
      }
+
+   msgpack_packer *const pk = &nvim->packer;
+   msgpack_pack_array(pk, 1);
+   msgpack_pack_str(pk, size);
+   msgpack_pack_str_body(pk, eina_strbuf_string_get(keys), size);
+
+   nvim->input.requests++;
+   DBG("Sending %u inputs in one call (%zu bytes)", nvim->input.pending, size);
+end:
+   nvim->input.pending = 0;
+   eina_strbuf_reset(keys);
+}
+
+static s_request *
+_request_new(s_nvim *nvim,
+             e_api api)
+{
+   /* Pending keys were typed before this request was made. They must reach
+    * neovim first. */
+   _input_pack(nvim);
+   return _request_prepare(nvim, api);
 }
 
 static Eina_Bool
-_request_send(s_nvim *nvim,
-              s_request *req)
+_notification_new(s_nvim *nvim,
+                  e_api api)
 {
-   /* Finally, send that to the slave neovim process */
-   const Eina_Bool ok = ecore_exe_send(
-      nvim->exe, nvim->sbuffer.data, (int)nvim->sbuffer.size
-   );
-   if (EINA_UNLIKELY(! ok))
+   /* Same as _request_new() */
+   _input_pack(nvim);
+   return _notification_prepare(nvim, api);
+}
+
+static Eina_Bool
+_flush_cb(void *data)
+{
+   s_nvim *const nvim = data;
+
+   /* Returning ECORE_CALLBACK_CANCEL deletes the idle enterer */
+   nvim->flusher = NULL;
+   nvim_api_flush(nvim);
+   return ECORE_CALLBACK_CANCEL;
+}
+
+static Eina_Bool
+_flush_schedule(s_nvim *nvim)
+{
+   if (! nvim->flusher)
      {
-        CRI("Failed to send %zu bytes to neovim", nvim->sbuffer.size);
-        _request_cleanup(nvim, req);
-        return EINA_FALSE;
+        nvim->flusher = ecore_idle_enterer_before_add(_flush_cb, nvim);
+        if (EINA_UNLIKELY(! nvim->flusher))
+          {
+             ERR("Failed to create idle enterer. Sending data right now.");
+             return nvim_api_flush(nvim);
+          }
      }
-   DBG("Sent %zu bytes to neovim", nvim->sbuffer.size);
    return EINA_TRUE;
 }
 
-Eina_List *
+static Eina_Bool
+_message_send(s_nvim *nvim)
+{
+   /*
+    * Messages are not sent one by one, as this would mean one write per
+    * message. They are accumulated in the serialization buffer, and sent
+    * all at once when the main loop is done with the current iteration.
+    * If a lot of data is accumulated, we don't wait to send it.
+    */
+   if (nvim->sbuffer.size >= FLUSH_THRESHOLD)
+     return nvim_api_flush(nvim);
+   else
+     return _flush_schedule(nvim);
+}
+
+Eina_Bool
+nvim_api_flush(s_nvim *nvim)
+{
+   if (nvim->flusher)
+     {
+        ecore_idle_enterer_del(nvim->flusher);
+        nvim->flusher = NULL;
+     }
+   _input_pack(nvim);
+   if (nvim->sbuffer.size == 0) { return EINA_TRUE; }
+
+   if (nvim->recorder)
+     rpc_recorder_write(nvim->recorder, RPC_DIR_SENT,
+                        nvim->sbuffer.data, nvim->sbuffer.size);
+
+   /* Finally, send that to the slave neovim process. When a session is
+    * replayed, there is no one to send it to: the replay already contains the
+    * responses. */
+   const Eina_Bool ok = (nvim->writer)
+      ? nvim_writer_write(nvim->writer, nvim->sbuffer.data, nvim->sbuffer.size)
+      : EINA_TRUE;
+   if (EINA_LIKELY(ok))
+     {
+        DBG("Sent %zu bytes to neovim", nvim->sbuffer.size);
+        nvim->stats.bytes_out += nvim->sbuffer.size;
+     }
+   else
+     CRI("Failed to send %zu bytes to neovim", nvim->sbuffer.size);
+
+   /* Request identifiers are sequential, so the ones that were just sent
+    * are easy to find */
+   const uint32_t first_uid = nvim->flush_uid;
+   const uint32_t end_uid = nvim->request_id;
+   msgpack_sbuffer_clear(&nvim->sbuffer);
+   nvim->flush_uid = nvim->request_id;
+
+   if (EINA_UNLIKELY(! ok))
+     {
+        /* None of them will be answered. Their callbacks are told so, and
+         * may send new requests, which are not part of the range. */
+        for (uint32_t uid = first_uid; uid != end_uid; uid++)
+          {
+             s_request *const req = nvim_api_request_find(nvim, uid);
+             if (req) nvim_api_request_call(nvim, req, NULL,
+                                            "failed to send the request");
+          }
+     }
+   return ok;
+}
+
+s_request *
 nvim_api_request_find(const s_nvim *nvim,
                       uint32_t req_id)
 {
-   const s_request *req;
-   Eina_List *it;
+   return request_table_find(&(nvim->requests.table), req_id);
+}
+
+void
+nvim_api_request_answered(s_nvim *nvim,
+                          const s_request *req)
+{
+   stats_api_answered(&(nvim->stats.apis[req->api]),
+                      ecore_time_get() - req->sent);
+}
+
+void
+nvim_api_request_free(s_nvim *nvim,
+                      s_request *req)
+{
+   request_table_del(&(nvim->requests.table), req);
+}
+
+void
+nvim_api_request_call(s_nvim *nvim,
+                      s_request *req,
+                      const msgpack_object *result,
+                      const char *error)
+{
+   /* The callback may very well send new requests, which may cause the
+    * requests to be moved in their table. So we release the request before
+    * calling anything. */
+   const f_nvim_api_cb func = req->cb.func;
+   void *const data = req->cb.data;
+   nvim_api_request_free(nvim, req);
+
+   if (func) func(nvim, data, result, error);
+}
+
+static Eina_Bool
+_requests_sweep_cb(void *data)
+{
+   s_nvim *const nvim = data;
+   s_request_table *const table = &(nvim->requests.table);
+   if (table->count == 0) { return ECORE_CALLBACK_RENEW; }
 
-   EINA_LIST_FOREACH(nvim->requests, it, req)
+   /*
+    * Releasing a request shifts the ones that follow it back in the table,
+    * so the slot of an expired request is checked again after it has been
+    * released. Callbacks are given the chance to handle the failure. As they
+    * may send new requests, the table may be reallocated and its requests
+    * moved while we go through it. A request may then be missed, and will be
+    * by the next sweep, or visited twice, which is harmless.
+    */
+   const double now = ecore_time_get();
+   uint32_t i = 0;
+   while (table->slots && (i <= table->mask))
+     {
+        s_request *const req = &(table->slots[i]);
+        if ((! req->pending) || (now - req->sent < nvim->requests.timeout))
+          {
+             i++;
+             continue;
+          }
+
+        WRN("Request %"PRIu32" (%s) was not answered after %.1f seconds",
+            req->uid, _api_names[req->api].name, now - req->sent);
+        stats_api_expired(&(nvim->stats.apis[req->api]));
+        nvim->requests.expired++;
+        nvim_api_request_call(nvim, req, NULL, "request expired");
+     }
+   return ECORE_CALLBACK_RENEW;
+}
+
+Eina_Bool
+nvim_api_requests_timeout_set(s_nvim *nvim,
+                              double timeout)
+{
+   if (nvim->requests.sweeper)
+     {
+        ecore_timer_del(nvim->requests.sweeper);
+        nvim->requests.sweeper = NULL;
+     }
+   nvim->requests.timeout = timeout;
+   if (timeout <= 0.0) { return EINA_TRUE; }
+
+   /* Requests expire at most half a timeout late */
+   nvim->requests.sweeper = ecore_timer_add(timeout / 2.0,
+                                            _requests_sweep_cb, nvim);
+   if (EINA_UNLIKELY(! nvim->requests.sweeper))
      {
-        if (req->uid == req_id) { return it; }
+        CRI("Failed to create timer");
+        return EINA_FALSE;
      }
-   return NULL;
+   return EINA_TRUE;
 }
 
 void
-nvim_api_request_free(s_nvim *nvim,
-                      Eina_List *req_item)
+nvim_api_requests_drop(s_nvim *nvim)
 {
-   s_request *const req = eina_list_data_get(req_item);
-   nvim->requests = eina_list_remove_list(nvim->requests, req_item);
-   eina_mempool_free(_mempool, req);
+   /* Messages that were not sent yet are dropped as well */
+   if (nvim->flusher)
+     {
+        ecore_idle_enterer_del(nvim->flusher);
+        nvim->flusher = NULL;
+     }
+   msgpack_sbuffer_clear(&nvim->sbuffer);
+   eina_strbuf_reset(nvim->input.keys);
+   nvim->input.pending = 0;
+
+   if (nvim->requests.sweeper)
+     {
+        ecore_timer_del(nvim->requests.sweeper);
+        nvim->requests.sweeper = NULL;
+     }
+
+   if (nvim->requests.table.count)
+     INF("Dropping %u pending requests", nvim->requests.table.count);
+   request_table_clear(&(nvim->requests.table));
 }
 
-void nvim_api_request_call(s_nvim *nvim,
-                           const Eina_List *req_item,
-                           const msgpack_object *result)
+const char *
+nvim_api_name_get(e_api api)
 {
-   const s_request *const req = eina_list_data_get(req_item);
-   if (req->cb.func) req->cb.func(nvim, req->cb.data, result);
+   return (api < __E_API_LAST) ? _api_names[api].name : NULL;
 }
 
 Eina_Bool
@@ -144,8 +392,7 @@ nvim_api_ui_attach(s_nvim *nvim,
                    unsigned int width,
                    unsigned int height)
 {
-   const char api[] = "nvim_ui_attach";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
+   s_request *const req = _request_new(nvim, E_API_UI_ATTACH);
    if (EINA_UNLIKELY(! req))
      {
         CRI("Failed to create request");
@@ -154,13 +401,17 @@ nvim_api_ui_attach(s_nvim *nvim,
 
    const s_config *const cfg = nvim->config;
 
+   /* From neovim 0.4.0, the line-based grid events can be requested. They
+    * replace the put/highlight_set/cursor_goto protocol. */
+   const Eina_Bool linegrid = NVIM_VERSION_GE(nvim, 0, 4, 0);
+
    msgpack_packer *const pk = &nvim->packer;
    msgpack_pack_array(pk, 3);
    msgpack_pack_int64(pk, width);
    msgpack_pack_int64(pk, height);
 
-   /* Pack the options. There are 2: rgb, ext_popupmenu and ext_tabline */
-   msgpack_pack_map(pk, 3);
+   /* Pack the options: rgb, ext_popupmenu, ext_tabline (and ext_linegrid) */
+   msgpack_pack_map(pk, (linegrid) ? 4 : 3);
 
    /* Pack the RGB option (boolean) */
      {
@@ -193,21 +444,30 @@ nvim_api_ui_attach(s_nvim *nvim,
         else msgpack_pack_false(pk);
      }
 
-   return _request_send(nvim, req);
+   /* Pack the line-based grid */
+   if (linegrid)
+     {
+        const char key[] = "ext_linegrid";
+        const size_t len = sizeof(key) - 1;
+        msgpack_pack_str(pk, len);
+        msgpack_pack_str_body(pk, key, len);
+        msgpack_pack_true(pk);
+     }
+
+   nvim->ui_attached = EINA_TRUE;
+   return _message_send(nvim);
 }
 
 Eina_Bool
 nvim_api_ui_ext_cmdline_set(s_nvim *nvim,
                             Eina_Bool externalize)
 {
-   const char api[] = "nvim_ui_set_option";
    const char key[] = "ext_cmdline";
    const size_t len = sizeof(key) - 1;
 
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
-   if (EINA_UNLIKELY(! req))
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_UI_SET_OPTION)))
      {
-        CRI("Failed to create request");
+        CRI("Failed to create notification");
         return EINA_FALSE;
      }
 
@@ -218,21 +478,19 @@ nvim_api_ui_ext_cmdline_set(s_nvim *nvim,
    if (externalize) msgpack_pack_true(pk);
    else msgpack_pack_false(pk);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
 nvim_api_ui_ext_wildmenu_set(s_nvim *nvim,
                              Eina_Bool externalize)
 {
-   const char api[] = "nvim_ui_set_option";
    const char key[] = "ext_wildmenu";
    const size_t len = sizeof(key) - 1;
 
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
-   if (EINA_UNLIKELY(! req))
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_UI_SET_OPTION)))
      {
-        CRI("Failed to create request");
+        CRI("Failed to create notification");
         return EINA_FALSE;
      }
 
@@ -243,18 +501,16 @@ nvim_api_ui_ext_wildmenu_set(s_nvim *nvim,
    if (externalize) msgpack_pack_true(pk);
    else msgpack_pack_false(pk);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
 nvim_api_ui_try_resize(s_nvim *nvim,
                        unsigned int width, unsigned height)
 {
-   const char api[] = "nvim_ui_try_resize";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
-   if (EINA_UNLIKELY(! req))
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_UI_TRY_RESIZE)))
      {
-        CRI("Failed to create request");
+        CRI("Failed to create notification");
         return EINA_FALSE;
      }
 
@@ -263,7 +519,7 @@ nvim_api_ui_try_resize(s_nvim *nvim,
    msgpack_pack_int64(pk, width);
    msgpack_pack_int64(pk, height);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
@@ -273,8 +529,7 @@ nvim_api_eval(s_nvim *nvim,
               f_nvim_api_cb func,
               void *func_data)
 {
-   const char api[] = "nvim_eval";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
+   s_request *const req = _request_new(nvim, E_API_EVAL);
    if (EINA_UNLIKELY(! req))
      {
         CRI("Failed to create request");
@@ -289,7 +544,7 @@ nvim_api_eval(s_nvim *nvim,
    msgpack_pack_str(pk, input_size);
    msgpack_pack_str_body(pk, input, input_size);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
@@ -299,8 +554,7 @@ nvim_api_command_output(s_nvim *nvim,
                         f_nvim_api_cb func,
                         void *func_data)
 {
-   const char api[] = "nvim_command_output";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
+   s_request *const req = _request_new(nvim, E_API_COMMAND_OUTPUT);
    if (EINA_UNLIKELY(! req))
      {
         CRI("Failed to create request");
@@ -315,7 +569,7 @@ nvim_api_command_output(s_nvim *nvim,
    msgpack_pack_str(pk, input_size);
    msgpack_pack_str_body(pk, input, input_size);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
@@ -323,11 +577,9 @@ nvim_api_command(s_nvim *nvim,
                  const char *input,
                  unsigned int input_size)
 {
-   const char api[] = "nvim_command";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
-   if (EINA_UNLIKELY(! req))
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_COMMAND)))
      {
-        CRI("Failed to create request");
+        CRI("Failed to create notification");
         return EINA_FALSE;
      }
    DBG("Running nvim command: %s", input);
@@ -337,7 +589,7 @@ nvim_api_command(s_nvim *nvim,
    msgpack_pack_str(pk, input_size);
    msgpack_pack_str_body(pk, input, input_size);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
@@ -345,11 +597,9 @@ nvim_api_var_integer_set(s_nvim *nvim,
                          const char *name,
                          int value)
 {
-   const char api[] = "nvim_set_var";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
-   if (EINA_UNLIKELY(! req))
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_SET_VAR)))
      {
-        CRI("Failed to create request");
+        CRI("Failed to create notification");
         return EINA_FALSE;
      }
    const size_t name_size = strlen(name);
@@ -360,45 +610,108 @@ nvim_api_var_integer_set(s_nvim *nvim,
    msgpack_pack_str_body(pk, name, name_size);
    msgpack_pack_int(pk, value);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
-nvim_api_input(s_nvim *nvim,
-               const char *input,
-               unsigned int input_size)
+nvim_api_var_set(s_nvim *nvim,
+                 const char *name,
+                 f_nvim_api_pack pack)
 {
-   const char api[] = "nvim_input";
-   s_request *const req = _request_new(nvim, api, sizeof(api) - 1);
+   if (EINA_UNLIKELY(! _notification_new(nvim, E_API_SET_VAR)))
+     {
+        CRI("Failed to create notification");
+        return EINA_FALSE;
+     }
+   const size_t name_size = strlen(name);
+
+   /* The value is packed by the caller, in place */
+   msgpack_packer *const pk = &nvim->packer;
+   msgpack_pack_array(pk, 2);
+   msgpack_pack_str(pk, name_size);
+   msgpack_pack_str_body(pk, name, name_size);
+   pack(nvim, pk);
+
+   return _message_send(nvim);
+}
+
+Eina_Bool
+nvim_api_paste(s_nvim *nvim,
+               const char *data,
+               size_t size,
+               int phase,
+               f_nvim_api_cb func,
+               void *func_data)
+{
+   s_request *const req = _request_new(nvim, E_API_PASTE);
    if (EINA_UNLIKELY(! req))
      {
         CRI("Failed to create request");
         return EINA_FALSE;
      }
+   req->cb.func = func;
+   req->cb.data = func_data;
 
+   /* Arguments are: the data, whether to convert CRLF, the phase.
+    * The data is sent as-is: neovim does not interpret it. */
    msgpack_packer *const pk = &nvim->packer;
-   msgpack_pack_array(pk, 1);
-   msgpack_pack_str(pk, input_size);
-   msgpack_pack_str_body(pk, input, input_size);
+   msgpack_pack_array(pk, 3);
+   msgpack_pack_str(pk, size);
+   msgpack_pack_str_body(pk, data, size);
+   msgpack_pack_false(pk);
+   msgpack_pack_int(pk, phase);
 
-   return _request_send(nvim, req);
+   return _message_send(nvim);
 }
 
 Eina_Bool
-nvim_api_init(void)
+nvim_api_input(s_nvim *nvim,
+               const char *input,
+               unsigned int input_size)
 {
-   _mempool = eina_mempool_add("chained_mempool", "s_request",
-                               NULL, sizeof(s_request), 8);
-   if (EINA_UNLIKELY(! _mempool))
+   /*
+    * Keys are not sent right away. They are accumulated, so all the keys
+    * (and mouse events) received during one main loop iteration are sent
+    * in a single nvim_input request. This is transparent for neovim, which
+    * would have concatenated them in its input queue anyway.
+    */
+   if (EINA_UNLIKELY(! eina_strbuf_append_length(nvim->input.keys,
+                                                 input, input_size)))
      {
-        CRI("Failed to initialize chained mempool");
+        CRI("Failed to queue %u bytes of input", input_size);
         return EINA_FALSE;
      }
-   return EINA_TRUE;
+   nvim->input.pending++;
+   nvim->input.inputs++;
+
+   return _flush_schedule(nvim);
 }
 
-void
-nvim_api_shutdown(void)
+Eina_Bool
+nvim_api_input_request(s_nvim *nvim,
+                       const char *input,
+                       unsigned int input_size,
+                       f_nvim_api_cb func,
+                       void *func_data)
 {
-   eina_mempool_del(_mempool);
+   /*
+    * Unlike nvim_api_input(), the input is sent in its own request, so the
+    * caller knows when neovim has received it. Keys that are waiting to be
+    * sent are packed before it, so the order is preserved.
+    */
+   s_request *const req = _request_new(nvim, E_API_INPUT);
+   if (EINA_UNLIKELY(! req))
+     {
+        CRI("Failed to create request");
+        return EINA_FALSE;
+     }
+   req->cb.func = func;
+   req->cb.data = func_data;
+
+   msgpack_packer *const pk = &nvim->packer;
+   msgpack_pack_array(pk, 1);
+   msgpack_pack_str(pk, input_size);
+   msgpack_pack_str_body(pk, input, input_size);
+
+   return _message_send(nvim);
 }
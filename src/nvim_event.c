@@ -23,22 +23,13 @@
 #include "eovim/types.h"
 #include "eovim/nvim.h"
 #include "eovim/nvim_event.h"
+#include "eovim/redraw.h"
 #include "eovim/msgpack_helper.h"
 #include "eovim/gui.h"
 #include "eovim/mode.h"
 
 typedef enum
 {
-   /* Highlight keywords */
-   KW_FOREGROUND,
-   KW_BACKGROUND,
-   KW_SPECIAL,
-   KW_REVERSE,
-   KW_ITALIC,
-   KW_BOLD,
-   KW_UNDERLINE,
-   KW_UNDERCURL,
-
    /* Mode info set keywords */
    KW_CURSOR_SHAPE,
    KW_CELL_PERCENTAGE,
@@ -56,32 +47,14 @@ typedef enum
    __KW_LAST,
 
    /* Aliases */
-   KW_HIGHLIGHT_START = KW_FOREGROUND,
-   KW_HIGHLIGHT_END = KW_UNDERCURL,
    KW_MODE_INFO_START = KW_CURSOR_SHAPE,
    KW_MODE_INFO_END = KW_MOUSE_SHAPE,
    KW_MODES_START = KW_MODE_NORMAL,
    KW_MODES_END = KW_MODE_NORMAL,
 } e_kw;
 
-typedef struct
-{
-   Eina_Stringshare *name; /**< Name of the method */
-   Eina_Hash *callbacks; /**< Table of callbacks associated with the method */
-} s_method;
-
-typedef enum
-{
-   E_METHOD_REDRAW, /**< The "redraw" method */
-   E_METHOD_EOVIM, /**< The "eovim" method */
-
-   __E_METHOD_LAST
-} e_method;
-
-/* Array of callbacks for each method. It is NOT a hash table as we will support
- * (for now) very little number of methods (around two). It is much faster to
- * search sequentially among arrays of few cells than a map of two. */
-static s_method _methods[__E_METHOD_LAST];
+/* Callbacks of the commands of the "eovim" method, registered by plugins */
+static Eina_Hash *_plugin_callbacks = NULL;
 
 /* Cache of stringshared keywords */
 static Eina_Stringshare *_keywords[__KW_LAST];
@@ -192,39 +165,6 @@ nvim_event_resize(s_nvim *nvim,
    return EINA_TRUE;
 }
 
-static Eina_Bool
-nvim_event_clear(s_nvim *nvim,
-                 const msgpack_object_array *args EINA_UNUSED)
-{
-   gui_clear(&nvim->gui);
-   return EINA_TRUE;
-}
-
-static Eina_Bool
-nvim_event_eol_clear(s_nvim *nvim,
-                     const msgpack_object_array *args EINA_UNUSED)
-{
-   gui_eol_clear(&nvim->gui);
-   return EINA_TRUE;
-}
-
-static Eina_Bool
-nvim_event_cursor_goto(s_nvim *nvim,
-                       const msgpack_object_array *args)
-{
-   CHECK_BASE_ARGS_COUNT(args, ==, 1);
-   ARRAY_OF_ARGS_EXTRACT(args, params);
-   CHECK_ARGS_COUNT(params, ==, 2);
-
-   t_int row, column;
-   GET_ARG(params, 0, t_int, &row);
-   GET_ARG(params, 1, t_int, &column);
-
-   gui_cursor_goto(&nvim->gui, (unsigned int)column, (unsigned int)row);
-
-   return EINA_TRUE;
-}
-
 static Eina_Bool
 _mode_info_set(s_nvim *nvim,
                const msgpack_object_array *params)
@@ -420,213 +360,6 @@ nvim_event_mode_change(s_nvim *nvim,
    return EINA_TRUE;
 }
 
-static Eina_Bool
-nvim_event_set_scroll_region(s_nvim *nvim,
-                             const msgpack_object_array *args)
-{
-   CHECK_BASE_ARGS_COUNT(args, ==, 1);
-   ARRAY_OF_ARGS_EXTRACT(args, params);
-   CHECK_ARGS_COUNT(params, ==, 4);
-
-   t_int top, bot, left, right;
-   GET_ARG(params, 0, t_int, &top);
-   GET_ARG(params, 1, t_int, &bot);
-   GET_ARG(params, 2, t_int, &left);
-   GET_ARG(params, 3, t_int, &right);
-
-   gui_scroll_region_set(&nvim->gui, (int)top, (int)bot, (int)left, (int)right);
-
-   return EINA_TRUE;
-}
-
-static Eina_Bool
-nvim_event_scroll(s_nvim *nvim,
-                  const msgpack_object_array *args)
-{
-   /*
-    * It appears that in some cases (when the sh*tty command popup opens,
-    * because a message is open in another castle), the scroll command changes,
-    * and we get ["scroll", [N], [N]] instead of ["scroll", [N]].  I'm not sure
-    * if this is supposed to happen, but that's what happens!  So we should be
-    * ready to handle X arguments to "scroll" instead of just one
-    */
-   for (unsigned int i = 1; i < args->size; i++) /* 1 to exclude "scroll" */
-     {
-        const msgpack_object *const obj = &(args->ptr[i]);
-        CHECK_TYPE(obj, MSGPACK_OBJECT_ARRAY, EINA_FALSE);
-        const msgpack_object_array *const arr = &(obj->via.array);
-        CHECK_ARGS_COUNT(arr, ==, 1);
-
-        t_int scroll;
-        GET_ARG(arr, 0, t_int, &scroll);
-        gui_scroll(&nvim->gui, (int)scroll);
-     }
-
-   return EINA_TRUE;
-}
-
-static Eina_Bool
-nvim_event_highlight_set(s_nvim *nvim,
-                         const msgpack_object_array *args)
-{
-   CHECK_BASE_ARGS_COUNT(args, >=, 1);
-
-   /* Array that holds pointer to values within hash tables.
-    * We must ensure this array has been zeroes-out since we will rely on
-    * NULL pointers to check whether a value was provided or not */
-   const msgpack_object *objs[KW_HIGHLIGHT_END - KW_HIGHLIGHT_START + 1];
-   memset(objs, 0, sizeof(objs));
-
-   /*
-    * highlight arguments are arrays containing maps.
-    */
-   for (unsigned int i = 1; i < args->size; i++)
-     {
-        const msgpack_object *const obj = &(args->ptr[i]);
-        CHECK_TYPE(obj, MSGPACK_OBJECT_ARRAY, EINA_FALSE);
-        const msgpack_object_array *const arr = &(obj->via.array);
-        CHECK_ARGS_COUNT(arr, ==, 1);
-        const msgpack_object *const arr_arg = &(arr->ptr[0]);
-        CHECK_TYPE(arr_arg, MSGPACK_OBJECT_MAP, EINA_FALSE);
-
-        /*
-         * Okay, we now have a map. We go through all its key-value pairs
-         * and match the keys with the expected keys. If we have a match,
-         * we grab a pointer to the value, and pass on to the next pair.
-         */
-        const msgpack_object_map *const map = &(arr_arg->via.map);
-        for (unsigned int j = 0; j < map->size; j++)
-          {
-             const msgpack_object_kv *const kv = &(map->ptr[j]);
-             const msgpack_object *const key_obj = &(kv->key);
-             CHECK_TYPE(key_obj, MSGPACK_OBJECT_STR, EINA_FALSE);
-             const msgpack_object_str *const key = &(key_obj->via.str);
-             Eina_Stringshare *const shr_key = eina_stringshare_add_length(
-                key->ptr, key->size
-             );
-             if (EINA_UNLIKELY(! shr_key))
-               {
-                  CRI("Failed to create stringshare");
-                  return EINA_FALSE;
-               }
-
-             /*
-              * Keys matching. I think this is pretty efficient, as we are
-              * comparing stringshares! So key matching is just a pointer
-              * comparison. There are not much keys to be matched against
-              * (< 10), so linear walk is good enough -- probably faster than
-              * hashing.
-              */
-             for (unsigned int k = KW_HIGHLIGHT_START, x = 0; k <= KW_HIGHLIGHT_END; k++, x++)
-               {
-                  if (shr_key == KW(k))
-                    {
-                       objs[x] = &(kv->val);
-                       break;
-                    }
-               }
-
-             eina_stringshare_del(shr_key);
-          }
-     }
-
-   s_termview_style style = {
-      .fg_color = -1,
-      .bg_color = -1,
-      .sp_color = -1,
-      .reverse = EINA_FALSE,
-      .italic = EINA_FALSE,
-      .bold = EINA_FALSE,
-      .underline = EINA_FALSE,
-      .undercurl = EINA_FALSE,
-   };
-   const msgpack_object *o;
-
-   /*
-    * At this point, we have collected everything we could. We check for
-    * types to ensure that we will correctly use the memory.
-    */
-
-#define _GET_INT(Kw, Set)                                                     \
-   if ((o = objs[Kw])) {                                                      \
-        if (EINA_UNLIKELY((o->type != MSGPACK_OBJECT_POSITIVE_INTEGER) &&     \
-                          (o->type != MSGPACK_OBJECT_NEGATIVE_INTEGER)))      \
-          CRI("Expected an integer type. Got 0x%x", o->type);                 \
-        else Set = o->via.i64;                                                \
-   }
-
-#define _GET_BOOL(Kw, Set)                                                    \
-   if ((o = objs[Kw])) {                                                      \
-        if (EINA_UNLIKELY(o->type != MSGPACK_OBJECT_BOOLEAN))                 \
-          CRI("Expected an integer type. Got 0x%x", o->type);                 \
-        else Set = o->via.boolean;                                            \
-   }
-
-   _GET_INT(KW_FOREGROUND, style.fg_color);
-   _GET_INT(KW_BACKGROUND, style.bg_color);
-   _GET_INT(KW_SPECIAL, style.sp_color);
-   _GET_BOOL(KW_REVERSE, style.reverse);
-   _GET_BOOL(KW_ITALIC, style.italic);
-   _GET_BOOL(KW_BOLD, style.bold);
-   _GET_BOOL(KW_UNDERLINE, style.underline);
-   _GET_BOOL(KW_UNDERCURL, style.undercurl);
-
-#undef _GET_INT
-#undef _GET_BOOL
-
-   gui_style_set(&nvim->gui, &style);
-
-   return EINA_TRUE;
-}
-
-static Eina_Bool
-nvim_event_put(s_nvim *nvim,
-               const msgpack_object_array *args)
-{
-   /*
-    * The 'put' command is much more complicated than what it should be.
-    * We are suppose to receive a string, but we actually do receive arrays
-    * of strings.
-    */
-   CHECK_BASE_ARGS_COUNT(args, >=, 1);
-
-   /* Reset the put decode buffer */
-   eina_ustrbuf_reset(nvim->decode);
-
-   /*
-    * Go through all the arguments. Each argument is an array that contains
-    * exactly one string. We concatenate all these strings together in one
-    * static buffer (this is always called from the main thread, so no
-    * concurrency shit).
-    */
-   for (unsigned int i = 1; i < args->size; i++)
-     {
-        const msgpack_object *const obj = &(args->ptr[i]);
-        CHECK_TYPE(obj, MSGPACK_OBJECT_ARRAY, EINA_FALSE);
-        const msgpack_object_array *const arr = &(obj->via.array);
-        CHECK_ARGS_COUNT(arr, ==, 1);
-        const msgpack_object *const arr_arg = &(arr->ptr[0]);
-        CHECK_TYPE(arr_arg, MSGPACK_OBJECT_STR, EINA_FALSE);
-
-        const msgpack_object_str *const str = &(arr_arg->via.str);
-        int index = 0;
-        const Eina_Unicode cp = eina_unicode_utf8_next_get(str->ptr, &index);
-        if (EINA_UNLIKELY(cp == 0))
-          {
-             ERR("Failed to decode utf-8 string. Skipping.");
-             continue;
-          }
-        eina_ustrbuf_append_char(nvim->decode, cp);
-     }
-
-   /* Finally, pass the string and its length to the gui */
-   gui_put(&nvim->gui,
-           eina_ustrbuf_string_get(nvim->decode),
-           (unsigned int)eina_ustrbuf_length_get(nvim->decode));
-
-   return EINA_TRUE;
-}
-
 static Eina_Bool
 nvim_event_bell(s_nvim *nvim,
                 const msgpack_object_array *args EINA_UNUSED)
@@ -1115,247 +848,380 @@ fail:
    return EINA_FALSE;
 }
 
-Eina_Bool
-nvim_event_dispatch(s_nvim *nvim,
-                    Eina_Stringshare *method_name,
-                    Eina_Stringshare *command,
-                    const msgpack_object_array *args)
+static Eina_Bool
+nvim_event_flush(s_nvim *nvim,
+                 const msgpack_object_array *args EINA_UNUSED)
+{
+   /* Neovim is done updating the screen: it can be displayed */
+   gui_flush(&nvim->gui);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+nvim_event_grid_resize(s_nvim *nvim,
+                       const msgpack_object_array *args)
 {
-   /* Go sequentially through the list of methods we know about, so we can
-    * find out the callbacks table for that method, to try to find what matches
-    * 'command'. */
-   for (unsigned int i = 0; i < EINA_C_ARRAY_LENGTH(_methods); i++)
+   CHECK_BASE_ARGS_COUNT(args, >=, 1);
+
+   /* We don't use ext_multigrid, so there is only one grid to care about */
+   for (unsigned int i = 1; i < args->size; i++)
      {
-        const s_method *const method = &(_methods[i]);
-        if (method->name == method_name) /* Fond the method */
+        const msgpack_object_array *const params =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        CHECK_ARGS_COUNT(params, ==, 3);
+
+        t_int columns, rows;
+        GET_ARG(params, 1, t_int, &columns);
+        GET_ARG(params, 2, t_int, &rows);
+        gui_resized_confirm(&nvim->gui,
+                            (unsigned int)columns, (unsigned int)rows);
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+nvim_event_hl_attr_define(s_nvim *nvim,
+                          const msgpack_object_array *args)
+{
+   CHECK_BASE_ARGS_COUNT(args, >=, 1);
+
+   /*
+    * Each argument is [ id, rgb_attr, cterm_attr, info ]. Depending on the
+    * color mode we attached with, only one of the two attribute maps is
+    * relevant to us. Attributes that are not specified are the defaults.
+    */
+   const unsigned int map_index = (nvim->true_colors) ? 1 : 2;
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const params =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        CHECK_ARGS_COUNT(params, >=, 3);
+
+        t_int id;
+        GET_ARG(params, 0, t_int, &id);
+        if (EINA_UNLIKELY((id < 0) || (id > UINT16_MAX)))
           {
-             /* Grab the callback for the command. If we could find none,
-              * that's an error. Otherwise we call it. In both cases, the
-              * execution of the function will be terminated. */
-             const f_event_cb cb = eina_hash_find(method->callbacks, command);
-             if (EINA_UNLIKELY(! cb))
-               {
-                  CRI("Failed to get callback for command '%s' of method '%s'",
-                      command, method_name);
-                  return EINA_FALSE;
-               }
-             else
-               return cb(nvim, args);
+             ERR("Highlight attribute identifier is out of range");
+             continue;
           }
+        const msgpack_object_map *const map =
+           EOVIM_MSGPACK_MAP_EXTRACT(&(params->ptr[map_index]), fail);
+
+        s_termview_style style = {
+           .fg_color = -1,
+           .bg_color = -1,
+           .sp_color = -1,
+           .reverse = EINA_FALSE,
+           .italic = EINA_FALSE,
+           .bold = EINA_FALSE,
+           .underline = EINA_FALSE,
+           .undercurl = EINA_FALSE,
+        };
+        if (EINA_UNLIKELY(! redraw_style_decode(map, &style)))
+          goto fail;
+        gui_hl_attr_define(&nvim->gui, (unsigned int)id, &style);
      }
-
-   /* At this point, we didn't find the method. */
-   CRI("Unknown method '%s'", method_name);
+   return EINA_TRUE;
+fail:
    return EINA_FALSE;
 }
 
-
-typedef struct
+static Eina_Bool
+nvim_event_hl_group_set(s_nvim *nvim EINA_UNUSED,
+                        const msgpack_object_array *args EINA_UNUSED)
 {
-   const char *const name; /**< Name of the event */
-   const unsigned int size; /**< Size of @p name */
-   const f_event_cb func; /**< Callback function */
-} s_method_ctor;
-
-#define CB_CTOR(Name, Func) \
-{ .name = (Name), .size = sizeof(Name) - 1, .func = (Func) }
+   /* Eovim does not style its widgets after neovim's highlight groups */
+   return EINA_TRUE;
+}
 
 static Eina_Bool
-_command_add(Eina_Hash *table,
-             const char *name,
-             unsigned int name_len,
-             f_event_cb func)
+nvim_event_default_colors_set(s_nvim *nvim,
+                              const msgpack_object_array *args)
 {
-   /* Create the key to be inserted in the table */
-   Eina_Stringshare *const cmd = eina_stringshare_add_length(
-      name, name_len
-   );
-   if (EINA_UNLIKELY(! cmd))
+   CHECK_BASE_ARGS_COUNT(args, >=, 1);
+
+   /* Only the last call matters, as it overrides the previous ones */
+   const msgpack_object_array *const params =
+      EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[args->size - 1]), fail);
+   CHECK_ARGS_COUNT(params, >=, 5);
+
+   /*
+    * Arguments are [ rgb_fg, rgb_bg, rgb_sp, cterm_fg, cterm_bg ]. The cterm
+    * colors are shifted by one, zero meaning "terminal default".
+    * The special color is not supported, so it is simply ignored.
+    */
+   t_int fg, bg;
+   if (nvim->true_colors)
      {
-        CRI("Failed to create stringshare from '%s', size %u",
-            name, name_len);
-        goto fail;
+        GET_ARG(params, 0, t_int, &fg);
+        GET_ARG(params, 1, t_int, &bg);
      }
-
-   /* Add the value 'func' to the key 'cmd' in the table */
-   if (EINA_UNLIKELY(! eina_hash_add(table, cmd, func)))
+   else
      {
-        CRI("Failed to register callback %p for command '%s'",
-            func, cmd);
-        goto add_fail;
+        GET_ARG(params, 3, t_int, &fg);
+        GET_ARG(params, 4, t_int, &bg);
+        fg--;
+        bg--;
      }
-
+   gui_update_fg(&nvim->gui, fg);
+   gui_update_bg(&nvim->gui, bg);
    return EINA_TRUE;
-add_fail:
-   eina_stringshare_del(cmd);
 fail:
    return EINA_FALSE;
 }
 
-static Eina_Hash *
-_method_callbacs_table_build(const s_method_ctor *ctors,
-                             unsigned int ctors_count)
+/*
+ * Callbacks of the redraw commands. The commands that are decoded by the
+ * reader thread (see redraw.c) are directly applied to the GUI, and don't
+ * need to be dispatched.
+ */
+static const f_event_cb _redraw_handlers[__E_REDRAW_LAST] =
 {
-   /* Generate a hash table that will contain the callbacks to be called for
-    * each event sent by neovim. */
-   Eina_Hash *const cb = eina_hash_stringshared_new(NULL);
-   if (EINA_UNLIKELY(! cb))
-     {
-        CRI("Failed to create hash table to hold callbacks");
-        goto fail;
-     }
+   [E_REDRAW_RESIZE] = nvim_event_resize,
+   [E_REDRAW_MODE_INFO_SET] = nvim_event_mode_info_set,
+   [E_REDRAW_UPDATE_MENU] = nvim_event_update_menu,
+   [E_REDRAW_BUSY_START] = nvim_event_busy_start,
+   [E_REDRAW_BUSY_STOP] = nvim_event_busy_stop,
+   [E_REDRAW_MOUSE_ON] = nvim_event_mouse_on,
+   [E_REDRAW_MOUSE_OFF] = nvim_event_mouse_off,
+   [E_REDRAW_MODE_CHANGE] = nvim_event_mode_change,
+   [E_REDRAW_BELL] = nvim_event_bell,
+   [E_REDRAW_VISUAL_BELL] = nvim_event_visual_bell,
+   [E_REDRAW_UPDATE_FG] = nvim_event_update_fg,
+   [E_REDRAW_UPDATE_BG] = nvim_event_update_bg,
+   [E_REDRAW_UPDATE_SP] = nvim_event_update_sp,
+   [E_REDRAW_SUSPEND] = nvim_event_suspend,
+   [E_REDRAW_SET_TITLE] = nvim_event_set_title,
+   [E_REDRAW_SET_ICON] = nvim_event_set_icon,
+   [E_REDRAW_POPUPMENU_SHOW] = nvim_event_popupmenu_show,
+   [E_REDRAW_POPUPMENU_HIDE] = nvim_event_popupmenu_hide,
+   [E_REDRAW_POPUPMENU_SELECT] = nvim_event_popupmenu_select,
+   [E_REDRAW_TABLINE_UPDATE] = nvim_event_tabline_update,
+   [E_REDRAW_CMDLINE_SHOW] = nvim_event_cmdline_show,
+   [E_REDRAW_CMDLINE_POS] = nvim_event_cmdline_pos,
+   [E_REDRAW_CMDLINE_SPECIAL_CHAR] = nvim_event_cmdline_special_char,
+   [E_REDRAW_CMDLINE_HIDE] = nvim_event_cmdline_hide,
+   [E_REDRAW_CMDLINE_BLOCK_SHOW] = nvim_event_cmdline_block_show,
+   [E_REDRAW_CMDLINE_BLOCK_APPEND] = nvim_event_cmdline_block_append,
+   [E_REDRAW_CMDLINE_BLOCK_HIDE] = nvim_event_cmdline_block_hide,
+   [E_REDRAW_WILDMENU_SHOW] = nvim_event_wildmenu_show,
+   [E_REDRAW_WILDMENU_HIDE] = nvim_event_wildmenu_hide,
+   [E_REDRAW_WILDMENU_SELECT] = nvim_event_wildmenu_select,
+   [E_REDRAW_FLUSH] = nvim_event_flush,
+   [E_REDRAW_GRID_RESIZE] = nvim_event_grid_resize,
+   [E_REDRAW_HL_ATTR_DEFINE] = nvim_event_hl_attr_define,
+   [E_REDRAW_HL_GROUP_SET] = nvim_event_hl_group_set,
+   [E_REDRAW_DEFAULT_COLORS_SET] = nvim_event_default_colors_set,
+};
+
+/* Names of the redraw commands, mostly for debug purposes */
+static const struct {
+   const char *const name;
+   const unsigned int size;
+} _redraw_names[__E_REDRAW_LAST] =
+{
+#define REDRAW_COMMAND(Id, Name) \
+   [E_REDRAW_ ## Id] = { .name = #Name, .size = sizeof(#Name) - 1 },
+#include "eovim/redraw_commands.x"
+};
+
+e_redraw_command
+nvim_event_redraw_command_get(const char *name,
+                              size_t len)
+{
+   /*
+    * This is called for every single redraw command neovim sends us, so it
+    * must be fast and must not allocate. We first discriminate the commands
+    * by their length (plain integer comparison), then compare them byte per
+    * byte. There are at most a handful of commands sharing the same length.
+    * It must be kept in sync with 'eovim/redraw_commands.x'.
+    */
+#define MATCH(Id, Str) \
+   if (memcmp(name, Str, sizeof(Str) - 1) == 0) { return E_REDRAW_ ## Id; }
 
-   /* Add the events in the callbacks table. */
-   for (unsigned int i = 0; i < ctors_count; i++)
+   switch (len)
      {
-        const Eina_Bool ok =
-           _command_add(cb, ctors[i].name, ctors[i].size, ctors[i].func);
-        if (EINA_UNLIKELY(! ok))
-          {
-             CRI("Failed to register command '%s'", ctors[i].name);
-             goto hash_free;
-          }
+      case 3:
+         MATCH(PUT, "put");
+         break;
+      case 4:
+         MATCH(BELL, "bell");
+         break;
+      case 5:
+         MATCH(CLEAR, "clear");
+         MATCH(FLUSH, "flush");
+         break;
+      case 6:
+         MATCH(SCROLL, "scroll");
+         MATCH(RESIZE, "resize");
+         break;
+      case 7:
+         MATCH(SUSPEND, "suspend");
+         break;
+      case 8:
+         MATCH(MOUSE_ON, "mouse_on");
+         MATCH(SET_ICON, "set_icon");
+         break;
+      case 9:
+         MATCH(EOL_CLEAR, "eol_clear");
+         MATCH(BUSY_STOP, "busy_stop");
+         MATCH(MOUSE_OFF, "mouse_off");
+         MATCH(UPDATE_FG, "update_fg");
+         MATCH(UPDATE_BG, "update_bg");
+         MATCH(UPDATE_SP, "update_sp");
+         MATCH(SET_TITLE, "set_title");
+         MATCH(GRID_LINE, "grid_line");
+         break;
+      case 10:
+         MATCH(BUSY_START, "busy_start");
+         MATCH(GRID_CLEAR, "grid_clear");
+         break;
+      case 11:
+         MATCH(CURSOR_GOTO, "cursor_goto");
+         MATCH(MODE_CHANGE, "mode_change");
+         MATCH(CMDLINE_POS, "cmdline_pos");
+         MATCH(UPDATE_MENU, "update_menu");
+         MATCH(VISUAL_BELL, "visual_bell");
+         MATCH(GRID_RESIZE, "grid_resize");
+         MATCH(GRID_SCROLL, "grid_scroll");
+         break;
+      case 12:
+         MATCH(CMDLINE_SHOW, "cmdline_show");
+         MATCH(CMDLINE_HIDE, "cmdline_hide");
+         MATCH(HL_GROUP_SET, "hl_group_set");
+         break;
+      case 13:
+         MATCH(HIGHLIGHT_SET, "highlight_set");
+         MATCH(MODE_INFO_SET, "mode_info_set");
+         MATCH(WILDMENU_SHOW, "wildmenu_show");
+         MATCH(WILDMENU_HIDE, "wildmenu_hide");
+         break;
+      case 14:
+         MATCH(POPUPMENU_SHOW, "popupmenu_show");
+         MATCH(POPUPMENU_HIDE, "popupmenu_hide");
+         MATCH(TABLINE_UPDATE, "tabline_update");
+         MATCH(HL_ATTR_DEFINE, "hl_attr_define");
+         break;
+      case 15:
+         MATCH(WILDMENU_SELECT, "wildmenu_select");
+         break;
+      case 16:
+         MATCH(POPUPMENU_SELECT, "popupmenu_select");
+         MATCH(GRID_CURSOR_GOTO, "grid_cursor_goto");
+         break;
+      case 17:
+         MATCH(SET_SCROLL_REGION, "set_scroll_region");
+         break;
+      case 18:
+         MATCH(CMDLINE_BLOCK_SHOW, "cmdline_block_show");
+         MATCH(CMDLINE_BLOCK_HIDE, "cmdline_block_hide");
+         MATCH(DEFAULT_COLORS_SET, "default_colors_set");
+         break;
+      case 20:
+         MATCH(CMDLINE_SPECIAL_CHAR, "cmdline_special_char");
+         MATCH(CMDLINE_BLOCK_APPEND, "cmdline_block_append");
+         break;
+      default:
+         break;
      }
+#undef MATCH
 
-   return cb;
-hash_free:
-   eina_hash_free(cb);
-fail:
-   return NULL;
+   return __E_REDRAW_LAST;
 }
 
-static void
-_method_free(s_method *method)
+e_method
+nvim_event_method_get(const char *name,
+                      size_t len)
 {
-   /* This function is always used on statically-allocated containers.
-    * As such, free() should not be called on 'method' */
-   if (method->name) eina_stringshare_del(method->name);
-   if (method->callbacks) eina_hash_free(method->callbacks);
+   if ((len == 6) && (memcmp(name, "redraw", 6) == 0))
+     return E_METHOD_REDRAW;
+   else if ((len == 5) && (memcmp(name, "eovim", 5) == 0))
+     return E_METHOD_EOVIM;
+   else if ((len == 16) && (memcmp(name, "nvim_error_event", 16) == 0))
+     return E_METHOD_ERROR;
+   else
+     return __E_METHOD_LAST;
 }
 
-static Eina_Bool
-_method_redraw_init(e_method method_id)
+const char *
+nvim_event_redraw_command_name_get(e_redraw_command command)
 {
-   s_method *const method = &(_methods[method_id]);
-   const s_method_ctor ctors[] = {
-      CB_CTOR("resize", nvim_event_resize),
-      CB_CTOR("clear", nvim_event_clear),
-      CB_CTOR("eol_clear", nvim_event_eol_clear),
-      CB_CTOR("cursor_goto", nvim_event_cursor_goto),
-      CB_CTOR("mode_info_set", nvim_event_mode_info_set),
-      CB_CTOR("update_menu", nvim_event_update_menu),
-      CB_CTOR("busy_start", nvim_event_busy_start),
-      CB_CTOR("busy_stop", nvim_event_busy_stop),
-      CB_CTOR("mouse_on", nvim_event_mouse_on),
-      CB_CTOR("mouse_off", nvim_event_mouse_off),
-      CB_CTOR("mode_change", nvim_event_mode_change),
-      CB_CTOR("set_scroll_region", nvim_event_set_scroll_region),
-      CB_CTOR("scroll", nvim_event_scroll),
-      CB_CTOR("highlight_set", nvim_event_highlight_set),
-      CB_CTOR("put", nvim_event_put),
-      CB_CTOR("bell", nvim_event_bell),
-      CB_CTOR("visual_bell", nvim_event_visual_bell),
-      CB_CTOR("update_fg", nvim_event_update_fg),
-      CB_CTOR("update_bg", nvim_event_update_bg),
-      CB_CTOR("update_sp", nvim_event_update_sp),
-      CB_CTOR("suspend", nvim_event_suspend),
-      CB_CTOR("set_title", nvim_event_set_title),
-      CB_CTOR("set_icon", nvim_event_set_icon),
-      CB_CTOR("popupmenu_show", nvim_event_popupmenu_show),
-      CB_CTOR("popupmenu_hide", nvim_event_popupmenu_hide),
-      CB_CTOR("popupmenu_select", nvim_event_popupmenu_select),
-      CB_CTOR("tabline_update", nvim_event_tabline_update),
-      CB_CTOR("cmdline_show", nvim_event_cmdline_show),
-      CB_CTOR("cmdline_pos", nvim_event_cmdline_pos),
-      CB_CTOR("cmdline_special_char", nvim_event_cmdline_special_char),
-      CB_CTOR("cmdline_hide", nvim_event_cmdline_hide),
-      CB_CTOR("cmdline_block_show", nvim_event_cmdline_block_show),
-      CB_CTOR("cmdline_block_append", nvim_event_cmdline_block_append),
-      CB_CTOR("cmdline_block_hide", nvim_event_cmdline_block_hide),
-      CB_CTOR("wildmenu_show", nvim_event_wildmenu_show),
-      CB_CTOR("wildmenu_hide", nvim_event_wildmenu_hide),
-      CB_CTOR("wildmenu_select", nvim_event_wildmenu_select),
-   };
+   return (command < __E_REDRAW_LAST) ? _redraw_names[command].name : NULL;
+}
 
-   /* Register the name of the method as a stringshare */
-   const char name[] = "redraw";
-   method->name = eina_stringshare_add_length(name, sizeof(name) - 1);
-   if (EINA_UNLIKELY(! method->name))
+Eina_Bool
+nvim_event_redraw_dispatch(s_nvim *nvim,
+                           e_redraw_command command,
+                           const msgpack_object_array *args)
+{
+   const f_event_cb cb = _redraw_handlers[command];
+   if (EINA_UNLIKELY(! cb))
      {
-        CRI("Failed to create stringshare from string '%s'", name);
-        goto fail;
+        CRI("Failed to get callback for redraw command '%s'",
+            _redraw_names[command].name);
+        return EINA_FALSE;
      }
+   return cb(nvim, args);
+}
 
-   /* Build the callbacks table of the method */
-   method->callbacks =
-      _method_callbacs_table_build(ctors, EINA_C_ARRAY_LENGTH(ctors));
-   if (EINA_UNLIKELY(! method->callbacks))
+Eina_Bool
+nvim_event_plugin_dispatch(s_nvim *nvim,
+                           const msgpack_object_str *command,
+                           const msgpack_object_array *args)
+{
+   /* Plugin commands are registered at runtime, so they are stored in a
+    * table of stringshares. They are not sent often, so that's fine. */
+   Eina_Stringshare *const cmd =
+      eina_stringshare_add_length(command->ptr, command->size);
+   if (EINA_UNLIKELY(! cmd))
      {
-        CRI("Failed to create table of callbacks");
-        goto free_name;
+        CRI("Failed to create stringshare from command object");
+        return EINA_FALSE;
      }
 
-   return EINA_TRUE;
-free_name:
-   eina_stringshare_del(method->name);
-fail:
-   return EINA_FALSE;
+   Eina_Bool ret = EINA_FALSE;
+   const f_event_cb cb = eina_hash_find(_plugin_callbacks, cmd);
+   if (EINA_UNLIKELY(! cb))
+     CRI("Failed to get callback for plugin command '%s'", cmd);
+   else
+     ret = cb(nvim, args);
+
+   eina_stringshare_del(cmd);
+   return ret;
 }
 
-static Eina_Bool
-_method_eovim_init(e_method method_id)
+Eina_Bool
+nvim_event_plugin_register(const char *command,
+                           f_event_cb callback)
 {
-   s_method *const method = &(_methods[method_id]);
-
-   /* Register the name of the method as a stringshare */
-   const char name[] = "eovim";
-   method->name = eina_stringshare_add_length(name, sizeof(name) - 1);
-   if (EINA_UNLIKELY(! method->name))
+   /* Create the key to be inserted in the table */
+   Eina_Stringshare *const cmd = eina_stringshare_add(command);
+   if (EINA_UNLIKELY(! cmd))
      {
-        CRI("Failed to create stringshare from string '%s'", name);
+        CRI("Failed to create stringshare from '%s'", command);
         goto fail;
      }
 
-   /* Create an empty the callbacks table of the method */
-   method->callbacks = eina_hash_stringshared_new(NULL);
-   if (EINA_UNLIKELY(! method->callbacks))
+   /* Add the callback for the given command to the plugins table */
+   if (EINA_UNLIKELY(! eina_hash_add(_plugin_callbacks, cmd, callback)))
      {
-        CRI("Failed to create table of callbacks");
-        goto free_name;
+        CRI("Failed to register plugin event '%s'", command);
+        goto add_fail;
      }
 
    return EINA_TRUE;
-free_name:
-   eina_stringshare_del(method->name);
+add_fail:
+   eina_stringshare_del(cmd);
 fail:
    return EINA_FALSE;
 }
 
-Eina_Bool
-nvim_event_plugin_register(const char *command,
-                           f_event_cb callback)
-{
-   /* Add the callback for the given command to the eovim method */
-   Eina_Hash *const table = _methods[E_METHOD_EOVIM].callbacks;
-   const Eina_Bool ok =
-      _command_add(table, command, (unsigned int)strlen(command), callback);
-   if (EINA_UNLIKELY(! ok))
-     CRI("Failed to register plugin event '%s'", command);
-   return ok;
-}
-
 Eina_Bool
 nvim_event_init(void)
 {
    const char *const keywords[] = {
-      [KW_FOREGROUND] = "foreground",
-      [KW_BACKGROUND] = "background",
-      [KW_SPECIAL] = "special",
-      [KW_REVERSE] = "reverse",
-      [KW_ITALIC] = "italic",
-      [KW_BOLD] = "bold",
-      [KW_UNDERLINE] = "underline",
-      [KW_UNDERCURL] = "undercurl",
       [KW_CURSOR_SHAPE] = "cursor_shape",
       [KW_CELL_PERCENTAGE] = "cell_percentage",
       [KW_BLINKWAIT] = "blinkwait",
@@ -1379,25 +1245,31 @@ nvim_event_init(void)
           }
      }
 
-   /* Initialize the "redraw" method */
-   if (EINA_UNLIKELY(! _method_redraw_init(E_METHOD_REDRAW)))
+   /* Make sure the lookup of the redraw commands is in sync with their
+    * declaration. This is the price of not generating the lookup. */
+   for (unsigned int j = 0; j < EINA_C_ARRAY_LENGTH(_redraw_names); j++)
      {
-        CRI("Failed to setup the redraw method");
-        goto del_methods;
+        const e_redraw_command cmd = nvim_event_redraw_command_get(
+           _redraw_names[j].name, _redraw_names[j].size
+        );
+        if (EINA_UNLIKELY(cmd != j))
+          {
+             CRI("Redraw command '%s' cannot be looked up",
+                 _redraw_names[j].name);
+             goto fail;
+          }
      }
 
-   /* Initialize the "eovim" method */
-   if (EINA_UNLIKELY(! _method_eovim_init(E_METHOD_EOVIM)))
+   /* Create the table that will hold the callbacks of the plugins */
+   _plugin_callbacks = eina_hash_stringshared_new(NULL);
+   if (EINA_UNLIKELY(! _plugin_callbacks))
      {
-        CRI("Failed to setup the eovim method");
-        goto del_methods;
+        CRI("Failed to create table of callbacks");
+        goto fail;
      }
 
    return EINA_TRUE;
 
-del_methods:
-   for (unsigned int j = 0; j < EINA_C_ARRAY_LENGTH(_methods); j++)
-     _method_free(&(_methods[j]));
 fail:
    for (i--; i >= 0; i--)
      eina_stringshare_del(_keywords[i]);
@@ -1409,6 +1281,6 @@ nvim_event_shutdown(void)
 {
    for (unsigned int i = 0; i < __KW_LAST; i++)
      eina_stringshare_del(_keywords[i]);
-   for (unsigned int i = 0; i < EINA_C_ARRAY_LENGTH(_methods); i++)
-     _method_free(&(_methods[i]));
+   eina_hash_free(_plugin_callbacks);
+   _plugin_callbacks = NULL;
 }
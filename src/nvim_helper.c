@@ -26,12 +26,25 @@
 #include "eovim/log.h"
 #include <msgpack.h>
 
+/* Pasted data is sent in chunks of (roughly) this amount of bytes, so neovim
+ * can handle large pastes progressively. */
+#define PASTE_CHUNK_SIZE (32u * 1024u)
+
+/* Same for pastes that are emulated with nvim_input. The data is escaped in
+ * a buffer on the stack, so it must stay small. */
+#define PASTE_INPUT_CHUNK_SIZE 4096u
 
 static void
 _hl_group_color_get(s_nvim *nvim,
                     void *data,
-                    const msgpack_object *result)
+                    const msgpack_object *result,
+                    const char *error)
 {
+   if (EINA_UNLIKELY(error != NULL))
+     {
+        ERR("Failed to get the color of a highlight group: %s", error);
+        return;
+     }
    if (EINA_UNLIKELY(result->type != MSGPACK_OBJECT_STR))
      {
         ERR("A string is expected. Got type 0%x", result->type);
@@ -102,18 +115,32 @@ nvim_helper_highlight_group_decode(s_nvim *nvim,
 static void
 _version_decode(s_nvim *nvim,
                 void *data,
-                const msgpack_object *result)
+                const msgpack_object *result,
+                const char *error)
 {
+   /* If the version cannot be found out, it is left zeroed. The callback is
+    * called anyway, as it is what continues the startup. */
+   const f_version_decode func = (const f_version_decode)(data);
+   s_version version;
+   memset(&version, 0, sizeof(version));
+
    /* Make sure we got a string object from Neovim */
+   if (EINA_UNLIKELY(error != NULL))
+     {
+        ERR("Failed to get the version of Neovim: %s", error);
+        goto end;
+     }
    if (EINA_UNLIKELY(result->type != MSGPACK_OBJECT_STR))
      {
         ERR("A string is expected. Got type 0%x", result->type);
-        return;
+        goto end;
      }
    const msgpack_object_str *const str = &(result->via.str);
-
-   s_version version;
-   memset(&version, 0, sizeof(version));
+   if (EINA_UNLIKELY(str->size == 0))
+     {
+        ERR("Neovim did not tell its version");
+        goto end;
+     }
 
    /* Yes, this is evil, but I really don't want to crash later because the
     * string is not NUL-terminated */
@@ -123,6 +150,11 @@ _version_decode(s_nvim *nvim,
     * 'NVIM v' is, so I can attack X.Y.Z[-patch] */
    const char start[] = "NVIM v";
    const char *const ptr = strstr(str->ptr, start);
+   if (EINA_UNLIKELY(! ptr))
+     {
+        ERR("Failed to find the version of Neovim in '%s'", str->ptr);
+        goto end;
+     }
    const char *const v = ptr + sizeof(start) - 1;
 
    int bytes;
@@ -133,6 +165,7 @@ _version_decode(s_nvim *nvim,
      {
         ERR("Failed to successfully parse version. Results may be unexpected.");
         /* We went full retard, but we can keep going */
+        memset(&version, 0, sizeof(version));
      }
    else
      {
@@ -142,8 +175,8 @@ _version_decode(s_nvim *nvim,
           sscanf(&v[bytes + 1], "%32s", version.extra);
      }
 
-   /* Send the hl group to the callback function */
-   const f_version_decode func = (const f_version_decode)(data);
+end:
+   /* Send the version to the callback function */
    func(nvim, &version);
 }
 
@@ -157,3 +190,245 @@ nvim_helper_version_decode(s_nvim *nvim,
    nvim_api_command_output(nvim, vim_cmd, sizeof(vim_cmd) - 1,
                            _version_decode, func);
 }
+
+static size_t
+_paste_chunk_end(const char *data,
+                 size_t start,
+                 size_t size)
+{
+   const size_t end = start + PASTE_CHUNK_SIZE;
+   if (end >= size) { return size; }
+
+   /* Never cut a multi-bytes UTF-8 sequence in two: go back to its first
+    * byte. Continuation bytes are of the form 10xxxxxx. If the data is not
+    * UTF-8 at all, cut it anywhere. */
+   size_t cut = end;
+   while ((cut > start) && (((unsigned char)data[cut] & 0xc0) == 0x80))
+     cut--;
+   return (cut > start) ? cut : end;
+}
+
+/*
+ * A paste is sent one chunk at a time: the next chunk is only sent when
+ * neovim has answered the previous one. So neither our buffers nor the pipe
+ * ever hold more than one chunk, and the user interface keeps running while
+ * a large paste goes through. As the selection data only lives during the
+ * selection callback, the paste keeps its own copy of what is to be sent.
+ * What is pasted while a paste is in progress is queued, and sent after it
+ * as a paste of its own.
+ */
+struct paste
+{
+   EINA_INLIST;
+   char *data; /**< What is pasted */
+   size_t size; /**< Amount of bytes in @p data */
+   size_t start; /**< First byte of the next chunk to be sent */
+   Eina_Bool stream; /**< Sent with nvim_paste(), rather than typed */
+   Eina_Bool streaming; /**< A phase 1 chunk was sent, but no phase 3 one */
+};
+
+static void _paste_chunk_sent(s_nvim *nvim, void *data, const msgpack_object *result,
+                              const char *error);
+
+static Eina_Bool _paste_next(s_nvim *nvim);
+
+static inline s_paste *
+_paste_current(const s_nvim *nvim)
+{
+   /* The paste being sent is the first one of the queue */
+   return (nvim->pastes)
+      ? EINA_INLIST_CONTAINER_GET(nvim->pastes, s_paste)
+      : NULL;
+}
+
+static void
+_paste_del(s_nvim *nvim)
+{
+   s_paste *const paste = _paste_current(nvim);
+   nvim->pastes = eina_inlist_remove(nvim->pastes, EINA_INLIST_GET(paste));
+   free(paste->data);
+   free(paste);
+}
+
+static void
+_paste_done(s_nvim *nvim)
+{
+   /* The current paste is over, for better or worse. The next one, if any,
+    * starts its own stream. */
+   _paste_del(nvim);
+   if (nvim->pastes) { _paste_next(nvim); }
+}
+
+static Eina_Bool
+_paste_stream_next(s_nvim *nvim)
+{
+   s_paste *const paste = _paste_current(nvim);
+   const size_t start = paste->start;
+   const size_t end = _paste_chunk_end(paste->data, start, paste->size);
+
+   /*
+    * A paste that fits in one chunk is sent in one go (phase -1). Otherwise,
+    * it is streamed: the first chunk is sent with phase 1, the last one with
+    * phase 3, and all the others with phase 2. Each paste is a stream of its
+    * own, even when it was queued behind another one.
+    */
+   const Eina_Bool last = (end == paste->size);
+   const int phase = (paste->streaming) ? (last ? 3 : 2) : (last ? -1 : 1);
+   paste->streaming = ! last;
+   paste->start = end;
+   return nvim_api_paste(nvim, &(paste->data[start]), end - start, phase,
+                         _paste_chunk_sent, NULL);
+}
+
+static size_t
+_paste_input_end(const s_paste *paste,
+                 size_t typed)
+{
+   /* Where the data ends once @p typed bytes of it were typed. As '<' is
+    * typed "<lt>", this is not (start + typed). */
+   size_t len = 0;
+   size_t i = paste->start;
+   for (; (i < paste->size) && (len < PASTE_INPUT_CHUNK_SIZE); i++)
+     {
+        const size_t char_len = (paste->data[i] == '<') ? 4 : 1;
+        if (len + char_len > typed) { break; }
+        len += char_len;
+     }
+   return i;
+}
+
+static Eina_Bool
+_paste_input_next(s_nvim *nvim)
+{
+   s_paste *const paste = _paste_current(nvim);
+
+   /* Room for one more escaped character once the chunk is full */
+   char buf[PASTE_INPUT_CHUNK_SIZE + 4];
+   unsigned int len = 0;
+
+   /*
+    * Before nvim_paste(), the only way to paste was to type the data.
+    * If we type '<' we must escape it as "<lt>", otherwise it would be
+    * understood as the beginning of a special key. The start of the paste
+    * is only moved once neovim told how much of the chunk it has taken.
+    */
+   for (size_t i = paste->start;
+        (i < paste->size) && (len < PASTE_INPUT_CHUNK_SIZE); i++)
+     {
+        if (paste->data[i] == '<')
+          {
+             memcpy(&(buf[len]), "<lt>", 4);
+             len += 4;
+          }
+        else
+          buf[len++] = paste->data[i];
+     }
+   return nvim_api_input_request(nvim, buf, len, _paste_chunk_sent, NULL);
+}
+
+static Eina_Bool
+_paste_next(s_nvim *nvim)
+{
+   s_paste *const paste = _paste_current(nvim);
+   const Eina_Bool ok = (paste->stream)
+      ? _paste_stream_next(nvim)
+      : _paste_input_next(nvim);
+
+   /*
+    * If the request could not be sent, its callback may already have
+    * dropped the paste. Otherwise it is still the current one: queued pastes
+    * were allocated before it was released, so they can't share its address.
+    */
+   if (EINA_UNLIKELY((! ok) && (_paste_current(nvim) == paste)))
+     {
+        ERR("Failed to send a chunk of the paste. Dropping the rest of it.");
+        _paste_done(nvim);
+     }
+   return ok;
+}
+
+static void
+_paste_chunk_sent(s_nvim *nvim,
+                  void *data EINA_UNUSED,
+                  const msgpack_object *result,
+                  const char *error)
+{
+   s_paste *const paste = _paste_current(nvim);
+   if (EINA_UNLIKELY(! paste)) { return; }
+
+   if (EINA_UNLIKELY(error != NULL))
+     {
+        ERR("Failed to send a chunk of the paste (%s). "
+            "Dropping the rest of it.", error);
+        _paste_done(nvim);
+        return;
+     }
+
+   /* nvim_paste() returns false when the user cancelled the paste. No more
+    * data shall be sent then. */
+   if (paste->stream && (result->type == MSGPACK_OBJECT_BOOLEAN) &&
+       (! result->via.boolean))
+     {
+        INF("The paste was cancelled");
+        _paste_done(nvim);
+        return;
+     }
+
+   /* nvim_input() returns how many bytes it has taken, which may be less
+    * than what it was given. The rest is typed again. */
+   if (! paste->stream)
+     {
+        const size_t typed = (result->type == MSGPACK_OBJECT_POSITIVE_INTEGER)
+           ? (size_t)result->via.u64
+           : SIZE_MAX;
+        paste->start = _paste_input_end(paste, typed);
+     }
+
+   if (paste->start < paste->size)
+     _paste_next(nvim);
+   else
+     _paste_done(nvim);
+}
+
+Eina_Bool
+nvim_helper_paste(s_nvim *nvim,
+                  const char *data,
+                  size_t size)
+{
+   if (size == 0) { return EINA_TRUE; }
+
+   s_paste *const paste = calloc(1, sizeof(s_paste));
+   char *const copy = malloc(size);
+   if (EINA_UNLIKELY((! paste) || (! copy)))
+     {
+        CRI("Failed to allocate memory for %zu bytes of paste", size);
+        free(paste);
+        free(copy);
+        return EINA_FALSE;
+     }
+   memcpy(copy, data, size);
+   paste->data = copy;
+   paste->size = size;
+   paste->start = 0;
+   paste->streaming = EINA_FALSE;
+
+   /* nvim_paste() appeared in neovim 0.4.0 */
+   paste->stream = NVIM_VERSION_GE(nvim, 0, 4, 0);
+
+   /* If a paste is in progress, this one waits for it to be over */
+   const Eina_Bool idle = (nvim->pastes == NULL);
+   nvim->pastes = eina_inlist_append(nvim->pastes, EINA_INLIST_GET(paste));
+   return (idle) ? _paste_next(nvim) : EINA_TRUE;
+}
+
+void
+nvim_helper_paste_abort(s_nvim *nvim)
+{
+   while (nvim->pastes)
+     {
+        const s_paste *const paste = _paste_current(nvim);
+        WRN("Dropping %zu bytes of paste that were never sent",
+            paste->size - paste->start);
+        _paste_del(nvim);
+     }
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/types.h"
+#include "eovim/nvim_reader.h"
+#include "eovim/nvim.h"
+#include "eovim/redraw.h"
+#include "eovim/nvim_event.h"
+#include "eovim/trace.h"
+#include "eovim/log.h"
+
+#include <Ecore.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+/*
+ * Everything neovim sends us is read and unpacked in a dedicated thread.
+ * Redraw notifications are also decoded in that thread, so the main loop is
+ * only left with applying the redraw commands.
+ *
+ * Messages are passed to the main loop through a single-producer
+ * single-consumer ring of pointers, which requires no lock. The main loop is
+ * woken up by an Ecore_Pipe. When the ring is full (the GUI falls behind),
+ * the reader thread waits until there is room again. It stops reading
+ * neovim's output in the meantime, which will eventually block neovim.
+ */
+
+/* Amount of bytes we are ready to receive from neovim in one read() */
+#define READER_CHUNK_SIZE (64u * 1024u)
+
+/* Maximum amount of messages in flight. Must be a power of two. */
+#define READER_RING_SIZE 256u
+
+/* Maximum amount of messages the main loop handles before giving the hand
+ * back to the other events (e.g. user input) */
+#define READER_BUDGET 32u
+
+struct nvim_reader
+{
+   s_nvim *nvim;
+   f_nvim_msg_cb func; /**< Called in the main loop for each message */
+   s_rpc_recorder *recorder; /**< Records what is read. May be NULL */
+   Eina_Thread thread;
+   Ecore_Pipe *wakeup; /**< Wakes up the main loop */
+   Eina_Semaphore space; /**< Signaled when the ring is not full anymore */
+   msgpack_unpacker unpacker; /**< Only used by the reader thread */
+   int fd; /**< Read end of neovim's stdout */
+   int stop_fds[2]; /**< Self-pipe used to interrupt the reader thread */
+
+   atomic_size_t head; /**< Next slot to be written. Set by the thread */
+   atomic_size_t tail; /**< Next slot to be read. Set by the main loop */
+   atomic_bool producer_waiting; /**< The thread waits for @p space */
+   atomic_bool notified; /**< A wake up is pending in the main loop */
+   atomic_bool stop; /**< The thread must terminate */
+   s_nvim_msg *ring[READER_RING_SIZE];
+};
+
+static void
+_msg_free(s_nvim_msg *msg)
+{
+   redraw_batch_free(msg->redraw);
+   msgpack_zone_free(msg->zone);
+   free(msg);
+}
+
+static Eina_Bool
+_is_redraw(const msgpack_object *method)
+{
+   return (((method->type == MSGPACK_OBJECT_STR) ||
+            (method->type == MSGPACK_OBJECT_BIN)) &&
+           (nvim_event_method_get(method->via.str.ptr, method->via.str.size)
+            == E_METHOD_REDRAW));
+}
+
+static s_nvim_msg *
+_msg_new(msgpack_unpacked *result)
+{
+   const msgpack_object *const obj = &(result->data);
+
+#if 0 /* Uncomment to roughly dump the received messages */
+   msgpack_object_print(stderr, *obj);
+   fprintf(stderr, "\n--------\n");
+#endif
+
+   if (EINA_UNLIKELY(obj->type != MSGPACK_OBJECT_ARRAY))
+     {
+        ERR("Unexpected msgpack type 0x%x", obj->type);
+        return NULL;
+     }
+
+   const msgpack_object_array *const args = &(obj->via.array);
+   const unsigned int response_args_count = 4;
+   const unsigned int notif_args_count = 3;
+   if ((args->size != response_args_count) &&
+       (args->size != notif_args_count))
+     {
+        ERR("Unexpected count of arguments: %u.", args->size);
+        return NULL;
+     }
+   if (EINA_UNLIKELY(args->ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER))
+     {
+        ERR("First argument in response is expected to be an integer");
+        return NULL;
+     }
+
+   s_nvim_msg *const msg = malloc(sizeof(s_nvim_msg));
+   if (EINA_UNLIKELY(! msg))
+     {
+        CRI("Failed to allocate memory for a message");
+        return NULL;
+     }
+   msg->args = *args;
+   msg->redraw = NULL;
+
+   /* Redraw notifications are decoded right now, outside of the main loop */
+   if ((args->ptr[0].via.u64 == 2) && (args->size == notif_args_count) &&
+       _is_redraw(&(args->ptr[1])))
+     {
+        if (EINA_UNLIKELY(args->ptr[2].type != MSGPACK_OBJECT_ARRAY))
+          {
+             ERR("Third argument in notification is expected to be an array");
+             free(msg);
+             return NULL;
+          }
+        msg->redraw = redraw_batch_decode(&(args->ptr[2].via.array));
+        if (EINA_UNLIKELY(! msg->redraw))
+          {
+             free(msg);
+             return NULL;
+          }
+     }
+
+   /* The message now owns the memory of the unpacked objects */
+   msg->zone = msgpack_unpacked_release_zone(result);
+   return msg;
+}
+
+/*============================================================================*
+ *                       Single Producer Single Consumer                      *
+ *============================================================================*/
+
+static Eina_Bool
+_ring_push(s_nvim_reader *reader,
+           s_nvim_msg *msg)
+{
+   const size_t head = atomic_load_explicit(&reader->head, memory_order_relaxed);
+
+   while (head - atomic_load(&reader->tail) >= READER_RING_SIZE)
+     {
+        /* The ring is full. Tell the main loop we are waiting for it, but
+         * check again afterwards: it may have popped a message in the
+         * meantime, without seeing we were waiting. Spurious wake ups are
+         * harmless, as we loop anyway. */
+        atomic_store(&reader->producer_waiting, true);
+        if (head - atomic_load(&reader->tail) < READER_RING_SIZE)
+          break;
+        eina_semaphore_lock(&reader->space);
+        if (atomic_load(&reader->stop))
+          return EINA_FALSE;
+     }
+
+   reader->ring[head & (READER_RING_SIZE - 1)] = msg;
+   atomic_store_explicit(&reader->head, head + 1, memory_order_release);
+
+   /* Wake up the main loop, unless it already knows there is work to do */
+   if (! atomic_exchange(&reader->notified, true))
+     {
+        const char wake = 0;
+        ecore_pipe_write(reader->wakeup, &wake, sizeof(wake));
+     }
+   return EINA_TRUE;
+}
+
+static s_nvim_msg *
+_ring_pop(s_nvim_reader *reader)
+{
+   const size_t tail = atomic_load_explicit(&reader->tail, memory_order_relaxed);
+   if (tail == atomic_load_explicit(&reader->head, memory_order_acquire))
+     return NULL;
+
+   s_nvim_msg *const msg = reader->ring[tail & (READER_RING_SIZE - 1)];
+   atomic_store(&reader->tail, tail + 1);
+
+   if (atomic_exchange(&reader->producer_waiting, false))
+     eina_semaphore_release(&reader->space, 1);
+   return msg;
+}
+
+/*============================================================================*
+ *                                Reader Thread                               *
+ *============================================================================*/
+
+static Eina_Bool
+_reader_unpack(s_nvim_reader *reader)
+{
+   msgpack_unpacker *const unpacker = &reader->unpacker;
+   Eina_Bool ok = EINA_TRUE;
+   msgpack_unpacked result;
+
+   msgpack_unpacked_init(&result);
+   for (;;)
+     {
+        const msgpack_unpack_return ret = msgpack_unpacker_next(unpacker, &result);
+        if (ret == MSGPACK_UNPACK_CONTINUE) { break; }
+        else if (ret != MSGPACK_UNPACK_SUCCESS)
+          {
+             ERR("Error while unpacking data from neovim (0x%x)", ret);
+             break;
+          }
+
+        TRACE_BEGIN("decode");
+        s_nvim_msg *const msg = _msg_new(&result);
+        TRACE_END("decode");
+        if (EINA_UNLIKELY(! msg)) { continue; }
+        atomic_fetch_add(&reader->nvim->stats.messages, 1u);
+
+        if (EINA_UNLIKELY(! _ring_push(reader, msg)))
+          {
+             /* We have been asked to stop */
+             _msg_free(msg);
+             ok = EINA_FALSE;
+             break;
+          }
+     }
+   msgpack_unpacked_destroy(&result);
+   return ok;
+}
+
+static void *
+_reader_thread(void *data,
+               Eina_Thread thread EINA_UNUSED)
+{
+   s_nvim_reader *const reader = data;
+   msgpack_unpacker *const unpacker = &reader->unpacker;
+   struct pollfd fds[2] = {
+      { .fd = reader->fd, .events = POLLIN, .revents = 0 },
+      { .fd = reader->stop_fds[0], .events = POLLIN, .revents = 0 },
+   };
+
+   trace_thread_name_set("reader");
+
+   while (! atomic_load(&reader->stop))
+     {
+        /*
+         * We read neovim's stdout directly into the unpacking buffer, so the
+         * received bytes are never copied around before being deserialized.
+         *
+         * msgpack_unpacker_reserve_buffer() only does something when the free
+         * space is too small. It then first tries to rewind the buffer if
+         * everything has been parsed, then moves the unparsed bytes at the
+         * beginning of a (possibly doubled) buffer. So we don't have to care
+         * about geometric growth and compaction ourselves.
+         */
+        if (msgpack_unpacker_buffer_capacity(unpacker) < READER_CHUNK_SIZE)
+          {
+             if (EINA_UNLIKELY(! msgpack_unpacker_reserve_buffer(
+                      unpacker, READER_CHUNK_SIZE)))
+               {
+                  CRI("Memory reallocation of %u bytes failed",
+                      READER_CHUNK_SIZE);
+                  break;
+               }
+          }
+
+        if (poll(fds, EINA_C_ARRAY_LENGTH(fds), -1) < 0)
+          {
+             if (errno == EINTR) { continue; }
+             ERR("Failed to wait for neovim's output: %s", strerror(errno));
+             break;
+          }
+        if (fds[1].revents) { break; } /* We have been asked to stop */
+
+        TRACE_BEGIN("read");
+        const ssize_t bytes = read(reader->fd,
+                                   msgpack_unpacker_buffer(unpacker),
+                                   msgpack_unpacker_buffer_capacity(unpacker));
+        TRACE_END("read");
+        if (bytes < 0)
+          {
+             if ((errno == EAGAIN) || (errno == EINTR)) { continue; }
+             ERR("Failed to read data from neovim: %s", strerror(errno));
+             break;
+          }
+        else if (bytes == 0)
+          {
+             /* End of file: neovim closed its stdout. The process termination
+              * will be handled by the ECORE_EXE_EVENT_DEL handler. */
+             DBG("Neovim closed its output stream");
+             break;
+          }
+
+        if (reader->recorder)
+          rpc_recorder_write(reader->recorder, RPC_DIR_RECEIVED,
+                             msgpack_unpacker_buffer(unpacker), (size_t)bytes);
+        atomic_fetch_add(&reader->nvim->stats.bytes_in, (unsigned long)bytes);
+        msgpack_unpacker_buffer_consumed(unpacker, (size_t)bytes);
+        if (! _reader_unpack(reader)) { break; }
+     }
+
+   return NULL;
+}
+
+/*============================================================================*
+ *                                  Main Loop                                 *
+ *============================================================================*/
+
+static void
+_reader_wakeup_cb(void *data,
+                  void *buffer EINA_UNUSED,
+                  unsigned int nbyte EINA_UNUSED)
+{
+   s_nvim_reader *const reader = data;
+
+   /* From now on, new messages need a new wake up */
+   atomic_store(&reader->notified, false);
+
+   for (unsigned int i = 0; i < READER_BUDGET; i++)
+     {
+        s_nvim_msg *const msg = _ring_pop(reader);
+        if (! msg) { return; }
+
+        TRACE_BEGIN("message");
+        reader->func(reader->nvim, msg);
+        _msg_free(msg);
+        TRACE_END("message");
+     }
+
+   /* We have consumed our budget, but messages may be pending. Let the main
+    * loop handle other events first, then come back to them. */
+   if (! atomic_exchange(&reader->notified, true))
+     {
+        const char wake = 0;
+        ecore_pipe_write(reader->wakeup, &wake, sizeof(wake));
+     }
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+s_nvim_reader *
+nvim_reader_new(s_nvim *nvim,
+                int fd,
+                s_rpc_recorder *recorder,
+                f_nvim_msg_cb func)
+{
+   /* The reader owns the file descriptor. It is closed on failure */
+   s_nvim_reader *const reader = calloc(1, sizeof(s_nvim_reader));
+   if (EINA_UNLIKELY(! reader))
+     {
+        CRI("Failed to allocate memory for the reader");
+        goto fail;
+     }
+   reader->nvim = nvim;
+   reader->func = func;
+   reader->recorder = recorder;
+   reader->fd = fd;
+   atomic_init(&reader->head, 0);
+   atomic_init(&reader->tail, 0);
+   atomic_init(&reader->producer_waiting, false);
+   atomic_init(&reader->notified, false);
+   atomic_init(&reader->stop, false);
+
+   if (EINA_UNLIKELY(pipe(reader->stop_fds) != 0))
+     {
+        CRI("Failed to create pipe: %s", strerror(errno));
+        goto free_reader;
+     }
+   fcntl(reader->stop_fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(reader->stop_fds[1], F_SETFD, FD_CLOEXEC);
+
+   if (EINA_UNLIKELY(! msgpack_unpacker_init(&reader->unpacker,
+                                             READER_CHUNK_SIZE)))
+     {
+        CRI("Failed to initialize the msgpack unpacker");
+        goto close_pipe;
+     }
+
+   if (EINA_UNLIKELY(! eina_semaphore_new(&reader->space, 0)))
+     {
+        CRI("Failed to create semaphore");
+        goto del_unpacker;
+     }
+
+   reader->wakeup = ecore_pipe_add(_reader_wakeup_cb, reader);
+   if (EINA_UNLIKELY(! reader->wakeup))
+     {
+        CRI("Failed to create Ecore_Pipe");
+        goto del_sem;
+     }
+
+   if (EINA_UNLIKELY(! eina_thread_create(&reader->thread, EINA_THREAD_NORMAL,
+                                          -1, _reader_thread, reader)))
+     {
+        CRI("Failed to create the reader thread");
+        goto del_pipe;
+     }
+
+   return reader;
+
+del_pipe:
+   ecore_pipe_del(reader->wakeup);
+del_sem:
+   eina_semaphore_free(&reader->space);
+del_unpacker:
+   msgpack_unpacker_destroy(&reader->unpacker);
+close_pipe:
+   close(reader->stop_fds[0]);
+   close(reader->stop_fds[1]);
+free_reader:
+   free(reader);
+fail:
+   close(fd);
+   return NULL;
+}
+
+void
+nvim_reader_free(s_nvim_reader *reader)
+{
+   if (! reader) { return; }
+
+   /* Interrupt the reader thread, whether it is waiting for neovim or for
+    * the main loop, and wait for it to terminate */
+   atomic_store(&reader->stop, true);
+   const char stop = 0;
+   if (EINA_UNLIKELY(write(reader->stop_fds[1], &stop, sizeof(stop)) < 0))
+     ERR("Failed to interrupt the reader thread: %s", strerror(errno));
+   eina_semaphore_release(&reader->space, 1);
+   eina_thread_join(reader->thread);
+
+   /* Drop the messages that were never handled */
+   s_nvim_msg *msg;
+   while ((msg = _ring_pop(reader)))
+     _msg_free(msg);
+
+   ecore_pipe_del(reader->wakeup);
+   eina_semaphore_free(&reader->space);
+   msgpack_unpacker_destroy(&reader->unpacker);
+   close(reader->stop_fds[0]);
+   close(reader->stop_fds[1]);
+   close(reader->fd);
+   free(reader);
+}
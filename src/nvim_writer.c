@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/nvim_writer.h"
+#include "eovim/log.h"
+
+#include <Ecore.h>
+#include <msgpack.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ * Messages are written to neovim's stdin without blocking. Most of the time
+ * the pipe takes everything at once and nothing is copied. When it is full
+ * (neovim is busy), what could not be written is kept aside, and written
+ * when the pipe becomes writable again. Messages sent in the meantime are
+ * queued after it, so the order of the messages is preserved.
+ */
+
+struct nvim_writer
+{
+   int fd; /**< Write end of neovim's stdin */
+   Ecore_Fd_Handler *handler; /**< Watches @p fd while data is pending */
+   msgpack_sbuffer pending; /**< What the pipe did not take yet */
+   size_t offset; /**< Bytes of @p pending already written */
+};
+
+static ssize_t
+_write(int fd,
+       const char *data,
+       size_t size)
+{
+   size_t written = 0;
+   while (written < size)
+     {
+        const ssize_t bytes = write(fd, data + written, size - written);
+        if (bytes < 0)
+          {
+             if (errno == EINTR) { continue; }
+             if (errno == EAGAIN) { break; }
+             ERR("Failed to write to neovim: %s", strerror(errno));
+             return -1;
+          }
+        written += (size_t)bytes;
+     }
+   return (ssize_t)written;
+}
+
+static void
+_pending_drop(s_nvim_writer *writer)
+{
+   msgpack_sbuffer_clear(&writer->pending);
+   writer->offset = 0;
+   if (writer->handler)
+     {
+        ecore_main_fd_handler_del(writer->handler);
+        writer->handler = NULL;
+     }
+}
+
+static Eina_Bool
+_writable_cb(void *data,
+             Ecore_Fd_Handler *handler EINA_UNUSED)
+{
+   s_nvim_writer *const writer = data;
+   const ssize_t bytes = _write(writer->fd,
+                                writer->pending.data + writer->offset,
+                                writer->pending.size - writer->offset);
+   if (EINA_UNLIKELY(bytes < 0))
+     {
+        ERR("Dropping %zu bytes that were never sent",
+            writer->pending.size - writer->offset);
+        goto drop;
+     }
+
+   writer->offset += (size_t)bytes;
+   if (writer->offset < writer->pending.size)
+     return ECORE_CALLBACK_RENEW;
+
+drop:
+   /* Returning ECORE_CALLBACK_CANCEL deletes the handler */
+   writer->handler = NULL;
+   _pending_drop(writer);
+   return ECORE_CALLBACK_CANCEL;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+s_nvim_writer *
+nvim_writer_new(int fd)
+{
+   /* The writer owns the file descriptor. It is closed on failure */
+   s_nvim_writer *const writer = calloc(1, sizeof(s_nvim_writer));
+   if (EINA_UNLIKELY(! writer))
+     {
+        CRI("Failed to allocate memory for the writer");
+        goto fail;
+     }
+   writer->fd = fd;
+   msgpack_sbuffer_init(&writer->pending);
+
+   const int flags = fcntl(fd, F_GETFL);
+   if (EINA_UNLIKELY((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)))
+     {
+        CRI("Failed to make neovim's input non-blocking: %s", strerror(errno));
+        goto free_writer;
+     }
+
+   return writer;
+
+free_writer:
+   msgpack_sbuffer_destroy(&writer->pending);
+   free(writer);
+fail:
+   close(fd);
+   return NULL;
+}
+
+void
+nvim_writer_free(s_nvim_writer *writer)
+{
+   if (! writer) { return; }
+
+   if (writer->pending.size > writer->offset)
+     WRN("%zu bytes were never sent to neovim",
+         writer->pending.size - writer->offset);
+   _pending_drop(writer);
+   msgpack_sbuffer_destroy(&writer->pending);
+
+   /* Closing neovim's stdin makes it terminate */
+   close(writer->fd);
+   free(writer);
+}
+
+Eina_Bool
+nvim_writer_write(s_nvim_writer *writer,
+                  const void *data,
+                  size_t size)
+{
+   const char *bytes = data;
+
+   /* If data is already waiting, ours must wait behind it */
+   if (! writer->handler)
+     {
+        const ssize_t written = _write(writer->fd, bytes, size);
+        if (EINA_UNLIKELY(written < 0)) { return EINA_FALSE; }
+        if ((size_t)written == size) { return EINA_TRUE; }
+        bytes += written;
+        size -= (size_t)written;
+
+        writer->handler = ecore_main_fd_handler_add(writer->fd, ECORE_FD_WRITE,
+                                                    _writable_cb, writer,
+                                                    NULL, NULL);
+        if (EINA_UNLIKELY(! writer->handler))
+          {
+             CRI("Failed to watch neovim's input");
+             return EINA_FALSE;
+          }
+     }
+
+   if (EINA_UNLIKELY(msgpack_sbuffer_write(&writer->pending, bytes, size) != 0))
+     {
+        CRI("Failed to keep %zu bytes for neovim", size);
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
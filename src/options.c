@@ -24,6 +24,7 @@
 #include "eovim/version.h"
 #include "eovim/log.h"
 #include <getopt.h>
+#include <stdlib.h>
 
 
 static void
@@ -45,6 +46,23 @@ _show_help(void)
       "  --config <path>         Provide an alternate GUI configuration\n"
       "  -F, --fullscreen        Run Eovim in fullscreen\n"
       "  -t, --theme <path>      Provide an alternate theme to Eovim\n"
+      "\n"
+      "  --record-rpc <file>     Record the session with Neovim in <file>\n"
+      "  --replay-rpc <file>     Replay the session recorded in <file>\n"
+      "                          instead of running Neovim\n"
+      "  --replay-fast           Replay as fast as possible, instead of at\n"
+      "                          the pace of the recording\n"
+      "  --latency-log <file>    Log the keypress-to-paint latency of each\n"
+      "                          key in <file>\n"
+      "  --latency-overlay       Display the keypress-to-paint latency\n"
+      "  --trace <file>          Trace what Eovim spends its time on, and\n"
+      "                          write it in <file> when exiting or on\n"
+      "                          SIGUSR1 (Chrome trace format)\n"
+      "  --request-timeout <s>   Give up on requests Neovim did not answer\n"
+      "                          after <s> seconds\n"
+      "  --rpc-errors            Send the calls whose result is ignored as\n"
+      "                          requests, so their errors are reported\n"
+      "\n"
       "  -h, --help              Display this message\n"
       "  -V, --version           Show Eovim's version\n"
       "\n"
@@ -82,6 +100,14 @@ typedef enum
    OPT_FORBIDDEN        = 0,
    OPT_CONFIG           = 1,
    OPT_NVIM             = 3,
+   OPT_RECORD_RPC       = 4,
+   OPT_REPLAY_RPC       = 5,
+   OPT_REPLAY_FAST      = 6,
+   OPT_LATENCY_LOG      = 7,
+   OPT_LATENCY_OVERLAY  = 8,
+   OPT_TRACE            = 9,
+   OPT_REQUEST_TIMEOUT  = 10,
+   OPT_RPC_ERRORS       = 11,
 
    OPT_NO_PLUGIN        = 'N',
    OPT_GEOMETRY         = 'g',
@@ -110,6 +136,14 @@ static const s_arg _args[] =
    ARG("theme",         OPT_THEME),
    ARG("help",          OPT_HELP),
    ARG("version",       OPT_VERSION),
+   ARG("record-rpc",    OPT_RECORD_RPC),
+   ARG("replay-rpc",    OPT_REPLAY_RPC),
+   ARG("replay-fast",   OPT_REPLAY_FAST),
+   ARG("latency-log",   OPT_LATENCY_LOG),
+   ARG("latency-overlay", OPT_LATENCY_OVERLAY),
+   ARG("trace",         OPT_TRACE),
+   ARG("request-timeout", OPT_REQUEST_TIMEOUT),
+   ARG("rpc-errors",    OPT_RPC_ERRORS),
    ARG("embed",         OPT_FORBIDDEN),
    ARG("headless",      OPT_FORBIDDEN),
    ARG("api-info",      OPT_FORBIDDEN),
@@ -157,6 +191,20 @@ _parse_geometry(s_geometry *geo,
    return EINA_TRUE;
 }
 
+static Eina_Bool
+_parse_timeout(double *timeout,
+               const char *str)
+{
+   char *end;
+   *timeout = strtod(str, &end);
+   if ((end == str) || (*end != '\0') || (! (*timeout > 0.0)))
+     {
+        ERR("Failed to parse timeout. A positive number of seconds is expected");
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
 e_options_result
 options_parse(int argc,
               const char *argv[],
@@ -211,6 +259,54 @@ options_parse(int argc,
                      return OPTIONS_RESULT_QUIT;
                    break;
 
+                   /* Files, consume the next argument */
+                case OPT_RECORD_RPC:
+                case OPT_REPLAY_RPC:
+                case OPT_LATENCY_LOG:
+                case OPT_TRACE:
+                   if (i + 1 >= argc)
+                     {
+                        fprintf(stderr,
+                                "eovim: Option \"%s\" expects a file\n", it);
+                        return OPTIONS_RESULT_ERROR;
+                     }
+                   if (opt == OPT_RECORD_RPC)
+                     opts->record_rpc = argv[++i];
+                   else if (opt == OPT_REPLAY_RPC)
+                     opts->replay_rpc = argv[++i];
+                   else if (opt == OPT_LATENCY_LOG)
+                     opts->latency_log = argv[++i];
+                   else
+                     opts->trace = argv[++i];
+                   break;
+
+                   /* Timeout, consume the next argument */
+                case OPT_REQUEST_TIMEOUT:
+                   if (i + 1 >= argc)
+                     {
+                        fprintf(stderr,
+                                "eovim: Option \"%s\" expects a number\n", it);
+                        return OPTIONS_RESULT_ERROR;
+                     }
+                   if (! _parse_timeout(&opts->request_timeout, argv[++i]))
+                     return OPTIONS_RESULT_ERROR;
+                   break;
+
+                   /* Latency overlay, store true */
+                case OPT_LATENCY_OVERLAY:
+                   opts->latency_overlay = EINA_TRUE;
+                   break;
+
+                   /* Report errors of ignored calls, store true */
+                case OPT_RPC_ERRORS:
+                   opts->rpc_errors = EINA_TRUE;
+                   break;
+
+                   /* Replay as fast as possible, store true */
+                case OPT_REPLAY_FAST:
+                   opts->replay_fast = EINA_TRUE;
+                   break;
+
                    /* No plugin, store true */
                 case OPT_NO_PLUGIN:
                    opts->no_plugins = EINA_TRUE;
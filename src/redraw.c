@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/types.h"
+#include "eovim/redraw.h"
+#include "eovim/nvim.h"
+#include "eovim/nvim_event.h"
+#include "eovim/msgpack_helper.h"
+#include "eovim/gui.h"
+#include "eovim/utf8.h"
+#include "eovim/trace.h"
+#include "eovim/log.h"
+
+/*
+ * Redraw batches are DECODED in the reader thread, and APPLIED in the main
+ * loop. The decoding part must therefore never touch anything that is not
+ * thread-safe: no stringshares, no GUI, no access to s_nvim. It only
+ * transforms msgpack objects into the plain structures of the batch.
+ */
+
+typedef Eina_Bool (*f_redraw_decode)(s_redraw_batch *batch,
+                                     const msgpack_object_array *args);
+
+#define KEY_IS(Str, Name) \
+   (((Str)->size == sizeof(Name) - 1) && \
+    (memcmp((Str)->ptr, (Name), sizeof(Name) - 1) == 0))
+
+static s_redraw_cmd *
+_cmd_new(s_redraw_batch *batch,
+         e_redraw_cmd type)
+{
+   if (batch->cmds_count == batch->cmds_alloc)
+     {
+        const unsigned int alloc =
+           (batch->cmds_alloc) ? batch->cmds_alloc * 2 : 32;
+        s_redraw_cmd *const cmds =
+           realloc(batch->cmds, alloc * sizeof(s_redraw_cmd));
+        if (EINA_UNLIKELY(! cmds))
+          {
+             CRI("Failed to allocate memory for %u redraw commands", alloc);
+             return NULL;
+          }
+        batch->cmds = cmds;
+        batch->cmds_alloc = alloc;
+     }
+
+   s_redraw_cmd *const cmd = &(batch->cmds[batch->cmds_count++]);
+   cmd->type = type;
+   return cmd;
+}
+
+static Eina_Bool
+_codepoints_reserve(s_redraw_batch *batch,
+                    unsigned int count)
+{
+   if (batch->cp_count + count <= batch->cp_alloc)
+     return EINA_TRUE;
+
+   unsigned int alloc = (batch->cp_alloc) ? batch->cp_alloc : 256;
+   while (alloc < batch->cp_count + count)
+     alloc *= 2;
+
+   Eina_Unicode *const cps =
+      realloc(batch->codepoints, alloc * sizeof(Eina_Unicode));
+   if (EINA_UNLIKELY(! cps))
+     {
+        CRI("Failed to allocate memory for %u codepoints", alloc);
+        return EINA_FALSE;
+     }
+   batch->codepoints = cps;
+   batch->cp_alloc = alloc;
+   return EINA_TRUE;
+}
+
+/*
+ * Most of the commands are formatted as [ name, [ args ] ]. This retrieves
+ * the array of args, and makes sure there are exactly @p count of them.
+ */
+static const msgpack_object_array *
+_params_get(const msgpack_object_array *args,
+            unsigned int count)
+{
+   if (EINA_UNLIKELY(args->size != 2))
+     {
+        CRI("Invalid argument count. (%u == 1) is false", args->size - 1);
+        return NULL;
+     }
+   const msgpack_object_array *const params =
+      EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[1]), fail);
+   if (EINA_UNLIKELY(params->size != count))
+     {
+        CRI("Invalid argument count. (%u == %u) is false", params->size, count);
+        return NULL;
+     }
+   return params;
+fail:
+   return NULL;
+}
+
+static Eina_Bool
+_decode_put(s_redraw_batch *batch,
+            const msgpack_object_array *args)
+{
+   /*
+    * We are suppose to receive a string, but we actually do receive arrays
+    * of strings (one per character): [ "put", ["a"], ["b"], ... ]
+    */
+   const unsigned int count = args->size - 1;
+   if (EINA_UNLIKELY(! _codepoints_reserve(batch, count)))
+     return EINA_FALSE;
+
+   const unsigned int start = batch->cp_count;
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const arr =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(arr->size != 1))
+          {
+             CRI("Invalid argument count. (%u == 1) is false", arr->size);
+             goto fail;
+          }
+        const msgpack_object *const arr_arg = &(arr->ptr[0]);
+        if (EINA_UNLIKELY(arr_arg->type != MSGPACK_OBJECT_STR))
+          {
+             CRI("A string was expected, but we got 0x%x", arr_arg->type);
+             goto fail;
+          }
+
+        const msgpack_object_str *const str = &(arr_arg->via.str);
+        const Eina_Unicode cp = utf8_first_get(str->ptr, str->size);
+        if (EINA_UNLIKELY(cp == 0))
+          {
+             ERR("Failed to decode utf-8 string. Skipping.");
+             continue;
+          }
+        batch->codepoints[batch->cp_count++] = cp;
+     }
+
+   /* Consecutive puts are written one after the other on the same line, so
+    * they can be merged in a single command. */
+   if (batch->cmds_count > 0)
+     {
+        s_redraw_cmd *const prev = &(batch->cmds[batch->cmds_count - 1]);
+        if ((prev->type == REDRAW_CMD_PUT) &&
+            (prev->u.put.start + prev->u.put.count == start))
+          {
+             prev->u.put.count += batch->cp_count - start;
+             return EINA_TRUE;
+          }
+     }
+
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_PUT);
+   if (EINA_UNLIKELY(! cmd)) goto fail;
+   cmd->u.put.start = start;
+   cmd->u.put.count = batch->cp_count - start;
+   return EINA_TRUE;
+
+fail:
+   /* Drop what was decoded of this command */
+   batch->cp_count = start;
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_cursor_goto(s_redraw_batch *batch,
+                    const msgpack_object_array *args)
+{
+   const msgpack_object_array *const params = _params_get(args, 2);
+   if (EINA_UNLIKELY(! params)) goto fail;
+
+   const int64_t row = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[0]), fail);
+   const int64_t col = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[1]), fail);
+
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_CURSOR_GOTO);
+   if (EINA_UNLIKELY(! cmd)) goto fail;
+   cmd->u.cursor.x = (unsigned int)col;
+   cmd->u.cursor.y = (unsigned int)row;
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+Eina_Bool
+redraw_style_decode(const msgpack_object_map *map,
+                    s_termview_style *style)
+{
+   for (unsigned int i = 0; i < map->size; i++)
+     {
+        const msgpack_object_kv *const kv = &(map->ptr[i]);
+        const msgpack_object *const val = &(kv->val);
+        const msgpack_object_str *const key =
+           EOVIM_MSGPACK_STRING_OBJ_EXTRACT(&(kv->key), fail);
+
+        if (KEY_IS(key, "foreground"))
+          style->fg_color = EOVIM_MSGPACK_INT64_EXTRACT(val, fail);
+        else if (KEY_IS(key, "background"))
+          style->bg_color = EOVIM_MSGPACK_INT64_EXTRACT(val, fail);
+        else if (KEY_IS(key, "special"))
+          style->sp_color = EOVIM_MSGPACK_INT64_EXTRACT(val, fail);
+        else
+          {
+             Eina_Bool *flag;
+             if (KEY_IS(key, "reverse")) flag = &style->reverse;
+             else if (KEY_IS(key, "italic")) flag = &style->italic;
+             else if (KEY_IS(key, "bold")) flag = &style->bold;
+             else if (KEY_IS(key, "underline")) flag = &style->underline;
+             else if (KEY_IS(key, "undercurl")) flag = &style->undercurl;
+             else continue; /* Unknown attributes are silently ignored */
+
+             if (EINA_UNLIKELY(val->type != MSGPACK_OBJECT_BOOLEAN))
+               CRI("Expected a boolean type. Got 0x%x", val->type);
+             else
+               *flag = val->via.boolean;
+          }
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_highlight_set(s_redraw_batch *batch,
+                      const msgpack_object_array *args)
+{
+   s_termview_style style = {
+      .fg_color = -1,
+      .bg_color = -1,
+      .sp_color = -1,
+      .reverse = EINA_FALSE,
+      .italic = EINA_FALSE,
+      .bold = EINA_FALSE,
+      .underline = EINA_FALSE,
+      .undercurl = EINA_FALSE,
+   };
+
+   /* highlight arguments are arrays containing exactly one map */
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const arr =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(arr->size != 1))
+          {
+             CRI("Invalid argument count. (%u == 1) is false", arr->size);
+             goto fail;
+          }
+        const msgpack_object_map *const map =
+           EOVIM_MSGPACK_MAP_EXTRACT(&(arr->ptr[0]), fail);
+        if (EINA_UNLIKELY(! redraw_style_decode(map, &style)))
+          goto fail;
+     }
+
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_HIGHLIGHT_SET);
+   if (EINA_UNLIKELY(! cmd)) goto fail;
+   cmd->u.style = style;
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_scroll(s_redraw_batch *batch,
+               const msgpack_object_array *args)
+{
+   /*
+    * In some cases (when the command popup opens), we get
+    * ["scroll", [N], [N]] instead of ["scroll", [N]]. So we should be ready
+    * to handle X arguments to "scroll" instead of just one.
+    */
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const arr =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(arr->size != 1))
+          {
+             CRI("Invalid argument count. (%u == 1) is false", arr->size);
+             goto fail;
+          }
+        const int64_t scroll = EOVIM_MSGPACK_INT64_EXTRACT(&(arr->ptr[0]), fail);
+
+        s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_SCROLL);
+        if (EINA_UNLIKELY(! cmd)) goto fail;
+        cmd->u.scroll = (int)scroll;
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_set_scroll_region(s_redraw_batch *batch,
+                          const msgpack_object_array *args)
+{
+   const msgpack_object_array *const params = _params_get(args, 4);
+   if (EINA_UNLIKELY(! params)) goto fail;
+
+   const int64_t top = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[0]), fail);
+   const int64_t bot = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[1]), fail);
+   const int64_t left = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[2]), fail);
+   const int64_t right = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[3]), fail);
+
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_SCROLL_REGION);
+   if (EINA_UNLIKELY(! cmd)) goto fail;
+   cmd->u.region.top = (int)top;
+   cmd->u.region.bot = (int)bot;
+   cmd->u.region.left = (int)left;
+   cmd->u.region.right = (int)right;
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_clear(s_redraw_batch *batch,
+              const msgpack_object_array *args EINA_UNUSED)
+{
+   return (_cmd_new(batch, REDRAW_CMD_CLEAR) != NULL);
+}
+
+static Eina_Bool
+_decode_eol_clear(s_redraw_batch *batch,
+                  const msgpack_object_array *args EINA_UNUSED)
+{
+   return (_cmd_new(batch, REDRAW_CMD_EOL_CLEAR) != NULL);
+}
+
+static Eina_Bool
+_line_segment_add(s_redraw_batch *batch,
+                  unsigned int row,
+                  unsigned int col,
+                  unsigned int hl_id,
+                  unsigned int start)
+{
+   if (batch->cp_count == start) { return EINA_TRUE; } /* Empty segment */
+
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_GRID_LINE);
+   if (EINA_UNLIKELY(! cmd)) { return EINA_FALSE; }
+   cmd->u.line.row = row;
+   cmd->u.line.col = col;
+   cmd->u.line.hl_id = hl_id;
+   cmd->u.line.start = start;
+   cmd->u.line.count = batch->cp_count - start;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_grid_line_decode(s_redraw_batch *batch,
+                  const msgpack_object_array *params)
+{
+   /*
+    * params are [ grid, row, col_start, cells ], where each cell is
+    * [ text(, hl_id(, repeat)) ]. When hl_id is omitted, the highlight of
+    * the previous cell is used. Consecutive cells sharing the same highlight
+    * are gathered into one segment, that will be written in one go.
+    */
+   if (EINA_UNLIKELY(params->size != 4))
+     {
+        CRI("Invalid argument count. (%u == 4) is false", params->size);
+        return EINA_FALSE;
+     }
+   const int64_t row = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[1]), fail);
+   const int64_t col = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[2]), fail);
+   const msgpack_object_array *const cells =
+      EOVIM_MSGPACK_ARRAY_EXTRACT(&(params->ptr[3]), fail);
+
+   unsigned int seg_col = (unsigned int)col;
+   unsigned int seg_start = batch->cp_count;
+   unsigned int hl_id = 0;
+
+   for (unsigned int i = 0; i < cells->size; i++)
+     {
+        const msgpack_object_array *const cell =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(cells->ptr[i]), fail);
+        if (EINA_UNLIKELY((cell->size < 1) || (cell->size > 3)))
+          {
+             CRI("Invalid cell size %u", cell->size);
+             goto fail;
+          }
+        const msgpack_object_str *const text =
+           EOVIM_MSGPACK_STRING_OBJ_EXTRACT(&(cell->ptr[0]), fail);
+
+        unsigned int repeat = 1;
+        if (cell->size >= 2)
+          {
+             const int64_t id =
+                EOVIM_MSGPACK_INT64_EXTRACT(&(cell->ptr[1]), fail);
+             if ((unsigned int)id != hl_id)
+               {
+                  if (EINA_UNLIKELY(! _line_segment_add(
+                           batch, (unsigned int)row, seg_col, hl_id, seg_start)))
+                    goto fail;
+                  seg_col += batch->cp_count - seg_start;
+                  seg_start = batch->cp_count;
+                  hl_id = (unsigned int)id;
+               }
+             if (cell->size == 3)
+               repeat = (unsigned int)
+                  EOVIM_MSGPACK_INT64_EXTRACT(&(cell->ptr[2]), fail);
+          }
+
+        /*
+         * An empty text is the right half of a double-width character, and
+         * is decoded as the codepoint 0.
+         */
+        const Eina_Unicode cp = utf8_first_get(text->ptr, text->size);
+
+        if (EINA_UNLIKELY(! _codepoints_reserve(batch, repeat)))
+          goto fail;
+        for (unsigned int r = 0; r < repeat; r++)
+          batch->codepoints[batch->cp_count++] = cp;
+     }
+
+   return _line_segment_add(batch, (unsigned int)row, seg_col,
+                            hl_id, seg_start);
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_grid_line(s_redraw_batch *batch,
+                  const msgpack_object_array *args)
+{
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const params =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(! _grid_line_decode(batch, params)))
+          goto fail;
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_grid_cursor_goto(s_redraw_batch *batch,
+                         const msgpack_object_array *args)
+{
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const params =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(params->size != 3))
+          {
+             CRI("Invalid argument count. (%u == 3) is false", params->size);
+             goto fail;
+          }
+
+        /* [ grid, row, col ]. There is only one grid without ext_multigrid */
+        const int64_t row = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[1]), fail);
+        const int64_t col = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[2]), fail);
+
+        s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_CURSOR_GOTO);
+        if (EINA_UNLIKELY(! cmd)) goto fail;
+        cmd->u.cursor.x = (unsigned int)col;
+        cmd->u.cursor.y = (unsigned int)row;
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_grid_scroll(s_redraw_batch *batch,
+                    const msgpack_object_array *args)
+{
+   for (unsigned int i = 1; i < args->size; i++)
+     {
+        const msgpack_object_array *const params =
+           EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[i]), fail);
+        if (EINA_UNLIKELY(params->size != 7))
+          {
+             CRI("Invalid argument count. (%u == 7) is false", params->size);
+             goto fail;
+          }
+
+        /*
+         * [ grid, top, bot, left, right, rows, cols ]. Contrary to the legacy
+         * scroll region, bot and right are exclusive. cols is always zero.
+         * This is expressed as the legacy pair set_scroll_region + scroll.
+         */
+        const int64_t top = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[1]), fail);
+        const int64_t bot = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[2]), fail);
+        const int64_t left = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[3]), fail);
+        const int64_t right = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[4]), fail);
+        const int64_t rows = EOVIM_MSGPACK_INT64_EXTRACT(&(params->ptr[5]), fail);
+
+        s_redraw_cmd *cmd = _cmd_new(batch, REDRAW_CMD_SCROLL_REGION);
+        if (EINA_UNLIKELY(! cmd)) goto fail;
+        cmd->u.region.top = (int)top;
+        cmd->u.region.bot = (int)bot - 1;
+        cmd->u.region.left = (int)left;
+        cmd->u.region.right = (int)right - 1;
+
+        cmd = _cmd_new(batch, REDRAW_CMD_SCROLL);
+        if (EINA_UNLIKELY(! cmd)) goto fail;
+        cmd->u.scroll = (int)rows;
+     }
+   return EINA_TRUE;
+fail:
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_decode_grid_clear(s_redraw_batch *batch,
+                   const msgpack_object_array *args EINA_UNUSED)
+{
+   return (_cmd_new(batch, REDRAW_CMD_GRID_CLEAR) != NULL);
+}
+
+static Eina_Bool
+_decode_generic(s_redraw_batch *batch,
+                e_redraw_command id,
+                const msgpack_object_array *args)
+{
+   s_redraw_cmd *const cmd = _cmd_new(batch, REDRAW_CMD_GENERIC);
+   if (EINA_UNLIKELY(! cmd)) return EINA_FALSE;
+   cmd->u.generic.id = id;
+   cmd->u.generic.args = args;
+   return EINA_TRUE;
+}
+
+/* Commands that have no decoder are dispatched by nvim_event.c */
+static const f_redraw_decode _decoders[__E_REDRAW_LAST] =
+{
+   [E_REDRAW_PUT] = _decode_put,
+   [E_REDRAW_CURSOR_GOTO] = _decode_cursor_goto,
+   [E_REDRAW_HIGHLIGHT_SET] = _decode_highlight_set,
+   [E_REDRAW_EOL_CLEAR] = _decode_eol_clear,
+   [E_REDRAW_SCROLL] = _decode_scroll,
+   [E_REDRAW_SET_SCROLL_REGION] = _decode_set_scroll_region,
+   [E_REDRAW_CLEAR] = _decode_clear,
+   [E_REDRAW_GRID_LINE] = _decode_grid_line,
+   [E_REDRAW_GRID_CURSOR_GOTO] = _decode_grid_cursor_goto,
+   [E_REDRAW_GRID_SCROLL] = _decode_grid_scroll,
+   [E_REDRAW_GRID_CLEAR] = _decode_grid_clear,
+};
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+s_redraw_batch *
+redraw_batch_decode(const msgpack_object_array *commands)
+{
+   s_redraw_batch *const batch = calloc(1, sizeof(s_redraw_batch));
+   if (EINA_UNLIKELY(! batch))
+     {
+        CRI("Failed to allocate memory for a redraw batch");
+        return NULL;
+     }
+
+   /*
+    * Go through the notification's commands. There are formatted of the form
+    * [ command_name, Args... ]
+    * So we expect arguments to be arrays of at least one element.
+    * command_name must be a string!
+    */
+   for (unsigned int i = 0; i < commands->size; i++)
+     {
+        const msgpack_object *const arg = &(commands->ptr[i]);
+        if (EINA_UNLIKELY(arg->type != MSGPACK_OBJECT_ARRAY))
+          {
+             CRI("Expected argument of type array. Got 0x%x.", arg->type);
+             continue; /* Try next element */
+          }
+        const msgpack_object_array *const cmd = &(arg->via.array);
+        if (EINA_UNLIKELY(cmd->size < 1))
+          {
+             CRI("Expected at least one argument. Got zero.");
+             continue; /* Try next element */
+          }
+        const msgpack_object *const name = &(cmd->ptr[0]);
+        if (EINA_UNLIKELY((name->type != MSGPACK_OBJECT_STR) &&
+                          (name->type != MSGPACK_OBJECT_BIN)))
+          {
+             CRI("Command name is expected to be a string. Got 0x%x",
+                 name->type);
+             continue; /* Try next element */
+          }
+
+        const msgpack_object_str *const str = &(name->via.str);
+        const e_redraw_command id =
+           nvim_event_redraw_command_get(str->ptr, str->size);
+        if (EINA_UNLIKELY(id == __E_REDRAW_LAST))
+          {
+             CRI("Unknown redraw command '%.*s'", (int)str->size, str->ptr);
+             continue; /* Try next element */
+          }
+
+        const f_redraw_decode decode = _decoders[id];
+        const Eina_Bool ok = (decode)
+           ? decode(batch, cmd)
+           : _decode_generic(batch, id, cmd);
+        if (EINA_UNLIKELY(! ok))
+          ERR("Failed to decode redraw command '%.*s'",
+              (int)str->size, str->ptr);
+     }
+
+   return batch;
+}
+
+e_redraw_command
+redraw_cmd_command_get(const s_redraw_cmd *cmd)
+{
+   /* Redraw command each decoded command was decoded from */
+   static const e_redraw_command decoded[REDRAW_CMD_GENERIC] =
+   {
+      [REDRAW_CMD_PUT] = E_REDRAW_PUT,
+      [REDRAW_CMD_CURSOR_GOTO] = E_REDRAW_CURSOR_GOTO,
+      [REDRAW_CMD_HIGHLIGHT_SET] = E_REDRAW_HIGHLIGHT_SET,
+      [REDRAW_CMD_SCROLL] = E_REDRAW_SCROLL,
+      [REDRAW_CMD_SCROLL_REGION] = E_REDRAW_SET_SCROLL_REGION,
+      [REDRAW_CMD_CLEAR] = E_REDRAW_CLEAR,
+      [REDRAW_CMD_EOL_CLEAR] = E_REDRAW_EOL_CLEAR,
+      [REDRAW_CMD_GRID_LINE] = E_REDRAW_GRID_LINE,
+      [REDRAW_CMD_GRID_CLEAR] = E_REDRAW_GRID_CLEAR,
+   };
+
+   return (cmd->type == REDRAW_CMD_GENERIC)
+      ? cmd->u.generic.id
+      : decoded[cmd->type];
+}
+
+void
+redraw_cmd_apply(s_nvim *nvim,
+                 const s_redraw_batch *batch,
+                 const s_redraw_cmd *cmd)
+{
+   s_gui *const gui = &nvim->gui;
+
+   switch (cmd->type)
+     {
+      case REDRAW_CMD_PUT:
+         gui_put(gui, &(batch->codepoints[cmd->u.put.start]),
+                 cmd->u.put.count);
+         break;
+
+      case REDRAW_CMD_CURSOR_GOTO:
+         gui_cursor_goto(gui, cmd->u.cursor.x, cmd->u.cursor.y);
+         break;
+
+      case REDRAW_CMD_HIGHLIGHT_SET:
+         gui_style_set(gui, &(cmd->u.style));
+         break;
+
+      case REDRAW_CMD_SCROLL:
+         gui_scroll(gui, cmd->u.scroll);
+         break;
+
+      case REDRAW_CMD_SCROLL_REGION:
+         gui_scroll_region_set(gui, cmd->u.region.top, cmd->u.region.bot,
+                               cmd->u.region.left, cmd->u.region.right);
+         break;
+
+      case REDRAW_CMD_CLEAR:
+         gui_clear(gui);
+         break;
+
+      case REDRAW_CMD_EOL_CLEAR:
+         gui_eol_clear(gui);
+         break;
+
+      case REDRAW_CMD_GRID_LINE:
+         gui_cells_put(gui, cmd->u.line.col, cmd->u.line.row,
+                       cmd->u.line.hl_id,
+                       &(batch->codepoints[cmd->u.line.start]),
+                       cmd->u.line.count);
+         break;
+
+      case REDRAW_CMD_GRID_CLEAR:
+         gui_grid_clear(gui);
+         break;
+
+      case REDRAW_CMD_GENERIC:
+         nvim_event_redraw_dispatch(nvim, cmd->u.generic.id,
+                                    cmd->u.generic.args);
+         break;
+     }
+}
+
+void
+redraw_batch_apply(s_nvim *nvim,
+                   const s_redraw_batch *batch)
+{
+   s_gui *const gui = &nvim->gui;
+
+   TRACE_BEGIN("redraw");
+
+   /* The damage of the whole batch is submitted at once, at the end */
+   gui_redraw_begin(gui);
+   for (unsigned int i = 0; i < batch->cmds_count; i++)
+     {
+        const s_redraw_cmd *const cmd = &(batch->cmds[i]);
+        const e_redraw_command command = redraw_cmd_command_get(cmd);
+        nvim->stats.redraw[command]++;
+
+        /* The name is only looked up when tracing, and only once */
+        if (TRACE_ENABLED())
+          {
+             const char *const name =
+                nvim_event_redraw_command_name_get(command);
+             trace_event_add(name, 'B');
+             redraw_cmd_apply(nvim, batch, cmd);
+             trace_event_add(name, 'E');
+          }
+        else
+          redraw_cmd_apply(nvim, batch, cmd);
+     }
+   gui_redraw_end(gui);
+
+   TRACE_END("redraw");
+}
+
+void
+redraw_batch_free(s_redraw_batch *batch)
+{
+   if (batch)
+     {
+        free(batch->cmds);
+        free(batch->codepoints);
+        free(batch);
+     }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/types.h"
+#include "eovim/request_table.h"
+#include "eovim/log.h"
+
+static Eina_Bool
+_request_table_resize(s_request_table *table,
+                      uint32_t size)
+{
+   s_request *const slots = calloc(size, sizeof(s_request));
+   if (EINA_UNLIKELY(! slots))
+     {
+        CRI("Failed to allocate memory for %"PRIu32" requests", size);
+        return EINA_FALSE;
+     }
+
+   /* Move the pending requests in the new table */
+   const uint32_t mask = size - 1;
+   for (uint32_t i = 0; table->slots && (i <= table->mask); i++)
+     {
+        const s_request *const src = &(table->slots[i]);
+        if (! src->pending) { continue; }
+
+        uint32_t slot = src->uid & mask;
+        while (slots[slot].pending) { slot = (slot + 1) & mask; }
+        slots[slot] = *src;
+     }
+
+   DBG("Table of pending requests now has %"PRIu32" slots", size);
+   free(table->slots);
+   table->slots = slots;
+   table->mask = mask;
+   return EINA_TRUE;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+s_request *
+request_table_add(s_request_table *table,
+                  uint32_t uid)
+{
+   /* Keep the table at most 3/4 full, so probe sequences stay short, and
+    * there is always a free slot to end them */
+   const uint64_t size = (table->slots) ? (uint64_t)table->mask + 1u : 0u;
+   if (((uint64_t)table->count + 1u) * 4u > size * 3u)
+     {
+        const uint64_t new_size = (size) ? size * 2u : REQUEST_TABLE_MIN_SIZE;
+        if (EINA_UNLIKELY(new_size > UINT32_MAX))
+          {
+             CRI("Too many pending requests");
+             return NULL;
+          }
+        if (EINA_UNLIKELY(! _request_table_resize(table, (uint32_t)new_size)))
+          return NULL;
+     }
+
+   uint32_t slot = uid & table->mask;
+   while (table->slots[slot].pending) { slot = (slot + 1) & table->mask; }
+
+   s_request *const req = &(table->slots[slot]);
+   req->uid = uid;
+   req->pending = EINA_TRUE;
+   table->count++;
+   return req;
+}
+
+s_request *
+request_table_find(const s_request_table *table,
+                   uint32_t uid)
+{
+   if (EINA_UNLIKELY(! table->slots)) { return NULL; }
+
+   /* A request is between its home slot and the next free one */
+   for (uint32_t slot = uid & table->mask; table->slots[slot].pending;
+        slot = (slot + 1) & table->mask)
+     {
+        s_request *const req = &(table->slots[slot]);
+        if (req->uid == uid) { return req; }
+     }
+   return NULL;
+}
+
+void
+request_table_del(s_request_table *table,
+                  s_request *req)
+{
+   const uint32_t mask = table->mask;
+   uint32_t hole = (uint32_t)(req - table->slots);
+
+   req->pending = EINA_FALSE;
+   table->count--;
+
+   /*
+    * No tombstone is left behind: the requests that follow in the probe
+    * sequence are shifted back, so that each one can still be reached from
+    * its home slot. A request may fill the hole only if the hole is
+    * between its home slot and itself.
+    */
+   for (uint32_t slot = (hole + 1) & mask; table->slots[slot].pending;
+        slot = (slot + 1) & mask)
+     {
+        s_request *const cur = &(table->slots[slot]);
+        const uint32_t home = cur->uid & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+          {
+             table->slots[hole] = *cur;
+             cur->pending = EINA_FALSE;
+             hole = slot;
+          }
+     }
+
+   /* Give memory back once the table is mostly empty. This is not worth
+    * failing for. */
+   const uint32_t size = mask + 1;
+   if ((size > REQUEST_TABLE_MIN_SIZE) && (table->count < size / 8u))
+     _request_table_resize(table, size / 2u);
+}
+
+void
+request_table_clear(s_request_table *table)
+{
+   free(table->slots);
+   table->slots = NULL;
+   table->mask = 0;
+   table->count = 0;
+}
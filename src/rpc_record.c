@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/rpc_record.h"
+#include "eovim/log.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+/*
+ * Recording is designed to be cheap enough to be left enabled on a user's
+ * machine while reproducing a problem: the bytes are appended as they are,
+ * with a small header, to a buffered file. Both the reader thread (received
+ * bytes) and the main loop (sent bytes) write to it, so writes are
+ * serialized by a lock.
+ *
+ * Replaying a session is done by a thread that writes the received bytes of a
+ * recording into a socket, in place of neovim's stdout. The bytes that eovim
+ * sends are discarded, so a replay is deterministic as long as eovim sends
+ * the same requests than during the recording (i.e. the user does not
+ * interact with the window): responses are matched by request identifiers.
+ */
+
+#define RECORD_MAGIC_SIZE (sizeof(RPC_RECORD_MAGIC) - 1)
+#define RECORD_HEADER_SIZE (1u + 8u + 4u)
+
+struct rpc_recorder
+{
+   Eina_Lock lock; /**< Serializes writes of the reader thread and main loop */
+   FILE *file;
+   uint64_t start; /**< Time of the beginning of the recording */
+   Eina_Bool failed; /**< Recording stopped after a write error */
+};
+
+struct rpc_replayer
+{
+   Eina_File *file;
+   const unsigned char *map;
+   size_t size;
+   Eina_Thread thread;
+   int fd; /**< Our end of the socket that replaces neovim's stdout */
+   int stop_fds[2]; /**< Self-pipe used to interrupt the replay thread */
+   Eina_Bool paced; /**< Replay at the pace of the recording */
+};
+
+static uint64_t
+_now_get(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*============================================================================*
+ *                                  Recorder                                  *
+ *============================================================================*/
+
+s_rpc_recorder *
+rpc_recorder_new(const char *path)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(path, NULL);
+
+   s_rpc_recorder *const rec = calloc(1, sizeof(s_rpc_recorder));
+   if (EINA_UNLIKELY(! rec))
+     {
+        CRI("Failed to allocate memory for the recorder");
+        goto fail;
+     }
+
+   rec->file = fopen(path, "wb");
+   if (EINA_UNLIKELY(! rec->file))
+     {
+        CRI("Failed to open '%s': %s", path, strerror(errno));
+        goto free_rec;
+     }
+   if (EINA_UNLIKELY(fwrite(RPC_RECORD_MAGIC, RECORD_MAGIC_SIZE, 1,
+                            rec->file) != 1))
+     {
+        CRI("Failed to write to '%s': %s", path, strerror(errno));
+        goto close_file;
+     }
+
+   if (EINA_UNLIKELY(! eina_lock_new(&rec->lock)))
+     {
+        CRI("Failed to create lock");
+        goto close_file;
+     }
+
+   rec->start = _now_get();
+   INF("Recording the session with neovim in '%s'", path);
+   return rec;
+
+close_file:
+   fclose(rec->file);
+free_rec:
+   free(rec);
+fail:
+   return NULL;
+}
+
+void
+rpc_recorder_free(s_rpc_recorder *rec)
+{
+   if (! rec) { return; }
+
+   if (EINA_UNLIKELY(fclose(rec->file) != 0))
+     ERR("Failed to close the recording: %s", strerror(errno));
+   eina_lock_free(&rec->lock);
+   free(rec);
+}
+
+void
+rpc_recorder_write(s_rpc_recorder *rec,
+                   e_rpc_dir dir,
+                   const void *data,
+                   size_t size)
+{
+   if (EINA_UNLIKELY(size > UINT32_MAX))
+     {
+        ERR("Cannot record %zu bytes at once", size);
+        return;
+     }
+
+   const uint64_t time = _now_get() - rec->start;
+   const uint32_t len = (uint32_t)size;
+   unsigned char header[RECORD_HEADER_SIZE];
+   header[0] = (unsigned char)dir;
+   memcpy(&header[1], &time, sizeof(time));
+   memcpy(&header[9], &len, sizeof(len));
+
+   eina_lock_take(&rec->lock);
+   if (! rec->failed)
+     {
+        if (EINA_UNLIKELY((fwrite(header, sizeof(header), 1, rec->file) != 1) ||
+                          (fwrite(data, size, 1, rec->file) != 1)))
+          {
+             /* The recording is unusable from now on. Don't go on. */
+             ERR("Failed to record %zu bytes: %s", size, strerror(errno));
+             rec->failed = EINA_TRUE;
+          }
+     }
+   eina_lock_release(&rec->lock);
+}
+
+/*============================================================================*
+ *                                  Replayer                                  *
+ *============================================================================*/
+
+static Eina_Bool
+_replay_wait(s_rpc_replayer *rep,
+             uint64_t deadline)
+{
+   /* Sleep until the deadline, unless we are asked to stop */
+   struct pollfd pfd = { .fd = rep->stop_fds[0], .events = POLLIN, .revents = 0 };
+   for (;;)
+     {
+        const uint64_t now = _now_get();
+        if (now >= deadline) { return EINA_TRUE; }
+
+        const uint64_t ms = (deadline - now + 999999u) / 1000000u;
+        const int ret = poll(&pfd, 1, (ms > INT32_MAX) ? INT32_MAX : (int)ms);
+        if (ret > 0) { return EINA_FALSE; }
+        else if ((ret < 0) && (errno != EINTR))
+          {
+             ERR("Failed to wait: %s", strerror(errno));
+             return EINA_FALSE;
+          }
+     }
+}
+
+static Eina_Bool
+_replay_send(s_rpc_replayer *rep,
+             const unsigned char *data,
+             size_t size)
+{
+   struct pollfd fds[2] = {
+      { .fd = rep->fd, .events = POLLOUT, .revents = 0 },
+      { .fd = rep->stop_fds[0], .events = POLLIN, .revents = 0 },
+   };
+
+   while (size > 0)
+     {
+        if (poll(fds, EINA_C_ARRAY_LENGTH(fds), -1) < 0)
+          {
+             if (errno == EINTR) { continue; }
+             ERR("Failed to wait for the reader: %s", strerror(errno));
+             return EINA_FALSE;
+          }
+        if (fds[1].revents) { return EINA_FALSE; } /* Asked to stop */
+
+        /* MSG_NOSIGNAL: the reader may have gone away. That's no reason to
+         * be killed by SIGPIPE. */
+        const ssize_t bytes = send(rep->fd, data, size, MSG_NOSIGNAL);
+        if (bytes < 0)
+          {
+             if ((errno == EAGAIN) || (errno == EINTR)) { continue; }
+             DBG("Replay interrupted: %s", strerror(errno));
+             return EINA_FALSE;
+          }
+        data += bytes;
+        size -= (size_t)bytes;
+     }
+   return EINA_TRUE;
+}
+
+static void *
+_replay_thread(void *data,
+               Eina_Thread thread EINA_UNUSED)
+{
+   s_rpc_replayer *const rep = data;
+   const uint64_t start = _now_get();
+   size_t off = RECORD_MAGIC_SIZE;
+   unsigned int records = 0;
+
+   while (off < rep->size)
+     {
+        if (EINA_UNLIKELY(rep->size - off < RECORD_HEADER_SIZE))
+          {
+             ERR("Recording is truncated at offset %zu", off);
+             break;
+          }
+        const unsigned char *const header = &(rep->map[off]);
+        uint64_t time;
+        uint32_t len;
+        memcpy(&time, &header[1], sizeof(time));
+        memcpy(&len, &header[9], sizeof(len));
+        off += RECORD_HEADER_SIZE;
+        if (EINA_UNLIKELY(rep->size - off < len))
+          {
+             ERR("Recording is truncated at offset %zu", off);
+             break;
+          }
+        const unsigned char *const bytes = &(rep->map[off]);
+        off += len;
+
+        /* What eovim sent back then is not sent anywhere */
+        if (header[0] != RPC_DIR_RECEIVED) { continue; }
+
+        if (rep->paced && (! _replay_wait(rep, start + time))) { break; }
+        if (! _replay_send(rep, bytes, len)) { break; }
+        records++;
+     }
+
+   /* The reader will see the end of the file, as if neovim had exited */
+   INF("Replayed %u records", records);
+   shutdown(rep->fd, SHUT_WR);
+   return NULL;
+}
+
+s_rpc_replayer *
+rpc_replayer_new(const char *path,
+                 Eina_Bool paced,
+                 int *fd)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(path, NULL);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(fd, NULL);
+
+   s_rpc_replayer *const rep = calloc(1, sizeof(s_rpc_replayer));
+   if (EINA_UNLIKELY(! rep))
+     {
+        CRI("Failed to allocate memory for the replayer");
+        goto fail;
+     }
+   rep->paced = paced;
+
+   rep->file = eina_file_open(path, EINA_FALSE);
+   if (EINA_UNLIKELY(! rep->file))
+     {
+        CRI("Failed to open '%s'", path);
+        goto free_rep;
+     }
+   rep->size = eina_file_size_get(rep->file);
+   rep->map = eina_file_map_all(rep->file, EINA_FILE_SEQUENTIAL);
+   if (EINA_UNLIKELY(! rep->map))
+     {
+        CRI("Failed to map '%s'", path);
+        goto close_file;
+     }
+   if (EINA_UNLIKELY((rep->size < RECORD_MAGIC_SIZE) ||
+                     memcmp(rep->map, RPC_RECORD_MAGIC, RECORD_MAGIC_SIZE)))
+     {
+        CRI("'%s' is not a recording of an RPC session", path);
+        goto unmap_file;
+     }
+
+   /* A socket, so a reader that went away does not raise SIGPIPE */
+   int sv[2];
+   if (EINA_UNLIKELY(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0))
+     {
+        CRI("Failed to create socket pair: %s", strerror(errno));
+        goto unmap_file;
+     }
+   rep->fd = sv[0];
+   fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+   fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+   fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+   if (EINA_UNLIKELY(pipe(rep->stop_fds) != 0))
+     {
+        CRI("Failed to create pipe: %s", strerror(errno));
+        goto close_socket;
+     }
+   fcntl(rep->stop_fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(rep->stop_fds[1], F_SETFD, FD_CLOEXEC);
+
+   if (EINA_UNLIKELY(! eina_thread_create(&rep->thread, EINA_THREAD_NORMAL,
+                                          -1, _replay_thread, rep)))
+     {
+        CRI("Failed to create the replay thread");
+        goto close_pipe;
+     }
+
+   INF("Replaying the session recorded in '%s'", path);
+   *fd = sv[1];
+   return rep;
+
+close_pipe:
+   close(rep->stop_fds[0]);
+   close(rep->stop_fds[1]);
+close_socket:
+   close(sv[0]);
+   close(sv[1]);
+unmap_file:
+   eina_file_map_free(rep->file, (void *)rep->map);
+close_file:
+   eina_file_close(rep->file);
+free_rep:
+   free(rep);
+fail:
+   return NULL;
+}
+
+void
+rpc_replayer_free(s_rpc_replayer *rep)
+{
+   if (! rep) { return; }
+
+   const char stop = 0;
+   if (EINA_UNLIKELY(write(rep->stop_fds[1], &stop, sizeof(stop)) < 0))
+     ERR("Failed to interrupt the replay thread: %s", strerror(errno));
+   eina_thread_join(rep->thread);
+
+   close(rep->stop_fds[0]);
+   close(rep->stop_fds[1]);
+   close(rep->fd);
+   eina_file_map_free(rep->file, (void *)rep->map);
+   eina_file_close(rep->file);
+   free(rep);
+}
@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/stats.h"
+#include "eovim/nvim.h"
+#include "eovim/nvim_api.h"
+#include "eovim/nvim_event.h"
+#include "eovim/termview.h"
+#include "eovim/msgpack_helper.h"
+#include "eovim/gui.h"
+#include "eovim/log.h"
+
+/*
+ * The counters are updated where the events happen: the reader thread counts
+ * what it reads and decodes (hence the atomics), nvim_api counts what is
+ * sent and the time requests take to be answered, and redraw counts the
+ * commands it applies. The termview keeps its own statistics. This module
+ * puts all of them together.
+ */
+
+typedef enum
+{
+   KW_HUD,
+   KW_ON,
+   KW_OFF,
+   KW_TOGGLE,
+
+   __KW_LAST
+} e_kw;
+
+static Eina_Stringshare *_keywords[__KW_LAST];
+#define KW(Val) _keywords[(Val)]
+
+/* Amount of redraw commands that are detailed in the HUD */
+#define HUD_REDRAW_TOP 3u
+
+/* Number of buckets per power of two in the histograms */
+#define HIST_SUB (1u << STATS_HIST_SUB_BITS)
+
+static unsigned int
+_hist_bucket_get(uint32_t us)
+{
+   /* The smallest values have a bucket each */
+   if (us < HIST_SUB) { return us; }
+
+   /* Otherwise, the bucket is found by the position of the most significant
+    * bit, and the bits that follow it */
+   const unsigned int msb = 31u - (unsigned int)__builtin_clz(us);
+   const unsigned int shift = msb - STATS_HIST_SUB_BITS;
+   const unsigned int sub = (us >> shift) & (HIST_SUB - 1u);
+   return ((shift + 1u) << STATS_HIST_SUB_BITS) + sub;
+}
+
+static double
+_hist_bucket_max(unsigned int bucket)
+{
+   /* Highest value, in microseconds, that is counted in the bucket */
+   if (bucket < HIST_SUB) { return (double)bucket; }
+
+   const unsigned int shift = (bucket >> STATS_HIST_SUB_BITS) - 1u;
+   const unsigned int sub = bucket & (HIST_SUB - 1u);
+   const double low = (double)((uint64_t)(HIST_SUB + sub) << shift);
+   return low + (double)((uint64_t)1u << shift) - 1.0;
+}
+
+static void
+_pack_str(msgpack_packer *pk,
+          const char *str)
+{
+   const size_t len = strlen(str);
+   msgpack_pack_str(pk, len);
+   msgpack_pack_str_body(pk, str, len);
+}
+
+static void
+_pack_uint(msgpack_packer *pk,
+           const char *key,
+           unsigned long value)
+{
+   _pack_str(pk, key);
+   msgpack_pack_uint64(pk, value);
+}
+
+static Eina_Bool
+_api_used(const s_stats_api *api)
+{
+   return (api->answered || api->expired);
+}
+
+static void
+_api_pack(msgpack_packer *pk,
+          const char *name,
+          const s_stats_api *api)
+{
+   _pack_str(pk, name);
+   msgpack_pack_map(pk, 7);
+   _pack_uint(pk, "answered", api->answered);
+   _pack_uint(pk, "expired", api->expired);
+   _pack_str(pk, "average_ms");
+   msgpack_pack_double(pk, (api->answered)
+                       ? (api->total * 1000.0) / (double)api->answered
+                       : 0.0);
+   _pack_str(pk, "p50_ms");
+   msgpack_pack_double(pk, stats_api_percentile_get(api, 0.50));
+   _pack_str(pk, "p95_ms");
+   msgpack_pack_double(pk, stats_api_percentile_get(api, 0.95));
+   _pack_str(pk, "p99_ms");
+   msgpack_pack_double(pk, stats_api_percentile_get(api, 0.99));
+   _pack_str(pk, "max_ms");
+   msgpack_pack_double(pk, api->max * 1000.0);
+}
+
+static void
+_api_text_append(Eina_Strbuf *buf,
+                 const char *name,
+                 const s_stats_api *api)
+{
+   if (api->answered)
+     eina_strbuf_append_printf(buf, "%s: %lu answered, %.1f ms on average, "
+                               "p99 %.1f ms",
+                               name, api->answered,
+                               (api->total * 1000.0) / (double)api->answered,
+                               stats_api_percentile_get(api, 0.99));
+   if (api->expired)
+     {
+        /* The name was already written with the answered requests */
+        if (api->answered)
+          eina_strbuf_append_printf(buf, ", %lu expired", api->expired);
+        else
+          eina_strbuf_append_printf(buf, "%s: %lu expired", name, api->expired);
+     }
+   if (_api_used(api))
+     eina_strbuf_append(buf, "<br>");
+}
+
+static void
+_stats_publish(s_nvim *nvim)
+{
+   /*
+    * Eovim() only sends a notification to eovim, so nothing can be returned
+    * to it. The statistics are stored in g:eovim_stats, and the EovimStats
+    * user autocommand tells scripts when they are available.
+    */
+   nvim_api_var_set(nvim, "eovim_stats", stats_pack);
+
+   const char cmd[] = "silent doautocmd <nomodeline> User EovimStats";
+   nvim_api_command(nvim, cmd, sizeof(cmd) - 1);
+}
+
+static Eina_Bool
+_stats_cmd_cb(s_nvim *nvim,
+              const msgpack_object_array *args)
+{
+   s_gui *const gui = &nvim->gui;
+
+   /* Without parameters, the statistics are sent to neovim */
+   if (args->size < 2)
+     {
+        _stats_publish(nvim);
+        return EINA_TRUE;
+     }
+
+   /* Otherwise, we expect maps of parameters. Exclude "stats" itself */
+   const msgpack_object_array *const arr =
+      EOVIM_MSGPACK_ARRAY_EXTRACT(&(args->ptr[1]), fail);
+   for (unsigned int i = 0; i < arr->size; i++)
+     {
+        const msgpack_object_map *const map =
+           EOVIM_MSGPACK_MAP_EXTRACT(&(arr->ptr[i]), fail);
+        const msgpack_object *key_obj, *val_obj;
+        size_t it;
+        EOVIM_MSGPACK_MAP_ITER(map, it, key_obj, val_obj)
+          {
+             Eina_Stringshare *const key =
+                EOVIM_MSGPACK_STRING_EXTRACT(key_obj, fail);
+             Eina_Stringshare *const val =
+                EOVIM_MSGPACK_STRING_EXTRACT(val_obj, del_key);
+
+             if (key != KW(KW_HUD))
+               ERR("Invalid keyword '%s'", key);
+             else if (val == KW(KW_ON))
+               gui_hud_show(gui, EINA_TRUE);
+             else if (val == KW(KW_OFF))
+               gui_hud_show(gui, EINA_FALSE);
+             else if (val == KW(KW_TOGGLE))
+               gui_hud_show(gui, ! gui_hud_shown_get(gui));
+             else
+               ERR("Invalid argument '%s' for keyword '%s'", val, key);
+
+             eina_stringshare_del(val);
+             eina_stringshare_del(key);
+             continue;
+del_key:
+             eina_stringshare_del(key);
+             goto fail;
+          }
+     }
+   return EINA_TRUE;
+
+fail:
+   return EINA_FALSE;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+stats_init(void)
+{
+   const char *const keywords[__KW_LAST] = {
+      [KW_HUD] = "hud",
+      [KW_ON] = "on",
+      [KW_OFF] = "off",
+      [KW_TOGGLE] = "toggle",
+   };
+   int i = 0;
+
+   for (; i < __KW_LAST; i++)
+     {
+        _keywords[i] = eina_stringshare_add(keywords[i]);
+        if (EINA_UNLIKELY(! _keywords[i]))
+          {
+             CRI("Failed to create stringshare from '%s'", keywords[i]);
+             goto fail;
+          }
+     }
+
+   /* The statistics are queried like the plugins are */
+   if (EINA_UNLIKELY(! nvim_event_plugin_register("stats", _stats_cmd_cb)))
+     {
+        CRI("Failed to register the 'stats' command");
+        goto fail;
+     }
+   return EINA_TRUE;
+
+fail:
+   for (--i; i >= 0; i--)
+     eina_stringshare_del(_keywords[i]);
+   return EINA_FALSE;
+}
+
+void
+stats_shutdown(void)
+{
+   for (unsigned int i = 0; i < EINA_C_ARRAY_LENGTH(_keywords); i++)
+     eina_stringshare_del(_keywords[i]);
+}
+
+void
+stats_api_answered(s_stats_api *api,
+                   double elapsed)
+{
+   /* Beyond an hour, who cares about accuracy anyway */
+   const double us = elapsed * 1e6;
+   const uint32_t value = (us < 0.0) ? 0u
+      : (us >= (double)UINT32_MAX) ? UINT32_MAX
+      : (uint32_t)us;
+
+   api->answered++;
+   api->total += elapsed;
+   if (elapsed > api->max) { api->max = elapsed; }
+   api->hist[_hist_bucket_get(value)]++;
+}
+
+void
+stats_api_expired(s_stats_api *api)
+{
+   api->expired++;
+}
+
+double
+stats_api_percentile_get(const s_stats_api *api,
+                         double percentile)
+{
+   if (api->answered == 0) { return 0.0; }
+
+   /* Rank of the response which wait time is searched for */
+   double rank = percentile * (double)api->answered;
+   if (rank < 1.0) { rank = 1.0; }
+
+   unsigned long seen = 0;
+   for (unsigned int i = 0; i < STATS_HIST_BUCKETS; i++)
+     {
+        seen += api->hist[i];
+        if ((double)seen >= rank)
+          {
+             /* The bucket may go beyond the actual maximum */
+             const double ms = _hist_bucket_max(i) / 1000.0;
+             const double max = api->max * 1000.0;
+             return (ms < max) ? ms : max;
+          }
+     }
+   return api->max * 1000.0;
+}
+
+void
+stats_pack(s_nvim *nvim,
+           msgpack_packer *pk)
+{
+   const s_stats *const stats = &nvim->stats;
+   s_termview_palette_stats palette;
+   s_termview_damage_stats damage;
+
+   termview_palette_stats_get(nvim->gui.termview, &palette);
+   termview_damage_stats_get(nvim->gui.termview, &damage);
+
+   msgpack_pack_map(pk, 11);
+   _pack_uint(pk, "bytes_in", atomic_load(&stats->bytes_in));
+   _pack_uint(pk, "bytes_out", stats->bytes_out);
+   _pack_uint(pk, "messages", atomic_load(&stats->messages));
+   _pack_uint(pk, "requests_pending", nvim->requests.table.count);
+   _pack_uint(pk, "requests_expired", nvim->requests.expired);
+   _pack_uint(pk, "inputs", nvim->input.inputs);
+   _pack_uint(pk, "input_requests", nvim->input.requests);
+
+   /* Redraw commands that were never received are omitted */
+   uint32_t redraw_types = 0;
+   for (unsigned int i = 0; i < __E_REDRAW_LAST; i++)
+     if (stats->redraw[i]) redraw_types++;
+   _pack_str(pk, "redraw");
+   msgpack_pack_map(pk, redraw_types);
+   for (unsigned int i = 0; i < __E_REDRAW_LAST; i++)
+     if (stats->redraw[i])
+       _pack_uint(pk, nvim_event_redraw_command_name_get((e_redraw_command)i),
+                  stats->redraw[i]);
+
+   /* So are the API functions that were never answered */
+   uint32_t apis = 0;
+   for (unsigned int i = 0; i < __E_API_LAST; i++)
+     if (_api_used(&(stats->apis[i]))) apis++;
+   _pack_str(pk, "api");
+   msgpack_pack_map(pk, apis);
+   for (unsigned int i = 0; i < __E_API_LAST; i++)
+     if (_api_used(&(stats->apis[i])))
+       _api_pack(pk, nvim_api_name_get((e_api)i), &(stats->apis[i]));
+
+   _pack_str(pk, "palette");
+   msgpack_pack_map(pk, 6);
+   _pack_uint(pk, "used", palette.used);
+   _pack_uint(pk, "allocations", palette.allocations);
+   _pack_uint(pk, "sweeps", palette.sweeps);
+   _pack_uint(pk, "evictions", palette.evictions);
+   _pack_uint(pk, "forced_evictions", palette.forced_evictions);
+   _pack_uint(pk, "repainted_attrs", palette.repainted_attrs);
+
+   _pack_str(pk, "damage");
+   msgpack_pack_map(pk, 6);
+   _pack_uint(pk, "requested", damage.requested);
+   _pack_uint(pk, "submitted", damage.submitted);
+   _pack_uint(pk, "cells", damage.cells);
+   _pack_uint(pk, "batches", damage.batches);
+   _pack_uint(pk, "frames", damage.frames);
+   _pack_uint(pk, "fallbacks", damage.fallbacks);
+}
+
+void
+stats_text_append(const s_nvim *nvim,
+                  Eina_Strbuf *buf)
+{
+   const s_stats *const stats = &nvim->stats;
+   s_termview_palette_stats palette;
+   s_termview_damage_stats damage;
+
+   termview_palette_stats_get(nvim->gui.termview, &palette);
+   termview_damage_stats_get(nvim->gui.termview, &damage);
+
+   eina_strbuf_append_printf(
+      buf, "Received %lu KiB in %lu messages, sent %lu KiB<br>"
+      "%u requests pending, %u inputs sent in %u requests<br>",
+      atomic_load(&stats->bytes_in) / 1024u, atomic_load(&stats->messages),
+      stats->bytes_out / 1024u, nvim->requests.table.count,
+      nvim->input.inputs, nvim->input.requests);
+   for (unsigned int i = 0; i < __E_API_LAST; i++)
+     _api_text_append(buf, nvim_api_name_get((e_api)i), &(stats->apis[i]));
+
+   /* Only the most frequent redraw commands are detailed */
+   unsigned long total = 0;
+   unsigned int top[HUD_REDRAW_TOP];
+   unsigned int top_count = 0;
+   for (unsigned int i = 0; i < __E_REDRAW_LAST; i++)
+     {
+        const unsigned long count = stats->redraw[i];
+        if (count == 0) { continue; }
+        total += count;
+
+        unsigned int pos = top_count;
+        while ((pos > 0) && (stats->redraw[top[pos - 1]] < count))
+          {
+             if (pos < HUD_REDRAW_TOP) top[pos] = top[pos - 1];
+             pos--;
+          }
+        if (pos < HUD_REDRAW_TOP) top[pos] = i;
+        if (top_count < HUD_REDRAW_TOP) top_count++;
+     }
+   eina_strbuf_append_printf(buf, "%lu redraw commands", total);
+   for (unsigned int i = 0; i < top_count; i++)
+     eina_strbuf_append_printf(buf, "%s %s %lu", (i == 0) ? ":" : ",",
+                               nvim_event_redraw_command_name_get(
+                                  (e_redraw_command)top[i]),
+                               stats->redraw[top[i]]);
+
+   eina_strbuf_append_printf(
+      buf, "<br>%u palettes used, %u evicted (%u forcibly) in %u sweeps<br>"
+      "%u rectangles damaged (%u requested), %u cells in %u frames",
+      palette.used, palette.evictions, palette.forced_evictions,
+      palette.sweeps, damage.submitted, damage.requested, damage.cells,
+      damage.frames);
+}
@@ -30,8 +30,11 @@
 #include "eovim/nvim_helper.h"
 #include "eovim/nvim_api.h"
 #include "eovim/nvim.h"
+#include "eovim/grid.h"
+#include "eovim/trace.h"
 
 #include <Edje.h>
+#include <Ecore.h>
 #include <Ecore_Input.h>
 
 enum
@@ -42,6 +45,17 @@ enum
    COL_GENERATOR_START /* Should be the last element */
 };
 
+/*
+ * Delays after which the shadow grid is presented if no "flush" was
+ * received. Neovim before 0.4.0 never sends "flush", so its updates are
+ * only coalesced for one frame. Otherwise, this is just a safety net.
+ */
+#define SYNC_FALLBACK_DELAY (1.0 / 60.0)
+#define SYNC_FLUSH_TIMEOUT 0.5
+
+/* Maximum number of palettes evicted by a sweep of the textgrid */
+#define PALETTE_EVICT_BATCH 32u
+
 enum
 {
    THEME_MSG_BLINK_SET = 0,
@@ -52,8 +66,23 @@ static Evas_Smart *_smart = NULL;
 static Evas_Smart_Class _parent_sc = EVAS_SMART_CLASS_INIT_NULL;
 
 typedef struct termview s_termview;
+typedef struct hl_attr s_hl_attr;
 typedef void (*f_cursor_calc)(s_termview *sd, Evas_Coord x, Evas_Coord y);
 
+/*
+ * A highlight attribute, as it is written in the textgrid cells: the colors
+ * are palette identifiers, and reverse video is already applied.
+ */
+struct hl_attr
+{
+   uint8_t fg;
+   uint8_t bg;
+   Eina_Bool italic;
+   Eina_Bool bold;
+   Eina_Bool underline;
+   Eina_Bool stale; /**< One of its palettes was evicted */
+};
+
 struct termview
 {
    Evas_Object_Smart_Clipped_Data __clipped_data; /* Required by Evas */
@@ -61,14 +90,27 @@ struct termview
    s_nvim *nvim;
    Evas_Object *textgrid;
    Evas_Object *cursor;
-   Eina_Hash *palettes;
 
    unsigned int cell_w;
    unsigned int cell_h;
    unsigned int rows;
    unsigned int cols;
 
-   unsigned int palette_id_generator;
+   /*
+    * The textgrid has only 256 extended palettes. When they are all taken,
+    * the ones that are not displayed anymore are recycled, the least
+    * recently used first.
+    */
+   struct {
+      Eina_Hash *ids; /**< Maps a s_termview_color to its palette id */
+      s_termview_color colors[256]; /**< Color of each palette id */
+      unsigned int last_use[256]; /**< Value of @p tick at the last use */
+      unsigned int tick; /**< Incremented for each style resolution */
+      unsigned int generator; /**< Next never-used palette id */
+      uint8_t free_ids[256]; /**< Palettes ids that have been evicted */
+      unsigned int free_count;
+      s_termview_palette_stats stats;
+   } palette;
 
    /* The rows and columns that neovim uses to display its text. It is
     * important to keep them around, as this allows to arbitrate positions
@@ -80,17 +122,42 @@ struct termview
    unsigned int nvim_rows;
    unsigned int nvim_cols;
 
+   uint16_t current; /**< Highlight attribute of the cells being written */
+
+   /*
+    * Redraw commands are applied to a shadow grid, that is not displayed.
+    * When neovim sends "flush", the dirty cells of the grid are compared
+    * to the ones of the textgrid (the last presented frame), and only the
+    * ones that differ are written. The intermediate states of the screen
+    * are never displayed.
+    */
+   s_grid *grid;
    struct {
-      uint8_t fg;
-      uint8_t bg;
-      Eina_Bool reverse;
-      Eina_Bool italic;
-      Eina_Bool bold;
-      Eina_Bool underline;
-   } current; /**< Current style */
+      Ecore_Timer *timer; /**< Presents the shadow grid if no flush comes */
+      Eina_Bool batching; /**< A redraw batch is being applied */
+      Eina_Bool cursor_dirty; /**< The cursor moved since last presentation */
+      Eina_Bool flush_aware; /**< Neovim sends "flush" events */
+      s_termview_damage_stats stats;
+   } damage;
 
    Eina_Rectangle scroll; /**< Scrolling region */
 
+   /*
+    * Highlight attributes, indexed by their id. With ext_linegrid, ids are
+    * the ones of hl_attr_define. With the legacy protocol, each distinct
+    * highlight_set is given an id when it is first seen, and the
+    * @p legacy table maps the style (see _style_key()) to this id.
+    * The styles are kept to resolve again the attributes that are stale.
+    * Id 0 is always the default attribute.
+    */
+   struct {
+      s_hl_attr *attrs;
+      s_termview_style *styles;
+      unsigned int count;
+      unsigned int legacy_next; /**< Next id to be given to a legacy style */
+      Eina_Hash *legacy;
+   } hl;
+
    struct {
       /* When mouse drag starts, we store in here the button that was pressed
        * when dragging was initiated. Since there is no button 0, we use 0 as a
@@ -111,6 +178,28 @@ struct termview
 
 #include "termcolors.x"
 
+/* Style and attribute of the cells that have no highlight attribute */
+static const s_termview_style _default_style = {
+   .fg_color = -1,
+   .bg_color = -1,
+   .sp_color = -1,
+   .reverse = EINA_FALSE,
+   .italic = EINA_FALSE,
+   .bold = EINA_FALSE,
+   .underline = EINA_FALSE,
+   .undercurl = EINA_FALSE,
+};
+
+static const s_hl_attr _default_attr = {
+   .fg = COL_DEFAULT_FG,
+   .bg = COL_DEFAULT_BG,
+   .italic = EINA_FALSE,
+   .bold = EINA_FALSE,
+   .underline = EINA_FALSE,
+   .stale = EINA_FALSE,
+};
+
+static Eina_Bool _hl_reserve(s_termview *sd, unsigned int id);
 
 static void
 _keys_send(s_termview *sd,
@@ -118,6 +207,9 @@ _keys_send(s_termview *sd,
            unsigned int size)
 {
    const s_config *const config = sd->nvim->config;
+
+   /* Composed keys are timed from the last key of their sequence */
+   latency_key_pressed(sd->nvim->gui.latency);
    nvim_api_input(sd->nvim, keys, size);
    if (config->key_react)
      edje_object_signal_emit(sd->cursor, "key,down", "eovim");
@@ -407,61 +499,10 @@ _paste_cb(void *data,
    EINA_SAFETY_ON_FALSE_RETURN_VAL(ev->format == ELM_SEL_FORMAT_TEXT, EINA_FALSE);
 
    s_termview *const sd = data;
-   const char *const string = ev->data;
-   Eina_Bool ret = EINA_TRUE;
-   size_t escaped_len = 0;
-
-   for (size_t i = 0; i < ev->len; i++)
-     {
-        /* We know that if we type '<' we must escape it as "<lt>", so we will
-         * hav to write 4 characters? Otherwise, there is no escaping, we will
-         * write only one character */
-        escaped_len += (string[i] == '<') ? 4 : 1;
-     }
-
-   /* We can only pass UINT_MAX bytes to neovim, so if the input is greater
-    * than that (lol), we will truncate the paste... such a shame...
-    */
-   if (EINA_UNLIKELY(escaped_len > UINT_MAX))
-     {
-        ERR("Integer overflow. Pasting will be truncated.");
-        ret = EINA_FALSE; /* We will not copy everything */
-     }
-
-   if (escaped_len != ev->len)
-     {
-        /* If we have some escaping to do, we have to make copies of the input
-         * data, as we need to modify it. That's not great... but we how it
-         * goes. */
-        char *const escaped = malloc(escaped_len + 1);
-        if (EINA_UNLIKELY(! escaped))
-          {
-             CRI("Failed to allocate memory");
-             return EINA_FALSE;
-          }
-        char *ptr = escaped;
-         for (unsigned int i = 0; i < ev->len; i++)
-           {
-             if (string[i] == '<')
-               {
-                  strcpy(ptr, "<lt>");
-                  ptr += 4;
-               }
-             else *(ptr++) = string[i];
-           }
-         escaped[escaped_len] = '\0';
-
-         /* Send the data, then free the temporayy storage */
-        nvim_api_input(sd->nvim, escaped, (unsigned int)escaped_len);
-        free(escaped);
-     }
-   else
-     {
-        /* Cool! No escaping to do! Send the pasted data as they are. */
-        nvim_api_input(sd->nvim, string, (unsigned int)ev->len);
-     }
 
-   return ret;
+   /* The selection data is only valid during this callback, so the paste
+    * keeps its own copy, which is then sent chunk by chunk */
+   return nvim_helper_paste(sd->nvim, ev->data, ev->len);
 }
 
 static void
@@ -585,6 +626,174 @@ _termview_focus_out_cb(void *data,
 }
 
 
+static void
+_cell_template_make(const s_termview *sd,
+                    uint16_t id,
+                    Evas_Textgrid_Cell *cell)
+{
+   /*
+    * A template is a cell with the attributes @p id stands for, but without
+    * codepoint. It is fully reset, so the cells made by copying it can be
+    * compared with memcmp().
+    */
+   memset(cell, 0, sizeof(Evas_Textgrid_Cell));
+
+   const s_hl_attr *const attr = (EINA_LIKELY(id < sd->hl.count))
+      ? &(sd->hl.attrs[id])
+      : &_default_attr;
+   cell->fg = attr->fg;
+   cell->bg = attr->bg;
+   cell->bold = !!attr->bold;
+   cell->italic = !!attr->italic;
+   cell->underline = !!attr->underline;
+   cell->fg_extended = 1;
+   cell->bg_extended = 1;
+}
+
+static void
+_rect_submit(s_termview *sd,
+             unsigned int first,
+             unsigned int last,
+             unsigned int y,
+             unsigned int h)
+{
+   evas_object_textgrid_update_add(sd->textgrid, (int)first, (int)y,
+                                   (int)(last - first + 1), (int)h);
+   sd->damage.stats.submitted++;
+}
+
+static void
+_present(s_termview *sd)
+{
+   if (sd->damage.timer)
+     {
+        ecore_timer_del(sd->damage.timer);
+        sd->damage.timer = NULL;
+     }
+
+   s_grid *const grid = sd->grid;
+   if ((! grid->has_dirty) && (! sd->damage.cursor_dirty)) { return; }
+   TRACE_BEGIN("present");
+
+   /*
+    * Only the dirty cells that differ from what the textgrid already
+    * displays are written. Consecutive rows that changed on the same span
+    * are submitted as a single rectangle. This is typically the case of
+    * scrolling and clearing, and of successive lines that are fully redrawn.
+    */
+   unsigned int rect_first = 0, rect_last = 0, rect_y = 0, rect_h = 0;
+   for (unsigned int y = 0; grid->has_dirty && (y < grid->rows); y++)
+     {
+        const s_grid_span span = grid->dirty[y];
+        unsigned int first = UINT_MAX, last = 0;
+
+        if (span.first <= span.last)
+          {
+             const Eina_Unicode *const codepoints =
+                grid_row_codepoints_get(grid, y);
+             const uint16_t *const attrs = grid_row_attrs_get(grid, y);
+             Evas_Textgrid_Cell *const cells =
+                evas_object_textgrid_cellrow_get(sd->textgrid, (int)y);
+
+             /* Cells are made from a template, that is built again only when
+              * the attribute changes, which is seldom within a row */
+             Evas_Textgrid_Cell template;
+             unsigned int template_id = UINT_MAX;
+
+             for (unsigned int x = span.first; x <= span.last; x++)
+               {
+                  Evas_Textgrid_Cell cell;
+                  if ((codepoints[x] == 0) && (attrs[x] == 0))
+                    {
+                       /* Cleared cells are blank, like the ones of a new
+                        * textgrid */
+                       memset(&cell, 0, sizeof(cell));
+                    }
+                  else
+                    {
+                       if (attrs[x] != template_id)
+                         {
+                            _cell_template_make(sd, attrs[x], &template);
+                            template_id = attrs[x];
+                         }
+                       memcpy(&cell, &template, sizeof(cell));
+                       cell.codepoint = codepoints[x];
+                    }
+                  if (memcmp(&cell, &cells[x], sizeof(cell)) != 0)
+                    {
+                       cells[x] = cell;
+                       if (first == UINT_MAX) first = x;
+                       last = x;
+                       sd->damage.stats.cells++;
+                    }
+               }
+             if (first != UINT_MAX)
+               evas_object_textgrid_cellrow_set(sd->textgrid, (int)y, cells);
+          }
+
+        if ((rect_h > 0) && (first == rect_first) && (last == rect_last))
+          {
+             rect_h++;
+             continue;
+          }
+        if (rect_h > 0)
+          _rect_submit(sd, rect_first, rect_last, rect_y, rect_h);
+        rect_h = 0;
+        if (first != UINT_MAX)
+          {
+             rect_first = first;
+             rect_last = last;
+             rect_y = y;
+             rect_h = 1;
+          }
+     }
+   if (rect_h > 0)
+     _rect_submit(sd, rect_first, rect_last, rect_y, rect_h);
+   grid_dirty_reset(grid);
+
+   if (sd->damage.cursor_dirty)
+     {
+        Evas_Coord ox, oy;
+        evas_object_geometry_get(sd->textgrid, &ox, &oy, NULL, NULL);
+        sd->cursor_calc(sd, ox, oy);
+        sd->damage.cursor_dirty = EINA_FALSE;
+     }
+   sd->damage.stats.frames++;
+   TRACE_END("present");
+}
+
+static Eina_Bool
+_present_timer_cb(void *data)
+{
+   s_termview *const sd = data;
+   sd->damage.timer = NULL;
+   sd->damage.stats.fallbacks++;
+   _present(sd);
+   return ECORE_CALLBACK_CANCEL;
+}
+
+static void
+_grid_changed(s_termview *sd)
+{
+   sd->damage.stats.requested++;
+
+   /* Outside of redraw batches, changes are displayed right away */
+   if (! sd->damage.batching)
+     _present(sd);
+}
+
+static void
+_textgrid_update_all(s_termview *sd)
+{
+   /*
+    * The palettes changed, but not the cells: comparing them would find
+    * nothing to update. The whole textgrid is redrawn instead.
+    */
+   _present(sd);
+   if ((sd->cols > 0) && (sd->rows > 0))
+     _rect_submit(sd, 0, sd->cols - 1, 0, sd->rows);
+}
+
 static void
 _smart_add(Evas_Object *obj)
 {
@@ -627,8 +836,8 @@ _smart_add(Evas_Object *obj)
    evas_object_show(o);
 
    /* Creation of the palette items cache */
-   sd->palettes = eina_hash_int32_new(NULL);
-   if (EINA_UNLIKELY(! sd->palettes))
+   sd->palette.ids = eina_hash_int32_new(NULL);
+   if (EINA_UNLIKELY(! sd->palette.ids))
      {
         CRI("Failed to create hash for color palettes");
         return;
@@ -639,11 +848,30 @@ _smart_add(Evas_Object *obj)
       COL_REVERSE_FG, 0, 0, 0, 255
    );
 
+   /* The shadow grid is empty until the termview is given a size */
+   sd->grid = grid_new(0, 0);
+   if (EINA_UNLIKELY(! sd->grid))
+     {
+        CRI("Failed to create the shadow grid");
+        return;
+     }
+
    /* Set a default foreground color */
    termview_fg_color_set(obj, 255, 215, 175, 255);
 
    /* Set the index at which the extended palette will start */
-   sd->palette_id_generator = COL_GENERATOR_START;
+   sd->palette.generator = COL_GENERATOR_START;
+
+   /* Memoization of the legacy highlight_set styles */
+   sd->hl.legacy = eina_hash_int64_new(NULL);
+   if (EINA_UNLIKELY(! sd->hl.legacy))
+     {
+        CRI("Failed to create hash for highlight attributes");
+        return;
+     }
+   if (EINA_UNLIKELY(! _hl_reserve(sd, 0))) { return; }
+   sd->hl.legacy_next = 1;
+   sd->current = 0;
 }
 
 static void
@@ -652,7 +880,22 @@ _smart_del(Evas_Object *obj)
    s_termview *const sd = evas_object_smart_data_get(obj);
    evas_object_del(sd->textgrid);
    evas_object_del(sd->cursor);
-   eina_hash_free(sd->palettes);
+   const s_termview_palette_stats *const stats = &sd->palette.stats;
+   INF("%u palettes were allocated. %u were evicted in %u sweeps, "
+       "%u of which while being displayed (%u attributes repainted)",
+       stats->allocations, stats->evictions, stats->sweeps,
+       stats->forced_evictions, stats->repainted_attrs);
+   const s_termview_damage_stats *const damage = &sd->damage.stats;
+   INF("%u redraw batches were displayed in %u frames (%u without flush). "
+       "%u changes were submitted as %u rectangles (%u cells written)",
+       damage->batches, damage->frames, damage->fallbacks,
+       damage->requested, damage->submitted, damage->cells);
+   if (sd->damage.timer) ecore_timer_del(sd->damage.timer);
+   grid_free(sd->grid);
+   eina_hash_free(sd->palette.ids);
+   eina_hash_free(sd->hl.legacy);
+   free(sd->hl.attrs);
+   free(sd->hl.styles);
    _composition_reset(sd);
 }
 
@@ -670,10 +913,15 @@ _smart_resize(Evas_Object *obj,
    /* Don't resize if not needed */
    if ((cols == sd->cols) && (rows == sd->rows)) { return; }
 
+   if (EINA_UNLIKELY(! grid_resize(sd->grid, cols, rows))) { return; }
    evas_object_textgrid_size_set(sd->textgrid, (int)cols, (int)rows);
    sd->cols = cols;
    sd->rows = rows;
 
+   /* The textgrid lost its content. Give it back right away. Its new cells
+    * are blank, so only the ones that are not are written. */
+   _present(sd);
+
    termview_resize(obj, cols, rows);
    evas_object_smart_changed(obj);
 }
@@ -749,7 +997,7 @@ void
 termview_refresh(Evas_Object *obj)
 {
    s_termview *const sd = evas_object_smart_data_get(obj);
-   evas_object_textgrid_update_add(sd->textgrid, 0, 0, (int)sd->cols, (int)sd->rows);
+   _textgrid_update_all(sd);
 }
 
 void
@@ -806,7 +1054,10 @@ termview_resize(Evas_Object *obj,
       .h = (int)rows - 1,
    };
    termview_scroll_region_set(obj, &region);
-   nvim_api_ui_try_resize(sd->nvim, cols, rows);
+
+   /* Before the UI is attached, neovim will be given our size upon attach */
+   if (sd->nvim->ui_attached)
+     nvim_api_ui_try_resize(sd->nvim, cols, rows);
 }
 
 void
@@ -820,48 +1071,56 @@ termview_resized_confirm(Evas_Object *obj,
    sd->nvim_cols = cols;
 }
 
+static void
+_grid_clear(s_termview *sd)
+{
+   grid_clear(sd->grid);
+   _grid_changed(sd);
+}
+
 void
 termview_clear(Evas_Object *obj)
 {
    s_termview *const sd = evas_object_smart_data_get(obj);
-   Evas_Object *const grid = sd->textgrid;
-
-   /*
-    * Go through each line (row) in the textgrid, and reset all the cells.
-    * Memset() is an efficient way to do that as it will reset both the
-    * codepoint and the attributes.
-    */
-   for (unsigned int y = 0; y < sd->rows; y++)
-     {
-        Evas_Textgrid_Cell *const cells = evas_object_textgrid_cellrow_get(
-           grid, (int)y
-        );
-        memset(cells, 0, sizeof(Evas_Textgrid_Cell) * sd->cols);
-        evas_object_textgrid_cellrow_set(grid, (int)y, cells);
-     }
-   evas_object_textgrid_update_add(grid, 0, 0, (int)sd->cols, (int)sd->rows);
+   _grid_clear(sd);
 
    /* Reset the writing position to (0,0) */
    sd->x = 0;
    sd->y = 0;
 }
 
+void
+termview_grid_clear(Evas_Object *obj)
+{
+   /* Contrary to termview_clear(), the cursor is left untouched */
+   s_termview *const sd = evas_object_smart_data_get(obj);
+   _grid_clear(sd);
+}
+
 void
 termview_eol_clear(Evas_Object *obj)
 {
    s_termview *const sd = evas_object_smart_data_get(obj);
-   Evas_Object *const grid = sd->textgrid;
+
+   if (EINA_UNLIKELY((sd->y >= sd->rows) || (sd->x >= sd->cols))) { return; }
 
    /*
     * Remove all characters from the cursor until the end of the textgrid line
     */
-   Evas_Textgrid_Cell *const cells = evas_object_textgrid_cellrow_get(
-      grid, (int)sd->y
-   );
-   memset(&cells[sd->x], 0, sizeof(Evas_Textgrid_Cell) * (sd->cols - sd->x));
-   evas_object_textgrid_cellrow_set(grid, (int)sd->y, cells);
-   evas_object_textgrid_update_add(grid, (int)sd->x, (int)sd->y,
-                                   (int)(sd->cols - sd->x), 1);
+   grid_eol_clear(sd->grid, sd->x, sd->y);
+   _grid_changed(sd);
+}
+
+static unsigned int
+_cells_write(s_termview *sd,
+             unsigned int col,
+             unsigned int row,
+             const Eina_Unicode *ustring,
+             unsigned int size)
+{
+   size = grid_put(sd->grid, col, row, ustring, size, sd->current);
+   _grid_changed(sd);
+   return size;
 }
 
 void
@@ -873,42 +1132,7 @@ termview_put(Evas_Object *obj,
 
    if (EINA_UNLIKELY(_unfinished_resizing_is(sd))) { return; }
 
-   Evas_Textgrid_Cell *const cells = evas_object_textgrid_cellrow_get(
-      sd->textgrid, (int)sd->y
-   );
-
-   if (EINA_UNLIKELY(sd->x + size > sd->cols))
-     {
-        ERR("String would overflow textgrid. Truncating.");
-        size = sd->cols - sd->x;
-     }
-
-   for (unsigned int x = 0; x < size; x++)
-     {
-        Evas_Textgrid_Cell *const c = &(cells[x + sd->x]);
-        c->codepoint = ustring[x];
-        if (sd->current.reverse)
-          {
-             if (sd->current.bg == COL_DEFAULT_BG)
-               c->fg = COL_REVERSE_FG;
-             else
-               c->fg = sd->current.bg;
-             c->bg = sd->current.fg;
-          }
-        else
-          {
-             c->fg = sd->current.fg;
-             c->bg = sd->current.bg;
-          }
-        c->bold = !!sd->current.bold;
-        c->italic = !!sd->current.italic;
-        c->underline = !!sd->current.underline;
-        c->bg_extended = 1;
-        c->fg_extended = 1;
-     }
-   evas_object_textgrid_cellrow_set(sd->textgrid, (int)sd->y, cells);
-   evas_object_textgrid_update_add(sd->textgrid,
-                                   (int)sd->x, (int)sd->y, (int)size, 1);
+   size = _cells_write(sd, sd->x, sd->y, ustring, size);
    termview_cursor_goto(obj, sd->x + size, sd->y);
 }
 
@@ -932,12 +1156,18 @@ termview_cursor_goto(Evas_Object *obj,
         to_x = sd->cols;
      }
 
-   Evas_Coord x, y;
-   evas_object_geometry_get(sd->textgrid, &x, &y, NULL, NULL);
-
    sd->x = to_x;
    sd->y = to_y;
-   sd->cursor_calc(sd, x, y);
+
+   /* The cursor is moved with the cells it points to */
+   if (sd->damage.batching || sd->grid->has_dirty)
+     sd->damage.cursor_dirty = EINA_TRUE;
+   else
+     {
+        Evas_Coord x, y;
+        evas_object_geometry_get(sd->textgrid, &x, &y, NULL, NULL);
+        sd->cursor_calc(sd, x, y);
+     }
 }
 
 
@@ -976,32 +1206,192 @@ termview_color_decompose(uint32_t col,
      }
 }
 
+static void
+_palette_evict(s_termview *sd,
+               uint8_t id,
+               Eina_Bool *evicted)
+{
+   eina_hash_del_by_key(sd->palette.ids, &(sd->palette.colors[id]));
+   sd->palette.free_ids[sd->palette.free_count++] = id;
+   sd->palette.stats.evictions++;
+   evicted[id] = EINA_TRUE;
+}
+
+static void
+_palette_repaint(s_termview *sd,
+                 uint8_t id)
+{
+   /*
+    * The palette is still displayed, but we have to recycle it anyway. The
+    * attributes that use it are given the default colors instead, and only
+    * the cells that use them are compared again to the textgrid. They are
+    * marked stale now, as their colors won't tell anymore that they used
+    * the evicted palette: they are resolved again from their style when
+    * they are used next.
+    */
+   for (unsigned int i = 0; i < sd->hl.count; i++)
+     {
+        s_hl_attr *const attr = &(sd->hl.attrs[i]);
+        if ((attr->fg != id) && (attr->bg != id)) { continue; }
+
+        if (attr->fg == id) attr->fg = COL_DEFAULT_FG;
+        if (attr->bg == id) attr->bg = COL_DEFAULT_BG;
+        attr->stale = EINA_TRUE;
+        grid_attr_dirty(sd->grid, (uint16_t)i);
+        sd->palette.stats.repainted_attrs++;
+     }
+}
+
+static void
+_palette_collect(s_termview *sd)
+{
+   /*
+    * All the palettes are taken. Find out which ones are used by the
+    * attributes of the shadow grid and by the cells of the textgrid (which
+    * may not have been presented yet). The ones that are used by the style
+    * being resolved (last used during the current tick) are also kept.
+    */
+   Eina_Bool used[256] = { EINA_FALSE };
+   Eina_Bool evicted[256] = { EINA_FALSE };
+   const s_grid *const grid = sd->grid;
+   Eina_Bool *const attr_used = calloc(sd->hl.count, sizeof(Eina_Bool));
+   if (EINA_LIKELY(attr_used != NULL))
+     {
+        for (unsigned int y = 0; y < grid->rows; y++)
+          {
+             const uint16_t *const attrs = grid_row_attrs_get(grid, y);
+             for (unsigned int x = 0; x < grid->cols; x++)
+               if (attrs[x] < sd->hl.count) attr_used[attrs[x]] = EINA_TRUE;
+          }
+        if (sd->current < sd->hl.count) attr_used[sd->current] = EINA_TRUE;
+        for (unsigned int i = 0; i < sd->hl.count; i++)
+          if (attr_used[i])
+            {
+               used[sd->hl.attrs[i].fg] = EINA_TRUE;
+               used[sd->hl.attrs[i].bg] = EINA_TRUE;
+            }
+        free(attr_used);
+     }
+   else
+     {
+        /* Without knowing which attributes are used, keep all of them */
+        ERR("Failed to allocate memory. All attributes are considered used");
+        for (unsigned int i = 0; i < sd->hl.count; i++)
+          {
+             used[sd->hl.attrs[i].fg] = EINA_TRUE;
+             used[sd->hl.attrs[i].bg] = EINA_TRUE;
+          }
+     }
+   for (unsigned int y = 0; y < sd->rows; y++)
+     {
+        const Evas_Textgrid_Cell *const cells =
+           evas_object_textgrid_cellrow_get(sd->textgrid, (int)y);
+        for (unsigned int x = 0; x < sd->cols; x++)
+          {
+             if (cells[x].fg_extended) used[cells[x].fg] = EINA_TRUE;
+             if (cells[x].bg_extended) used[cells[x].bg] = EINA_TRUE;
+          }
+     }
+
+   uint8_t candidates[256];
+   unsigned int candidates_count = 0;
+   uint8_t lru = 0;
+   for (unsigned int id = COL_GENERATOR_START; id <= UINT8_MAX; id++)
+     {
+        if (sd->palette.last_use[id] == sd->palette.tick) { continue; }
+        if ((lru == 0) ||
+            (sd->palette.last_use[id] < sd->palette.last_use[lru]))
+          lru = (uint8_t)id;
+        if (! used[id])
+          candidates[candidates_count++] = (uint8_t)id;
+     }
+
+   /*
+    * Palettes that are not displayed anymore are evicted, the least recently
+    * used first, by batches, so sweeping the textgrid stays rare. Palettes
+    * that were used recently are likely to be used again soon.
+    */
+   sd->palette.stats.sweeps++;
+   if (candidates_count > 0)
+     {
+        const unsigned int batch = MIN(candidates_count, PALETTE_EVICT_BATCH);
+        for (unsigned int i = 0; i < batch; i++)
+          {
+             /* Partial selection sort: bring the oldest candidate first */
+             unsigned int oldest = i;
+             for (unsigned int j = i + 1; j < candidates_count; j++)
+               if (sd->palette.last_use[candidates[j]] <
+                   sd->palette.last_use[candidates[oldest]])
+                 oldest = j;
+             const uint8_t id = candidates[oldest];
+             candidates[oldest] = candidates[i];
+             _palette_evict(sd, id, evicted);
+          }
+     }
+   else if (lru != 0)
+     {
+        /* Everything is displayed. Sacrifice the least recently used. */
+        WRN("All the palettes are displayed. Recycling palette %u", lru);
+        _palette_repaint(sd, lru);
+        _palette_evict(sd, lru, evicted);
+        sd->palette.stats.forced_evictions++;
+     }
+   DBG("Palette sweep: %u palettes evicted", sd->palette.free_count);
+
+   /* Highlight attributes that refer to evicted palettes must be resolved
+    * again before being used */
+   for (unsigned int i = 0; i < sd->hl.count; i++)
+     {
+        s_hl_attr *const attr = &(sd->hl.attrs[i]);
+        if (evicted[attr->fg] || evicted[attr->bg])
+          attr->stale = EINA_TRUE;
+     }
+}
+
 static uint8_t
 _make_palette(s_termview *sd,
               s_termview_color color)
 {
    if (color.a == 0x00) { return 0; }
 
-   const uint8_t *const id_ptr = eina_hash_find(sd->palettes, &color);
-   if (EINA_UNLIKELY(! id_ptr))
+   const uint8_t *const id_ptr = eina_hash_find(sd->palette.ids, &color);
+   if (EINA_LIKELY(id_ptr != NULL))
      {
-        const unsigned int id = sd->palette_id_generator++;
-        if (EINA_UNLIKELY(id > UINT8_MAX)) /* we have 256 colors max */
+        const uint8_t id = (uint8_t)(uintptr_t)(id_ptr);
+        sd->palette.last_use[id] = sd->palette.tick;
+        return id;
+     }
+
+   unsigned int id;
+   if (sd->palette.generator <= UINT8_MAX)
+     id = sd->palette.generator++;
+   else
+     {
+        if (sd->palette.free_count == 0)
+          {
+             TRACE_BEGIN("palette_collect");
+             _palette_collect(sd);
+             TRACE_END("palette_collect");
+          }
+        if (EINA_UNLIKELY(sd->palette.free_count == 0))
           {
-             CRI("Palettes overflow. Need to implement a backup!");
+             CRI("No palette could be recycled");
              return 0;
           }
+        id = sd->palette.free_ids[--sd->palette.free_count];
+     }
 
-        evas_object_textgrid_palette_set(
-           sd->textgrid, EVAS_TEXTGRID_PALETTE_EXTENDED,
-           (int)id,
-           color.r, color.g, color.b, color.a
-        );
+   evas_object_textgrid_palette_set(
+      sd->textgrid, EVAS_TEXTGRID_PALETTE_EXTENDED,
+      (int)id,
+      color.r, color.g, color.b, color.a
+   );
 
-        eina_hash_add(sd->palettes, &color, (void *)(uintptr_t)id);
-        return (uint8_t)id;
-     }
-   return (uint8_t)(uintptr_t)(id_ptr);
+   eina_hash_add(sd->palette.ids, &color, (void *)(uintptr_t)id);
+   sd->palette.colors[id] = color;
+   sd->palette.last_use[id] = sd->palette.tick;
+   sd->palette.stats.allocations++;
+   return (uint8_t)id;
 }
 
 static uint8_t
@@ -1021,18 +1411,32 @@ _make_palette_from_color(s_termview *sd,
      }
 }
 
-void
-termview_style_set(Evas_Object *obj,
-                   const s_termview_style *style)
+static void
+_attr_resolve(s_termview *sd,
+              const s_termview_style *style,
+              s_hl_attr *attr)
 {
-   s_termview *const sd = evas_object_smart_data_get(obj);
+   /* Palettes used by this style must not be recycled while it is being
+    * resolved: they are tagged with a new tick */
+   sd->palette.tick++;
 
-   sd->current.fg = _make_palette_from_color(sd, style->fg_color, EINA_TRUE);
-   sd->current.bg = _make_palette_from_color(sd, style->bg_color, EINA_FALSE);
-   sd->current.reverse = style->reverse;
-   sd->current.italic = style->italic;
-   sd->current.bold = style->bold;
-   sd->current.underline = style->underline || style->undercurl;
+   const uint8_t fg = _make_palette_from_color(sd, style->fg_color, EINA_TRUE);
+   const uint8_t bg = _make_palette_from_color(sd, style->bg_color, EINA_FALSE);
+
+   if (style->reverse)
+     {
+        attr->fg = (bg == COL_DEFAULT_BG) ? COL_REVERSE_FG : bg;
+        attr->bg = fg;
+     }
+   else
+     {
+        attr->fg = fg;
+        attr->bg = bg;
+     }
+   attr->italic = style->italic;
+   attr->bold = style->bold;
+   attr->underline = style->underline || style->undercurl;
+   attr->stale = EINA_FALSE;
 
    static Eina_Bool show_warning = EINA_TRUE;
    if (EINA_UNLIKELY(style->undercurl && show_warning))
@@ -1042,6 +1446,158 @@ termview_style_set(Evas_Object *obj,
      }
 }
 
+static Eina_Bool
+_hl_reserve(s_termview *sd,
+            unsigned int id)
+{
+   if (id < sd->hl.count) { return EINA_TRUE; }
+
+   unsigned int count = (sd->hl.count) ? sd->hl.count : 64;
+   while (count <= id) count *= 2;
+
+   s_termview_style *const styles =
+      realloc(sd->hl.styles, count * sizeof(s_termview_style));
+   if (EINA_UNLIKELY(! styles))
+     {
+        CRI("Failed to allocate memory for %u highlight styles", count);
+        return EINA_FALSE;
+     }
+   sd->hl.styles = styles;
+
+   s_hl_attr *const attrs = realloc(sd->hl.attrs, count * sizeof(s_hl_attr));
+   if (EINA_UNLIKELY(! attrs))
+     {
+        CRI("Failed to allocate memory for %u highlight attributes", count);
+        return EINA_FALSE;
+     }
+   /* Attributes that were not defined yet are the default ones */
+   for (unsigned int i = sd->hl.count; i < count; i++)
+     {
+        attrs[i] = _default_attr;
+        styles[i] = _default_style;
+     }
+   sd->hl.attrs = attrs;
+   sd->hl.count = count;
+   return EINA_TRUE;
+}
+
+static uint64_t
+_style_key(const s_termview_style *style)
+{
+   /*
+    * Colors are 24-bits values (or terminal colors), and -1 stands for the
+    * default color. Shifted by one, each of them fits in 25 bits. The special
+    * color is not rendered, so it is not part of the key.
+    */
+   const uint64_t fg = (uint64_t)(style->fg_color + 1) & 0x1ffffff;
+   const uint64_t bg = (uint64_t)(style->bg_color + 1) & 0x1ffffff;
+   return fg | (bg << 25)
+      | ((uint64_t)!!style->reverse << 50)
+      | ((uint64_t)!!style->italic << 51)
+      | ((uint64_t)!!style->bold << 52)
+      | ((uint64_t)!!style->underline << 53)
+      | ((uint64_t)!!style->undercurl << 54);
+}
+
+static void
+_attr_refresh(s_termview *sd,
+              unsigned int id)
+{
+   s_hl_attr *const attr = &(sd->hl.attrs[id]);
+   if (EINA_UNLIKELY(attr->stale))
+     {
+        /* Cells of the grid may use it: they must be compared again */
+        _attr_resolve(sd, &(sd->hl.styles[id]), attr);
+        grid_attr_dirty(sd->grid, (uint16_t)id);
+     }
+}
+
+void
+termview_style_set(Evas_Object *obj,
+                   const s_termview_style *style)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+
+   /*
+    * The legacy protocol sends the full style each time it changes, but
+    * there are only so many distinct styles. They are resolved once, and
+    * given an id in the highlight table. Ids are stored shifted by one, so
+    * a NULL value can be told apart.
+    */
+   const uint64_t key = _style_key(style);
+   const void *const data = eina_hash_find(sd->hl.legacy, &key);
+   if (EINA_LIKELY(data != NULL))
+     {
+        const unsigned int id = (unsigned int)((uintptr_t)data - 1);
+        _attr_refresh(sd, id);
+        sd->current = (uint16_t)id;
+        return;
+     }
+
+   /* Cells only have room for so many attributes */
+   const unsigned int id = sd->hl.legacy_next;
+   if (EINA_UNLIKELY((id > UINT16_MAX) || (! _hl_reserve(sd, id))))
+     {
+        ERR("Failed to register a new style. Using the default one.");
+        sd->current = 0;
+        return;
+     }
+   sd->hl.styles[id] = *style;
+   _attr_resolve(sd, style, &(sd->hl.attrs[id]));
+   eina_hash_add(sd->hl.legacy, &key, (void *)(uintptr_t)(id + 1));
+   sd->hl.legacy_next++;
+   sd->current = (uint16_t)id;
+}
+
+void
+termview_hl_attr_define(Evas_Object *obj,
+                        unsigned int id,
+                        const s_termview_style *style)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+   if (EINA_UNLIKELY(id > UINT16_MAX))
+     {
+        ERR("Highlight attribute %u is out of range", id);
+        return;
+     }
+   if (EINA_UNLIKELY(! _hl_reserve(sd, id))) { return; }
+
+   s_hl_attr *const attr = &(sd->hl.attrs[id]);
+   const s_hl_attr previous = *attr;
+   sd->hl.styles[id] = *style;
+   _attr_resolve(sd, style, attr);
+
+   /* A redefined attribute may already be used by cells of the grid */
+   if ((previous.fg != attr->fg) || (previous.bg != attr->bg) ||
+       (previous.bold != attr->bold) || (previous.italic != attr->italic) ||
+       (previous.underline != attr->underline))
+     grid_attr_dirty(sd->grid, (uint16_t)id);
+}
+
+void
+termview_cells_put(Evas_Object *obj,
+                   unsigned int col,
+                   unsigned int row,
+                   unsigned int hl_id,
+                   const Eina_Unicode *ustring,
+                   unsigned int size)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+
+   if (EINA_UNLIKELY(_unfinished_resizing_is(sd))) { return; }
+
+   if (EINA_LIKELY(hl_id < sd->hl.count))
+     {
+        _attr_refresh(sd, hl_id);
+        sd->current = (uint16_t)hl_id;
+     }
+   else
+     sd->current = 0;
+
+   /* Contrary to termview_put(), the cursor is not moved */
+   _cells_write(sd, col, row, ustring, size);
+}
+
 void
 termview_scroll_region_set(Evas_Object *obj,
                            const Eina_Rectangle *region)
@@ -1055,83 +1611,77 @@ termview_scroll(Evas_Object *obj,
                 int count)
 {
    s_termview *const sd = evas_object_smart_data_get(obj);
-   Evas_Object *const grid = sd->textgrid;
-   const size_t width = sizeof(Evas_Textgrid_Cell) * ((unsigned)sd->scroll.w + 1);
-   const int end_of_scroll = sd->scroll.y + sd->scroll.h;
-   Evas_Textgrid_Cell *src, *dst, *tmp;
 
-   if (count > 0) /* Scroll text upwards */
+   if (EINA_UNLIKELY((sd->scroll.x < 0) || (sd->scroll.y < 0) ||
+                     (sd->scroll.w < 0) || (sd->scroll.h < 0)))
      {
-        /*
-         * We are scrolling text upwards. Line N will be overwriten by line
-         * N+(count). The last lines are cleared.
-         *
-         * +------------------+     +------------------+
-         * | Line 0           |  ,> | Line 1           |
-         * +------------------+ /   +------------------+
-         * | Line 1           |' ,> | Line 2           |
-         * +------------------+ /   +------------------+
-         * | Line 2           |'    | xxxxxx           |
-         * +------------------+     +------------------+
-         *
-         */
+        ERR("Scrolling region is outside of the grid. Ignoring.");
+        return;
+     }
 
-        for (int i = sd->scroll.y + count; i <= end_of_scroll; i++)
-          {
-             const int j = i - count; /* destination */
+   /* The scrolling region holds the inclusive bounds of the scroll */
+   grid_scroll(sd->grid,
+               (unsigned int)sd->scroll.y,
+               (unsigned int)(sd->scroll.y + sd->scroll.h),
+               (unsigned int)sd->scroll.x,
+               (unsigned int)(sd->scroll.x + sd->scroll.w),
+               count);
+   _grid_changed(sd);
+}
 
-             dst = evas_object_textgrid_cellrow_get(grid, j);
-             src = evas_object_textgrid_cellrow_get(grid, i);
+void
+termview_damage_batch_begin(Evas_Object *obj)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+   sd->damage.batching = EINA_TRUE;
+   sd->damage.stats.batches++;
+}
 
-             memcpy(&dst[sd->scroll.x], &src[sd->scroll.x], width);
-             evas_object_textgrid_cellrow_set(grid, j, dst);
-          }
-        /* Clear the lines left after the scrolling */
-        for (int i = end_of_scroll; i > end_of_scroll - count; i--)
+void
+termview_damage_batch_end(Evas_Object *obj)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+   sd->damage.batching = EINA_FALSE;
+
+   /* The batch was not concluded by a flush. Wait for it, but not forever */
+   if ((sd->grid->has_dirty || sd->damage.cursor_dirty) && (! sd->damage.timer))
+     {
+        const double delay = (sd->damage.flush_aware)
+           ? SYNC_FLUSH_TIMEOUT
+           : SYNC_FALLBACK_DELAY;
+        sd->damage.timer = ecore_timer_add(delay, _present_timer_cb, sd);
+        if (EINA_UNLIKELY(! sd->damage.timer))
           {
-             tmp = evas_object_textgrid_cellrow_get(grid, i);
-             memset(&tmp[sd->scroll.x], 0, width);
-             evas_object_textgrid_cellrow_set(grid, i, tmp);
+             ERR("Failed to create timer. Presenting now.");
+             _present(sd);
           }
      }
-   else /* Scroll text downwards. count is NEGATIVE!!! */
-     {
-        /*
-         * We are scrolling text downwards. Line N+(count) will be overwriten
-         * by line N. The first lines are cleared.
-         *
-         * +------------------+     +------------------+
-         * | Line 0           |,    | xxxxxx           |
-         * +------------------+ \   +------------------+
-         * | Line 1           |, '> | Line 0           |
-         * +------------------+ \   +------------------+
-         * | Line 2           |  '> | Line 1           |
-         * +------------------+     +------------------+
-         *
-         */
-
-        for (int i = end_of_scroll; i >= sd->scroll.y - count; i--)
-          {
-             const int j = i + count; /* destination */
+}
 
-             dst = evas_object_textgrid_cellrow_get(grid, i);
-             src = evas_object_textgrid_cellrow_get(grid, j);
+void
+termview_flush(Evas_Object *obj)
+{
+   s_termview *const sd = evas_object_smart_data_get(obj);
+   sd->damage.flush_aware = EINA_TRUE;
+   _present(sd);
+}
 
-             memcpy(&dst[sd->scroll.x], &src[sd->scroll.x], width);
-             evas_object_textgrid_cellrow_set(grid, j, dst);
-          }
-        /* Clear the lines left after the scrolling */
-        for (int i = sd->scroll.y; i < sd->scroll.y - count; i++)
-          {
-             tmp = evas_object_textgrid_cellrow_get(grid, i);
-             memset(&tmp[sd->scroll.x], 0, width);
-             evas_object_textgrid_cellrow_set(grid, i, tmp);
-          }
-     }
+void
+termview_damage_stats_get(const Evas_Object *obj,
+                          s_termview_damage_stats *stats)
+{
+   const s_termview *const sd = evas_object_smart_data_get(obj);
+   *stats = sd->damage.stats;
+}
 
-   /* Finally, mark the update */
-   evas_object_textgrid_update_add(grid, sd->scroll.x, sd->scroll.y,
-                                   sd->scroll.w + 1, sd->scroll.h + 1);
+void
+termview_palette_stats_get(const Evas_Object *obj,
+                           s_termview_palette_stats *stats)
+{
+   const s_termview *const sd = evas_object_smart_data_get(obj);
+   *stats = sd->palette.stats;
+   stats->used = (sd->palette.generator - COL_GENERATOR_START)
+      - sd->palette.free_count;
 }
 
 void
@@ -1148,8 +1698,7 @@ termview_fg_color_set(Evas_Object *obj,
    );
 
    /* Update the whole textgrid to reflect the change */
-   evas_object_textgrid_update_add(sd->textgrid, 0, 0,
-                                   (int)sd->cols, (int)sd->rows);
+   _textgrid_update_all(sd);
 }
 
 void
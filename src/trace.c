@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/trace.h"
+#include "eovim/log.h"
+
+#include <Ecore.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Events are written in a ring by any thread, without lock: each writer
+ * reserves a slot with an atomic increment. When the ring is full, the oldest
+ * events are overwritten, so a dump holds the latest activity. Dumping while
+ * other threads are tracing may produce a few inconsistent events, which is
+ * fine for a debugging tool.
+ */
+
+/* Amount of events kept in the ring. Must be a power of 2. */
+#define TRACE_EVENTS_MAX (1u << 18)
+
+/* Amount of threads that can be named */
+#define TRACE_THREADS_MAX 16u
+
+typedef struct
+{
+   const char *name; /**< Static string */
+   uint64_t ns; /**< Monotonic timestamp */
+   uint32_t tid; /**< Eovim's identifier of the thread */
+   char phase; /**< 'B' (begin) or 'E' (end) */
+} s_trace_event;
+
+typedef struct
+{
+   const char *name;
+   uint32_t tid;
+} s_trace_thread;
+
+Eina_Bool _trace_enabled = EINA_FALSE;
+
+static s_trace_event *_events = NULL;
+static atomic_size_t _next;
+static uint64_t _origin; /**< Timestamp of trace_start() */
+static char *_path = NULL;
+static Ecore_Event_Handler *_signal_handler = NULL;
+
+static s_trace_thread _threads[TRACE_THREADS_MAX];
+static atomic_uint _threads_count;
+static atomic_uint _tid_next = 1u;
+static _Thread_local uint32_t _tid = 0u;
+
+static uint64_t
+_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t
+_tid_get(void)
+{
+   if (EINA_UNLIKELY(_tid == 0u))
+     _tid = atomic_fetch_add(&_tid_next, 1u);
+   return _tid;
+}
+
+static void
+_render_pre_cb(void *data EINA_UNUSED,
+               Evas *evas EINA_UNUSED,
+               void *info EINA_UNUSED)
+{
+   TRACE_BEGIN("render");
+}
+
+static void
+_render_post_cb(void *data EINA_UNUSED,
+                Evas *evas EINA_UNUSED,
+                void *info EINA_UNUSED)
+{
+   TRACE_END("render");
+}
+
+static Eina_Bool
+_signal_user_cb(void *data EINA_UNUSED,
+                int type EINA_UNUSED,
+                void *event)
+{
+   const Ecore_Event_Signal_User *const ev = event;
+
+   if ((ev->number == 1) && _trace_enabled)
+     {
+        INF("SIGUSR1 received. Dumping the trace in '%s'", _path);
+        trace_dump();
+     }
+   return ECORE_CALLBACK_PASS_ON;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+trace_init(void)
+{
+   _signal_handler = ecore_event_handler_add(ECORE_EVENT_SIGNAL_USER,
+                                             _signal_user_cb, NULL);
+   if (EINA_UNLIKELY(! _signal_handler))
+     {
+        CRI("Failed to create the handler for user signals");
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+void
+trace_shutdown(void)
+{
+   if (_trace_enabled)
+     {
+        trace_dump();
+        _trace_enabled = EINA_FALSE;
+     }
+   ecore_event_handler_del(_signal_handler);
+   free(_events);
+   free(_path);
+   _events = NULL;
+   _path = NULL;
+}
+
+Eina_Bool
+trace_start(const char *path)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(path, EINA_FALSE);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(_trace_enabled, EINA_FALSE);
+
+   _events = calloc(TRACE_EVENTS_MAX, sizeof(s_trace_event));
+   if (EINA_UNLIKELY(! _events))
+     {
+        CRI("Failed to allocate memory");
+        return EINA_FALSE;
+     }
+   _path = strdup(path);
+   if (EINA_UNLIKELY(! _path))
+     {
+        CRI("Failed to duplicate string '%s'", path);
+        free(_events);
+        _events = NULL;
+        return EINA_FALSE;
+     }
+
+   atomic_store(&_next, 0u);
+   _origin = _now();
+   _trace_enabled = EINA_TRUE;
+   trace_thread_name_set("main");
+   return EINA_TRUE;
+}
+
+void
+trace_event_add(const char *name,
+                char phase)
+{
+   const size_t slot = atomic_fetch_add(&_next, 1u) & (TRACE_EVENTS_MAX - 1u);
+   s_trace_event *const event = &(_events[slot]);
+
+   event->name = name;
+   event->ns = _now();
+   event->tid = _tid_get();
+   event->phase = phase;
+}
+
+void
+trace_thread_name_set(const char *name)
+{
+   if (! _trace_enabled) { return; }
+
+   const unsigned int idx = atomic_fetch_add(&_threads_count, 1u);
+   if (EINA_UNLIKELY(idx >= TRACE_THREADS_MAX))
+     {
+        WRN("Too many threads. '%s' will not be named in the trace", name);
+        return;
+     }
+   _threads[idx].name = name;
+   _threads[idx].tid = _tid_get();
+}
+
+void
+trace_evas_attach(Evas *evas)
+{
+   if (! _trace_enabled) { return; }
+
+   evas_event_callback_add(evas, EVAS_CALLBACK_RENDER_PRE,
+                           _render_pre_cb, NULL);
+   evas_event_callback_add(evas, EVAS_CALLBACK_RENDER_POST,
+                           _render_post_cb, NULL);
+}
+
+void
+trace_evas_detach(Evas *evas)
+{
+   if (! _trace_enabled) { return; }
+
+   evas_event_callback_del_full(evas, EVAS_CALLBACK_RENDER_PRE,
+                                _render_pre_cb, NULL);
+   evas_event_callback_del_full(evas, EVAS_CALLBACK_RENDER_POST,
+                                _render_post_cb, NULL);
+}
+
+Eina_Bool
+trace_dump(void)
+{
+   EINA_SAFETY_ON_FALSE_RETURN_VAL(_trace_enabled, EINA_FALSE);
+
+   FILE *const file = fopen(_path, "w");
+   if (EINA_UNLIKELY(! file))
+     {
+        ERR("Failed to open '%s': %s", _path, strerror(errno));
+        return EINA_FALSE;
+     }
+
+   const int pid = (int)getpid();
+   const size_t next = atomic_load(&_next);
+   const size_t count = (next > TRACE_EVENTS_MAX) ? TRACE_EVENTS_MAX : next;
+   const char *sep = "";
+
+   fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+
+   /* Name the threads, so the trace viewers show them as such */
+   unsigned int threads = atomic_load(&_threads_count);
+   if (threads > TRACE_THREADS_MAX) { threads = TRACE_THREADS_MAX; }
+   for (unsigned int i = 0; i < threads; i++)
+     {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":%i,\"tid\":%"PRIu32",\"args\":{\"name\":\"%s\"}}",
+                sep, pid, _threads[i].tid, _threads[i].name);
+        sep = ",";
+     }
+
+   /* Then the events, from the oldest one. Timestamps are in microseconds */
+   for (size_t i = next - count; i < next; i++)
+     {
+        const s_trace_event *const event =
+           &(_events[i & (TRACE_EVENTS_MAX - 1u)]);
+        if (EINA_UNLIKELY((! event->name) || (event->ns < _origin)))
+          continue;
+
+        const uint64_t ns = event->ns - _origin;
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%"PRIu64
+                ".%03u,\"pid\":%i,\"tid\":%"PRIu32"}",
+                sep, event->name, event->phase, ns / 1000u,
+                (unsigned int)(ns % 1000u), pid, event->tid);
+        sep = ",";
+     }
+   fputs("\n]}\n", file);
+
+   const Eina_Bool ok = (ferror(file) == 0);
+   if (EINA_UNLIKELY(fclose(file) != 0) || EINA_UNLIKELY(! ok))
+     {
+        ERR("Failed to write the trace in '%s'", _path);
+        return EINA_FALSE;
+     }
+   INF("Dumped %zu trace events in '%s'", count, _path);
+   return EINA_TRUE;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "eovim/types.h"
+#include "eovim/utf8.h"
+#include "eovim/log.h"
+
+/*
+ * Neovim sends UTF-8 text, and the textgrid wants codepoints. Eovim only
+ * decodes one codepoint at a time, as neovim sends one string per cell.
+ *
+ * With EOVIM_UTF8_BULK, whole strings can also be decoded. Most of the
+ * text is ASCII, and ASCII bytes are also codepoints: on x86, runs of ASCII
+ * bytes are widened 16 (SSE2) or 32 (AVX2) at a time. The first byte that
+ * is not ASCII is decoded by the scalar decoder, and the vectorized loop
+ * resumes after it. The best implementation is selected once, at init.
+ */
+
+/* What invalid sequences are decoded to */
+#define UTF8_REPLACEMENT_CHAR 0xfffd
+
+#ifdef EOVIM_UTF8_BULK
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define UTF8_X86 1
+# include <immintrin.h>
+#endif
+
+typedef unsigned int (*f_utf8_decode)(const char *str, unsigned int size,
+                                      Eina_Unicode *out);
+
+static unsigned int _decode_scalar(const char *str, unsigned int size, Eina_Unicode *out);
+#ifdef UTF8_X86
+static unsigned int _decode_sse2(const char *str, unsigned int size, Eina_Unicode *out);
+static unsigned int _decode_avx2(const char *str, unsigned int size, Eina_Unicode *out);
+#endif
+
+static const struct {
+   const char *const name;
+   const f_utf8_decode decode;
+} _impls[UTF8_IMPL_LAST] = {
+   [UTF8_IMPL_SCALAR] = { .name = "scalar", .decode = _decode_scalar },
+#ifdef UTF8_X86
+   [UTF8_IMPL_SSE2] = { .name = "sse2", .decode = _decode_sse2 },
+   [UTF8_IMPL_AVX2] = { .name = "avx2", .decode = _decode_avx2 },
+#else
+   [UTF8_IMPL_SSE2] = { .name = "sse2", .decode = NULL },
+   [UTF8_IMPL_AVX2] = { .name = "avx2", .decode = NULL },
+#endif
+};
+
+static e_utf8_impl _impl = UTF8_IMPL_SCALAR;
+
+
+static unsigned int
+_decode_scalar(const char *str,
+               unsigned int size,
+               Eina_Unicode *out)
+{
+   unsigned int i = 0, n = 0;
+   while (i < size)
+     {
+        const unsigned char c = (unsigned char)str[i];
+        if (c < 0x80)
+          {
+             out[n++] = c;
+             i++;
+          }
+        else
+          out[n++] = utf8_next_get(str, size, &i);
+     }
+   return n;
+}
+
+#ifdef UTF8_X86
+__attribute__((target("sse2")))
+static unsigned int
+_decode_sse2(const char *str,
+             unsigned int size,
+             Eina_Unicode *out)
+{
+   const __m128i zero = _mm_setzero_si128();
+   unsigned int i = 0, n = 0;
+
+   while (size - i >= 16)
+     {
+        const __m128i bytes =
+           _mm_loadu_si128((const __m128i *)(const void *)&str[i]);
+        const unsigned int mask = (unsigned int)_mm_movemask_epi8(bytes);
+        if (EINA_LIKELY(mask == 0))
+          {
+             /* 16 ASCII bytes: zero-extend them to 16 codepoints */
+             const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+             const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+             __m128i *const dst = (__m128i *)(void *)&out[n];
+             _mm_storeu_si128(&dst[0], _mm_unpacklo_epi16(lo, zero));
+             _mm_storeu_si128(&dst[1], _mm_unpackhi_epi16(lo, zero));
+             _mm_storeu_si128(&dst[2], _mm_unpacklo_epi16(hi, zero));
+             _mm_storeu_si128(&dst[3], _mm_unpackhi_epi16(hi, zero));
+             i += 16;
+             n += 16;
+             continue;
+          }
+
+        /* Copy the ASCII prefix, then decode the first non-ASCII character */
+        const unsigned int ascii = (unsigned int)__builtin_ctz(mask);
+        for (unsigned int k = 0; k < ascii; k++)
+          out[n++] = (unsigned char)str[i++];
+        out[n++] = utf8_next_get(str, size, &i);
+     }
+
+   return n + _decode_scalar(&str[i], size - i, &out[n]);
+}
+
+__attribute__((target("avx2")))
+static unsigned int
+_decode_avx2(const char *str,
+             unsigned int size,
+             Eina_Unicode *out)
+{
+   unsigned int i = 0, n = 0;
+
+   while (size - i >= 32)
+     {
+        const __m256i bytes =
+           _mm256_loadu_si256((const __m256i *)(const void *)&str[i]);
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(bytes);
+        if (EINA_LIKELY(mask == 0))
+          {
+             /* 32 ASCII bytes: zero-extend them, 8 at a time */
+             for (unsigned int k = 0; k < 32; k += 8)
+               {
+                  const __m128i chunk =
+                     _mm_loadl_epi64((const __m128i *)(const void *)&str[i + k]);
+                  _mm256_storeu_si256((__m256i *)(void *)&out[n + k],
+                                      _mm256_cvtepu8_epi32(chunk));
+               }
+             i += 32;
+             n += 32;
+             continue;
+          }
+
+        const unsigned int ascii = (unsigned int)__builtin_ctz(mask);
+        for (unsigned int k = 0; k < ascii; k++)
+          out[n++] = (unsigned char)str[i++];
+        out[n++] = utf8_next_get(str, size, &i);
+     }
+
+   /* Less than 32 bytes are left */
+   return n + _decode_sse2(&str[i], size - i, &out[n]);
+}
+#endif /* UTF8_X86 */
+
+static Eina_Bool
+_impl_supported(e_utf8_impl impl)
+{
+   switch (impl)
+     {
+      case UTF8_IMPL_SCALAR:
+         return EINA_TRUE;
+
+#ifdef UTF8_X86
+      case UTF8_IMPL_SSE2:
+         return __builtin_cpu_supports("sse2") ? EINA_TRUE : EINA_FALSE;
+
+      case UTF8_IMPL_AVX2:
+         return __builtin_cpu_supports("avx2") ? EINA_TRUE : EINA_FALSE;
+#endif
+
+      default:
+         return EINA_FALSE;
+     }
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+utf8_init(void)
+{
+#ifdef UTF8_X86
+   __builtin_cpu_init();
+#endif
+
+   /* Select the best implementation the CPU supports */
+   for (int impl = UTF8_IMPL_LAST - 1; impl >= UTF8_IMPL_SCALAR; impl--)
+     {
+        if (utf8_impl_set((e_utf8_impl)impl))
+          break;
+     }
+   DBG("UTF-8 decoding uses the %s implementation", _impls[_impl].name);
+   return EINA_TRUE;
+}
+
+void
+utf8_shutdown(void)
+{
+   _impl = UTF8_IMPL_SCALAR;
+}
+
+Eina_Bool
+utf8_impl_set(e_utf8_impl impl)
+{
+   if ((impl >= UTF8_IMPL_LAST) || (! _impls[impl].decode) ||
+       (! _impl_supported(impl)))
+     return EINA_FALSE;
+   _impl = impl;
+   return EINA_TRUE;
+}
+
+e_utf8_impl
+utf8_impl_get(void)
+{
+   return _impl;
+}
+
+const char *
+utf8_impl_name_get(e_utf8_impl impl)
+{
+   return (impl < UTF8_IMPL_LAST) ? _impls[impl].name : NULL;
+}
+
+unsigned int
+utf8_decode(const char *str,
+            unsigned int size,
+            Eina_Unicode *out)
+{
+   /* @p out must have room for @p size codepoints: one per byte at most */
+   return _impls[_impl].decode(str, size, out);
+}
+
+#endif /* EOVIM_UTF8_BULK */
+
+Eina_Unicode
+utf8_next_get(const char *str,
+              unsigned int size,
+              unsigned int *index)
+{
+   const unsigned char *const s = (const unsigned char *)str;
+   const unsigned int i = *index;
+   if (EINA_UNLIKELY(i >= size)) { return 0; }
+
+   const unsigned char c = s[i];
+   unsigned int len;
+   Eina_Unicode cp, min;
+
+   if (c < 0x80)
+     {
+        *index = i + 1;
+        return c;
+     }
+   else if ((c & 0xe0) == 0xc0) { len = 2; cp = c & 0x1f; min = 0x80; }
+   else if ((c & 0xf0) == 0xe0) { len = 3; cp = c & 0x0f; min = 0x800; }
+   else if ((c & 0xf8) == 0xf0) { len = 4; cp = c & 0x07; min = 0x10000; }
+   else { goto invalid; }
+
+   /* Strings are not NUL-terminated: never read past their end */
+   if (EINA_UNLIKELY(len > size - i)) { goto invalid; }
+   for (unsigned int k = 1; k < len; k++)
+     {
+        const unsigned char cc = s[i + k];
+        if (EINA_UNLIKELY((cc & 0xc0) != 0x80)) { goto invalid; }
+        cp = (cp << 6) | (cc & 0x3f);
+     }
+
+   /* Overlong encodings, surrogates and out of range values are invalid */
+   if (EINA_UNLIKELY((cp < min) || (cp > 0x10ffff) ||
+                     ((cp >= 0xd800) && (cp <= 0xdfff))))
+     goto invalid;
+
+   *index = i + len;
+   return cp;
+
+invalid:
+   *index = i + 1;
+   return UTF8_REPLACEMENT_CHAR;
+}
@@ -0,0 +1,875 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * fakenvim stands in for neovim: eovim runs it through its --nvim option. It
+ * speaks msgpack-rpc on its standard input and output, answers the requests
+ * that eovim sends, and draws a blank screen. It can then emit a "storm" of
+ * synthetic redraw batches at a configurable rate. This load-tests eovim's
+ * ingestion and rendering without neovim, with the same data on every run.
+ *
+ *   eovim --nvim fakenvim [fakenvim options]
+ *
+ * eovim forwards the options it does not know to neovim, so fakenvim's
+ * options go on eovim's command line. fakenvim ignores the arguments it
+ * does not know (e.g. --embed, or files to open).
+ *
+ * Requests are answered as follows:
+ *   - nvim_command_output: the version for ":version", no color for
+ *     synIDattr() queries, and an empty string otherwise,
+ *   - nvim_ui_attach and nvim_ui_try_resize: the screen is (re)drawn,
+ *   - nvim_input: the number of bytes that were given,
+ *   - nvim_command: ":quitall" and its friends terminate fakenvim,
+ *   - nvim_set_var: g:eovim_stats is checked (see --check-stats),
+ *   - anything else: nil.
+ * Notifications have the same effects, but get no response.
+ *
+ * With --check-stats, fakenvim asks eovim for its statistics once the storm
+ * is over, and compares them with what it emitted. It exits with a failure
+ * if they differ, or if eovim never sent them. Eovim exits with the status
+ * of neovim, so the test fails with it.
+ */
+
+#include <msgpack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+/* Amount of bytes we are ready to receive from eovim in one read() */
+#define FAKENVIM_CHUNK_SIZE (64u * 1024u)
+
+/* The only grid of ext_linegrid */
+#define GRID 1u
+
+/* Highlight attributes defined for the storm, besides the default one */
+#define HL_COUNT 4u
+
+static const char _usage[] =
+   "Usage: fakenvim [options]\n"
+   "\n"
+   "Options:\n"
+   "  --fake-version <X.Y.Z>  Version of neovim to pretend to be (0.4.0)\n"
+   "  --storm-count <N>       Emit N redraw batches once attached (0)\n"
+   "  --storm-rate <R>        Emit R batches per second, or as fast as\n"
+   "                          possible if R is 0 (60)\n"
+   "  --storm-lines <L>       Lines redrawn by each batch (all)\n"
+   "  --storm-scroll          Each batch scrolls the screen by one line\n"
+   "  --storm-seed <S>        Seed of the pseudo-random contents (1)\n"
+   "  --quit-after-storm      Exit once the storm is over\n"
+   "  --check-stats           Check eovim's statistics once the storm is\n"
+   "                          over, and fail if they are wrong\n"
+   "  --verbose               Report what was emitted on stderr at exit\n"
+   ;
+
+typedef struct
+{
+   unsigned int major;
+   unsigned int minor;
+   unsigned int patch;
+   unsigned long storm_count;
+   double storm_rate;
+   unsigned int storm_lines; /**< 0 means all the lines */
+   uint32_t storm_seed;
+   bool storm_scroll;
+   bool quit_after_storm;
+   bool check_stats;
+   bool verbose;
+} s_options;
+
+/* What was emitted, which eovim should report in its statistics */
+typedef struct
+{
+   unsigned long long bytes; /**< Bytes written on stdout */
+   unsigned long messages;
+   unsigned long cursor_gotos; /**< Calls to (grid_)cursor_goto */
+   unsigned long flushes;
+} s_counts;
+
+static struct
+{
+   s_options opts;
+   msgpack_sbuffer sbuffer; /**< Messages waiting to be written */
+   msgpack_packer packer;
+   unsigned int cols;
+   unsigned int rows;
+   char *line; /**< Contents of the line being packed (cols bytes) */
+   bool attached;
+   bool linegrid;
+   bool quit;
+   bool checked; /**< Eovim's statistics were received */
+   bool failed; /**< Eovim's statistics were wrong */
+
+   uint32_t rng;
+   unsigned long batches; /**< Batches of the storm emitted so far */
+   unsigned int next_row; /**< First row redrawn by the next batch */
+   uint64_t next_batch; /**< When the next batch is due */
+   uint64_t storm_start;
+   uint64_t storm_end;
+   s_counts sent;
+   s_counts requested; /**< What was sent when the statistics were asked */
+} _fake;
+
+static uint64_t
+_now_get(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t
+_rand(void)
+{
+   /* xorshift32: the contents of a storm only depend on the seed */
+   uint32_t x = _fake.rng;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return _fake.rng = x;
+}
+
+/*============================================================================*
+ *                                   Output                                   *
+ *============================================================================*/
+
+static bool
+_output_flush(void)
+{
+   const char *data = _fake.sbuffer.data;
+   size_t size = _fake.sbuffer.size;
+
+   while (size > 0)
+     {
+        const ssize_t bytes = write(STDOUT_FILENO, data, size);
+        if (bytes < 0)
+          {
+             if (errno == EINTR) { continue; }
+             fprintf(stderr, "fakenvim: failed to write: %s\n", strerror(errno));
+             return false;
+          }
+        data += bytes;
+        size -= (size_t)bytes;
+        _fake.sent.bytes += (unsigned long long)bytes;
+     }
+   msgpack_sbuffer_clear(&_fake.sbuffer);
+   return true;
+}
+
+static void
+_str_pack(const char *str,
+          size_t len)
+{
+   msgpack_pack_str(&_fake.packer, len);
+   msgpack_pack_str_body(&_fake.packer, str, len);
+}
+
+#define STR_PACK(Literal) _str_pack(Literal, sizeof(Literal) - 1)
+
+static void
+_uints_pack(unsigned int count, ...)
+{
+   msgpack_packer *const pk = &_fake.packer;
+   va_list args;
+
+   msgpack_pack_array(pk, count);
+   va_start(args, count);
+   for (unsigned int i = 0; i < count; i++)
+     msgpack_pack_uint32(pk, va_arg(args, unsigned int));
+   va_end(args);
+}
+
+static void
+_redraw_begin(unsigned int commands)
+{
+   /* [2, "redraw", [commands...]] */
+   _fake.sent.messages++;
+   msgpack_pack_array(&_fake.packer, 3);
+   msgpack_pack_int(&_fake.packer, 2);
+   STR_PACK("redraw");
+   msgpack_pack_array(&_fake.packer, commands);
+}
+
+static void
+_command_begin(const char *name,
+               unsigned int calls)
+{
+   /* [name, args of the 1st call, args of the 2nd call, ...] */
+   msgpack_pack_array(&_fake.packer, calls + 1);
+   _str_pack(name, strlen(name));
+}
+
+/*============================================================================*
+ *                                   Screen                                   *
+ *============================================================================*/
+
+static void
+_hl_attr_pack(unsigned int id)
+{
+   static const char *const styles[HL_COUNT] = {
+      NULL, "bold", "italic", "reverse",
+   };
+   static const uint32_t colors[HL_COUNT] = {
+      0xd70000, 0x5faf00, 0xffaf00, 0x0087ff,
+   };
+   msgpack_packer *const pk = &_fake.packer;
+   const unsigned int i = id - 1;
+
+   /* [id, rgb_attr, cterm_attr, info] */
+   msgpack_pack_array(pk, 4);
+   msgpack_pack_uint32(pk, id);
+   msgpack_pack_map(pk, (styles[i]) ? 2 : 1);
+   STR_PACK("foreground");
+   msgpack_pack_uint32(pk, colors[i]);
+   if (styles[i])
+     {
+        _str_pack(styles[i], strlen(styles[i]));
+        msgpack_pack_true(pk);
+     }
+   msgpack_pack_map(pk, 0);
+   msgpack_pack_array(pk, 0);
+}
+
+static void
+_screen_draw(void)
+{
+   /* Give eovim the size of the screen, and clear it */
+   if (_fake.linegrid)
+     {
+        _redraw_begin(6);
+        _command_begin("default_colors_set", 1);
+        _uints_pack(5, 0xd0d0d0, 0x1c1c1c, 0xff0000, 0, 0);
+        _command_begin("hl_attr_define", HL_COUNT);
+        for (unsigned int id = 1; id <= HL_COUNT; id++)
+          _hl_attr_pack(id);
+        _command_begin("grid_resize", 1);
+        _uints_pack(3, GRID, _fake.cols, _fake.rows);
+        _command_begin("grid_clear", 1);
+        _uints_pack(1, GRID);
+        _command_begin("grid_cursor_goto", 1);
+        _uints_pack(3, GRID, 0, 0);
+        _command_begin("flush", 1);
+        _uints_pack(0);
+        _fake.sent.cursor_gotos++;
+        _fake.sent.flushes++;
+     }
+   else
+     {
+        _redraw_begin(5);
+        _command_begin("resize", 1);
+        _uints_pack(2, _fake.cols, _fake.rows);
+        _command_begin("update_fg", 1);
+        _uints_pack(1, 0xd0d0d0);
+        _command_begin("update_bg", 1);
+        _uints_pack(1, 0x1c1c1c);
+        _command_begin("clear", 1);
+        _uints_pack(0);
+        _command_begin("cursor_goto", 1);
+        _uints_pack(2, 0, 0);
+        _fake.sent.cursor_gotos++;
+     }
+}
+
+static unsigned int
+_line_make(void)
+{
+   /* Random words, followed by blanks. Returns the length of the text. */
+   char *const cells = _fake.line;
+   const unsigned int text = _fake.cols - _rand() % (_fake.cols / 4u + 1u);
+   for (unsigned int col = 0; col < text; col++)
+     cells[col] = (_rand() % 6u == 0) ? ' ' : (char)('a' + _rand() % 26u);
+   return text;
+}
+
+static void
+_grid_line_pack(unsigned int row,
+                unsigned int text)
+{
+   /*
+    * [grid, row, col_start, cells], with one cell per column. Each word has
+    * a random attribute, which is given only by its first cell. The trailing
+    * blanks are packed as one repeated cell.
+    */
+   msgpack_packer *const pk = &_fake.packer;
+   const char *const cells = _fake.line;
+   const bool blanks = (text < _fake.cols);
+
+   msgpack_pack_array(pk, 4);
+   msgpack_pack_uint32(pk, GRID);
+   msgpack_pack_uint32(pk, row);
+   msgpack_pack_uint32(pk, 0);
+   msgpack_pack_array(pk, text + (blanks ? 1 : 0));
+   for (unsigned int col = 0; col < text; col++)
+     {
+        const bool word_start =
+           (cells[col] != ' ') && ((col == 0) || (cells[col - 1] == ' '));
+        msgpack_pack_array(pk, (word_start) ? 2 : 1);
+        _str_pack(&cells[col], 1);
+        if (word_start)
+          msgpack_pack_uint32(pk, _rand() % (HL_COUNT + 1u));
+     }
+   if (blanks)
+     {
+        msgpack_pack_array(pk, 3);
+        STR_PACK(" ");
+        msgpack_pack_uint32(pk, 0);
+        msgpack_pack_uint32(pk, _fake.cols - text);
+     }
+}
+
+static void
+_put_pack(unsigned int row,
+          unsigned int text)
+{
+   /* cursor_goto, highlight_set, put (one argument per cell), eol_clear */
+   msgpack_packer *const pk = &_fake.packer;
+   const char *const cells = _fake.line;
+
+   _command_begin("cursor_goto", 1);
+   _uints_pack(2, row, 0);
+   _fake.sent.cursor_gotos++;
+
+   _command_begin("highlight_set", 1);
+   msgpack_pack_array(pk, 1);
+   msgpack_pack_map(pk, 1);
+   STR_PACK("foreground");
+   msgpack_pack_uint32(pk, 0x5faf00 + _rand() % 0x80u);
+
+   _command_begin("put", text);
+   for (unsigned int col = 0; col < text; col++)
+     {
+        msgpack_pack_array(pk, 1);
+        _str_pack(&cells[col], 1);
+     }
+
+   _command_begin("eol_clear", 1);
+   _uints_pack(0);
+}
+
+static void
+_storm_batch_pack(void)
+{
+   const unsigned int lines =
+      ((_fake.opts.storm_lines == 0) || (_fake.opts.storm_lines > _fake.rows))
+      ? _fake.rows : _fake.opts.storm_lines;
+   const bool scroll = _fake.opts.storm_scroll;
+
+   /* When scrolling, the lines that are redrawn are the last ones */
+   unsigned int row = (scroll) ? _fake.rows - lines : _fake.next_row;
+   _fake.next_row = (_fake.next_row + lines) % _fake.rows;
+
+   if (_fake.linegrid)
+     {
+        _redraw_begin((scroll) ? 4 : 3);
+        if (scroll)
+          {
+             /* [grid, top, bot, left, right, rows, cols] */
+             _command_begin("grid_scroll", 1);
+             _uints_pack(7, GRID, 0, _fake.rows, 0, _fake.cols, 1, 0);
+          }
+        _command_begin("grid_line", lines);
+        for (unsigned int i = 0; i < lines; i++)
+          {
+             _grid_line_pack(row, _line_make());
+             row = (row + 1) % _fake.rows;
+          }
+        _command_begin("grid_cursor_goto", 1);
+        _uints_pack(3, GRID, row, 0);
+        _command_begin("flush", 1);
+        _uints_pack(0);
+        _fake.sent.cursor_gotos++;
+        _fake.sent.flushes++;
+     }
+   else
+     {
+        _redraw_begin(((scroll) ? 2 : 0) + 4 * lines);
+        if (scroll)
+          {
+             _command_begin("set_scroll_region", 1);
+             _uints_pack(4, 0, _fake.rows - 1, 0, _fake.cols - 1);
+             _command_begin("scroll", 1);
+             _uints_pack(1, 1);
+          }
+        for (unsigned int i = 0; i < lines; i++)
+          {
+             _put_pack(row, _line_make());
+             row = (row + 1) % _fake.rows;
+          }
+     }
+}
+
+static void
+_stats_request(void)
+{
+   /* [2, "eovim", [["stats"]]]: eovim answers with nvim_set_var() */
+   msgpack_packer *const pk = &_fake.packer;
+   _fake.sent.messages++;
+   msgpack_pack_array(pk, 3);
+   msgpack_pack_int(pk, 2);
+   STR_PACK("eovim");
+   msgpack_pack_array(pk, 1);
+   msgpack_pack_array(pk, 1);
+   STR_PACK("stats");
+
+   /* Including what is still to be written, this notification included */
+   _fake.requested = _fake.sent;
+   _fake.requested.bytes += _fake.sbuffer.size;
+}
+
+static bool
+_storm_pending(void)
+{
+   return (_fake.attached && (_fake.batches < _fake.opts.storm_count));
+}
+
+static int
+_storm_timeout_get(void)
+{
+   /* Milliseconds to wait for eovim before the next batch is due */
+   if (! _storm_pending()) { return -1; }
+
+   const uint64_t now = _now_get();
+   if (now >= _fake.next_batch) { return 0; }
+   return (int)((_fake.next_batch - now + 999999u) / 1000000u);
+}
+
+static void
+_storm_run(void)
+{
+   const uint64_t now = _now_get();
+   if ((! _storm_pending()) || (now < _fake.next_batch)) { return; }
+
+   if (_fake.batches == 0) { _fake.storm_start = now; }
+   _storm_batch_pack();
+   _fake.batches++;
+
+   /* Batches are due at a fixed pace, however late this one was */
+   if (_fake.opts.storm_rate > 0.0)
+     _fake.next_batch = _fake.storm_start +
+        (uint64_t)((double)_fake.batches * 1e9 / _fake.opts.storm_rate);
+
+   if (_fake.batches == _fake.opts.storm_count)
+     {
+        _fake.storm_end = _now_get();
+        if (_fake.opts.check_stats) { _stats_request(); }
+        else if (_fake.opts.quit_after_storm) { _fake.quit = true; }
+     }
+}
+
+/*============================================================================*
+ *                                  Requests                                  *
+ *============================================================================*/
+
+static bool
+_str_is(const msgpack_object_str *str,
+        const char *name)
+{
+   return ((str->size == strlen(name)) &&
+           (! memcmp(str->ptr, name, str->size)));
+}
+
+static bool
+_str_contains(const msgpack_object_str *str,
+              const char *needle)
+{
+   const size_t len = strlen(needle);
+   for (size_t i = 0; i + len <= str->size; i++)
+     if (! memcmp(&(str->ptr[i]), needle, len))
+       return true;
+   return false;
+}
+
+static bool
+_linegrid_requested(const msgpack_object_array *params)
+{
+   if ((params->size < 3) || (params->ptr[2].type != MSGPACK_OBJECT_MAP))
+     return false;
+
+   const msgpack_object_map *const opts = &(params->ptr[2].via.map);
+   for (unsigned int i = 0; i < opts->size; i++)
+     {
+        const msgpack_object_kv *const kv = &(opts->ptr[i]);
+        if ((kv->key.type == MSGPACK_OBJECT_STR) &&
+            _str_is(&(kv->key.via.str), "ext_linegrid") &&
+            (kv->val.type == MSGPACK_OBJECT_BOOLEAN))
+          return kv->val.via.boolean;
+     }
+   return false;
+}
+
+static bool
+_resize(const msgpack_object_array *params)
+{
+   if ((params->size < 2) ||
+       (params->ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER) ||
+       (params->ptr[1].type != MSGPACK_OBJECT_POSITIVE_INTEGER) ||
+       (params->ptr[0].via.u64 == 0) || (params->ptr[1].via.u64 == 0) ||
+       (params->ptr[0].via.u64 > UINT16_MAX) ||
+       (params->ptr[1].via.u64 > UINT16_MAX))
+     {
+        fprintf(stderr, "fakenvim: invalid screen size\n");
+        return false;
+     }
+
+   const unsigned int cols = (unsigned int)params->ptr[0].via.u64;
+   char *const line = realloc(_fake.line, cols);
+   if (! line)
+     {
+        fprintf(stderr, "fakenvim: failed to allocate memory\n");
+        return false;
+     }
+   _fake.line = line;
+   _fake.cols = cols;
+   _fake.rows = (unsigned int)params->ptr[1].via.u64;
+   _fake.next_row = 0;
+   return true;
+}
+
+static void
+_result_pack(uint32_t id,
+             const msgpack_object_str *method,
+             const msgpack_object_str *arg)
+{
+   /* [1, id, nil, result] */
+   msgpack_packer *const pk = &_fake.packer;
+   _fake.sent.messages++;
+   msgpack_pack_array(pk, 4);
+   msgpack_pack_int(pk, 1);
+   msgpack_pack_uint32(pk, id);
+   msgpack_pack_nil(pk);
+
+   if (_str_is(method, "nvim_command_output") && arg &&
+       _str_contains(arg, "version"))
+     {
+        char version[64];
+        const int len = snprintf(version, sizeof(version),
+                                 "\nNVIM v%u.%u.%u\nfakenvim",
+                                 _fake.opts.major, _fake.opts.minor,
+                                 _fake.opts.patch);
+        _str_pack(version, (size_t)len);
+     }
+   else if (_str_is(method, "nvim_command_output") && arg &&
+            _str_contains(arg, "synIDattr"))
+     STR_PACK("\n"); /* No color */
+   else if (_str_is(method, "nvim_command_output"))
+     STR_PACK("");
+   else if (_str_is(method, "nvim_input"))
+     msgpack_pack_uint32(pk, (arg) ? arg->size : 0);
+   else
+     msgpack_pack_nil(pk);
+}
+
+static const msgpack_object *
+_map_get(const msgpack_object *obj,
+         const char *key)
+{
+   if ((! obj) || (obj->type != MSGPACK_OBJECT_MAP)) { return NULL; }
+
+   const msgpack_object_map *const map = &(obj->via.map);
+   for (unsigned int i = 0; i < map->size; i++)
+     {
+        const msgpack_object_kv *const kv = &(map->ptr[i]);
+        if ((kv->key.type == MSGPACK_OBJECT_STR) &&
+            _str_is(&(kv->key.via.str), key))
+          return &(kv->val);
+     }
+   return NULL;
+}
+
+static void
+_stat_check(const msgpack_object *stats,
+            const char *group,
+            const char *key,
+            unsigned long long min,
+            unsigned long long max)
+{
+   /* Statistics are in g:eovim_stats, or in one of its maps */
+   const msgpack_object *const obj =
+      _map_get((group) ? _map_get(stats, group) : stats, key);
+   if ((! obj) || (obj->type != MSGPACK_OBJECT_POSITIVE_INTEGER))
+     {
+        fprintf(stderr, "fakenvim: eovim did not report '%s'\n", key);
+        _fake.failed = true;
+     }
+   else if ((obj->via.u64 < min) || (obj->via.u64 > max))
+     {
+        fprintf(stderr, "fakenvim: eovim reported %llu for '%s', "
+                "but %llu to %llu were expected\n",
+                (unsigned long long)obj->via.u64, key, min, max);
+        _fake.failed = true;
+     }
+}
+
+static void
+_stats_check(const msgpack_object_array *params)
+{
+   /*
+    * Eovim has received everything that was sent before the statistics were
+    * asked, and drawn it. It may have received some of what was sent since
+    * (e.g. answers to its requests), but nothing more.
+    */
+   const s_counts *const min = &_fake.requested;
+   const s_counts *const max = &_fake.sent;
+   const msgpack_object *const stats = (params->size == 2)
+      ? &(params->ptr[1]) : NULL;
+
+   _stat_check(stats, NULL, "bytes_in", min->bytes, max->bytes);
+   _stat_check(stats, NULL, "messages", min->messages, max->messages);
+   _stat_check(stats, "redraw",
+               (_fake.linegrid) ? "grid_cursor_goto" : "cursor_goto",
+               min->cursor_gotos, max->cursor_gotos);
+   if (_fake.linegrid)
+     _stat_check(stats, "redraw", "flush", min->flushes, max->flushes);
+
+   _fake.checked = true;
+   if (_fake.opts.quit_after_storm) { _fake.quit = true; }
+}
+
+static void
+_effects_apply(const msgpack_object_str *method,
+               const msgpack_object_array *params,
+               const msgpack_object_str *arg)
+{
+   if (_str_is(method, "nvim_ui_attach"))
+     {
+        if (! _resize(params)) { return; }
+        _fake.linegrid = _linegrid_requested(params);
+        _fake.attached = true;
+        _fake.next_batch = _now_get();
+        _screen_draw();
+     }
+   else if (_str_is(method, "nvim_ui_try_resize"))
+     {
+        if (_fake.attached && _resize(params))
+          _screen_draw();
+     }
+   else if (_str_is(method, "nvim_command") && arg &&
+            (_str_contains(arg, "qa") || _str_contains(arg, "quit")))
+     _fake.quit = true;
+   else if (_str_is(method, "nvim_set_var") && arg &&
+            _str_is(arg, "eovim_stats") && _fake.opts.check_stats)
+     _stats_check(params);
+}
+
+static void
+_message_handle(const msgpack_object *obj)
+{
+   /*
+    * Requests are [0, id, method, params], notifications [2, method, params].
+    * Eovim packs methods as BIN strings, which share the layout of STR.
+    */
+   if ((obj->type != MSGPACK_OBJECT_ARRAY) || (obj->via.array.size < 3) ||
+       (obj->via.array.ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER))
+     goto fail;
+
+   const msgpack_object_array *const msg = &(obj->via.array);
+   const uint64_t type = msg->ptr[0].via.u64;
+   const unsigned int first = (type == 0) ? 2 : 1;
+   if (((type != 0) && (type != 2)) || (msg->size != first + 2) ||
+       ((msg->ptr[first].type != MSGPACK_OBJECT_STR) &&
+        (msg->ptr[first].type != MSGPACK_OBJECT_BIN)) ||
+       (msg->ptr[first + 1].type != MSGPACK_OBJECT_ARRAY))
+     goto fail;
+
+   const msgpack_object_str *const method = &(msg->ptr[first].via.str);
+   const msgpack_object_array *const params = &(msg->ptr[first + 1].via.array);
+   const msgpack_object_str *const arg =
+      ((params->size > 0) && (params->ptr[0].type == MSGPACK_OBJECT_STR))
+      ? &(params->ptr[0].via.str) : NULL;
+
+   /* The response comes before the effects of the request */
+   if (type == 0)
+     _result_pack((uint32_t)msg->ptr[1].via.u64, method, arg);
+   _effects_apply(method, params, arg);
+   return;
+
+fail:
+   fprintf(stderr, "fakenvim: unexpected message\n");
+}
+
+/*============================================================================*
+ *                                    Main                                    *
+ *============================================================================*/
+
+static bool
+_options_parse(int argc,
+               char **argv,
+               s_options *opts)
+{
+   opts->minor = 4;
+   opts->storm_rate = 60.0;
+   opts->storm_seed = 1;
+
+   for (int i = 1; i < argc; i++)
+     {
+        const char *const it = argv[i];
+        const char *const next = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        /* Anything that is not ours is meant for neovim, and ignored */
+
+        if (! strcmp(it, "--storm-scroll")) { opts->storm_scroll = true; }
+        else if (! strcmp(it, "--quit-after-storm")) { opts->quit_after_storm = true; }
+        else if (! strcmp(it, "--check-stats")) { opts->check_stats = true; }
+        else if (! strcmp(it, "--verbose")) { opts->verbose = true; }
+        else if (! strcmp(it, "--help"))
+          {
+             fputs(_usage, stdout);
+             exit(EXIT_SUCCESS);
+          }
+        else if (! next) { continue; } /* The others expect an argument */
+        else if (! strcmp(it, "--fake-version"))
+          {
+             if (sscanf(next, "%u.%u.%u", &opts->major, &opts->minor,
+                        &opts->patch) != 3)
+               goto fail;
+             i++;
+          }
+        else if (! strcmp(it, "--storm-count"))
+          opts->storm_count = strtoul(argv[++i], NULL, 10);
+        else if (! strcmp(it, "--storm-rate"))
+          opts->storm_rate = strtod(argv[++i], NULL);
+        else if (! strcmp(it, "--storm-lines"))
+          opts->storm_lines = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (! strcmp(it, "--storm-seed"))
+          opts->storm_seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (! strcmp(it, "-u"))
+          i++; /* Skip neovim's init file */
+     }
+
+   /* A null seed would make xorshift produce only zeros */
+   if ((opts->storm_seed == 0) || (opts->storm_rate < 0.0))
+     goto fail;
+   return true;
+
+fail:
+   fputs(_usage, stderr);
+   return false;
+}
+
+static void
+_report(void)
+{
+   const uint64_t end = (_fake.storm_end) ? _fake.storm_end : _now_get();
+   const double secs = (_fake.batches)
+      ? (double)(end - _fake.storm_start) * 1e-9 : 0.0;
+
+   fprintf(stderr,
+           "fakenvim: %lu batches in %.3f s (%.1f batches/s), "
+           "%llu bytes written\n",
+           _fake.batches, secs,
+           (secs > 0.0) ? (double)_fake.batches / secs : 0.0,
+           _fake.sent.bytes);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+   int ret = EXIT_FAILURE;
+   msgpack_unpacker unpacker;
+   msgpack_unpacked result;
+
+   if (! _options_parse(argc, argv, &_fake.opts))
+     return EXIT_FAILURE;
+   _fake.rng = _fake.opts.storm_seed;
+
+   msgpack_sbuffer_init(&_fake.sbuffer);
+   msgpack_packer_init(&_fake.packer, &_fake.sbuffer, msgpack_sbuffer_write);
+   if (! msgpack_unpacker_init(&unpacker, FAKENVIM_CHUNK_SIZE))
+     {
+        fprintf(stderr, "fakenvim: failed to initialize the unpacker\n");
+        goto end;
+     }
+   msgpack_unpacked_init(&result);
+
+   struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+   while (! _fake.quit)
+     {
+        const int ready = poll(&pfd, 1, _storm_timeout_get());
+        if (ready < 0)
+          {
+             if (errno == EINTR) { continue; }
+             fprintf(stderr, "fakenvim: poll failed: %s\n", strerror(errno));
+             goto del_unpacker;
+          }
+        else if (ready > 0)
+          {
+             if (msgpack_unpacker_buffer_capacity(&unpacker) < FAKENVIM_CHUNK_SIZE)
+               {
+                  if (! msgpack_unpacker_reserve_buffer(&unpacker,
+                                                        FAKENVIM_CHUNK_SIZE))
+                    {
+                       fprintf(stderr, "fakenvim: failed to allocate memory\n");
+                       goto del_unpacker;
+                    }
+               }
+             const ssize_t bytes =
+                read(STDIN_FILENO, msgpack_unpacker_buffer(&unpacker),
+                     msgpack_unpacker_buffer_capacity(&unpacker));
+             if (bytes < 0)
+               {
+                  if ((errno == EINTR) || (errno == EAGAIN)) { continue; }
+                  fprintf(stderr, "fakenvim: failed to read: %s\n",
+                          strerror(errno));
+                  goto del_unpacker;
+               }
+             else if (bytes == 0) { break; } /* eovim went away */
+
+             msgpack_unpacker_buffer_consumed(&unpacker, (size_t)bytes);
+             msgpack_unpack_return status;
+             while ((status = msgpack_unpacker_next(&unpacker, &result))
+                    == MSGPACK_UNPACK_SUCCESS)
+               _message_handle(&(result.data));
+             if (status != MSGPACK_UNPACK_CONTINUE)
+               {
+                  fprintf(stderr, "fakenvim: failed to unpack (%i)\n", status);
+                  goto del_unpacker;
+               }
+          }
+
+        _storm_run();
+        if (! _output_flush()) { goto del_unpacker; }
+     }
+
+   if (_fake.opts.check_stats && (! _fake.checked))
+     {
+        fprintf(stderr, "fakenvim: eovim did not send its statistics\n");
+        _fake.failed = true;
+     }
+   ret = (_fake.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+del_unpacker:
+   if (_fake.opts.verbose) { _report(); }
+   msgpack_unpacked_destroy(&result);
+   msgpack_unpacker_destroy(&unpacker);
+end:
+   msgpack_sbuffer_destroy(&_fake.sbuffer);
+   free(_fake.line);
+   return ret;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests of the grid, which models the screen without Evas: writing,
+ * clearing and scrolling cells, and the bookkeeping of the dirty spans.
+ */
+
+#include "eovim/types.h"
+#include "eovim/grid.h"
+#include "eovim/log.h"
+#include "unit.h"
+
+int _eovim_log_domain = -1;
+
+#define COLS 8u
+#define ROWS 5u
+
+/* Row y is made of the letter 'a' + y, with the attribute y + 1 */
+static void
+_grid_fill(s_grid *grid)
+{
+   Eina_Unicode line[COLS];
+   for (unsigned int y = 0; y < ROWS; y++)
+     {
+        for (unsigned int x = 0; x < COLS; x++)
+          line[x] = 'a' + y;
+        grid_put(grid, 0, y, line, COLS, (uint16_t)(y + 1));
+     }
+   grid_dirty_reset(grid);
+}
+
+/* Whether the cells [first, last] of @p row are the letter of row @p src */
+static Eina_Bool
+_row_is(const s_grid *grid,
+        unsigned int row,
+        unsigned int first,
+        unsigned int last,
+        unsigned int src)
+{
+   const Eina_Unicode *const cps = grid_row_codepoints_get(grid, row);
+   const uint16_t *const attrs = grid_row_attrs_get(grid, row);
+   for (unsigned int x = first; x <= last; x++)
+     if ((cps[x] != 'a' + src) || (attrs[x] != src + 1))
+       return EINA_FALSE;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_row_cleared(const s_grid *grid,
+             unsigned int row,
+             unsigned int first,
+             unsigned int last)
+{
+   const Eina_Unicode *const cps = grid_row_codepoints_get(grid, row);
+   const uint16_t *const attrs = grid_row_attrs_get(grid, row);
+   for (unsigned int x = first; x <= last; x++)
+     if ((cps[x] != 0) || (attrs[x] != 0))
+       return EINA_FALSE;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_span_is(const s_grid *grid,
+         unsigned int row,
+         unsigned int first,
+         unsigned int last)
+{
+   const s_grid_span *const span = &(grid->dirty[row]);
+   return (span->first == first) && (span->last == last);
+}
+
+static Eina_Bool
+_span_empty(const s_grid *grid,
+            unsigned int row)
+{
+   return grid->dirty[row].last < grid->dirty[row].first;
+}
+
+static void
+_test_new(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   UNIT_CHECK(grid != NULL);
+   if (! grid) { return; }
+
+   /* A new grid is empty, and entirely dirty */
+   UNIT_CHECK(grid->has_dirty);
+   for (unsigned int y = 0; y < ROWS; y++)
+     {
+        UNIT_CHECK(_row_cleared(grid, y, 0, COLS - 1));
+        UNIT_CHECK(_span_is(grid, y, 0, COLS - 1));
+     }
+
+   grid_dirty_reset(grid);
+   UNIT_CHECK(! grid->has_dirty);
+   for (unsigned int y = 0; y < ROWS; y++)
+     UNIT_CHECK(_span_empty(grid, y));
+   grid_free(grid);
+}
+
+static void
+_test_put(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   if (! grid) { UNIT_CHECK(grid != NULL); return; }
+   grid_dirty_reset(grid);
+
+   const Eina_Unicode text[] = { 'x', 'y', 'z' };
+   UNIT_CHECK(grid_put(grid, 2, 1, text, 3, 7) == 3);
+   const Eina_Unicode *const cps = grid_row_codepoints_get(grid, 1);
+   const uint16_t *const attrs = grid_row_attrs_get(grid, 1);
+   UNIT_CHECK((cps[1] == 0) && (cps[2] == 'x') && (cps[4] == 'z'));
+   UNIT_CHECK((cps[5] == 0) && (attrs[3] == 7) && (attrs[5] == 0));
+
+   /* Only the written cells are dirty */
+   UNIT_CHECK(grid->has_dirty);
+   UNIT_CHECK(_span_is(grid, 1, 2, 4));
+   UNIT_CHECK(_span_empty(grid, 0) && _span_empty(grid, 2));
+
+   /* Writes on the same row extend its span */
+   UNIT_CHECK(grid_put(grid, 6, 1, text, 1, 7) == 1);
+   UNIT_CHECK(_span_is(grid, 1, 2, 6));
+   UNIT_CHECK(grid_put(grid, 0, 1, text, 1, 7) == 1);
+   UNIT_CHECK(_span_is(grid, 1, 0, 6));
+
+   /* What does not fit is dropped */
+   UNIT_CHECK(grid_put(grid, COLS - 2, 3, text, 3, 1) == 2);
+   UNIT_CHECK(_span_is(grid, 3, COLS - 2, COLS - 1));
+   UNIT_CHECK(grid_put(grid, 0, ROWS, text, 3, 1) == 0);
+   grid_free(grid);
+}
+
+static void
+_test_clear(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   if (! grid) { UNIT_CHECK(grid != NULL); return; }
+   _grid_fill(grid);
+
+   grid_eol_clear(grid, 5, 2);
+   UNIT_CHECK(_row_is(grid, 2, 0, 4, 2));
+   UNIT_CHECK(_row_cleared(grid, 2, 5, COLS - 1));
+   UNIT_CHECK(_span_is(grid, 2, 5, COLS - 1));
+   UNIT_CHECK(_span_empty(grid, 1) && _span_empty(grid, 3));
+
+   grid_clear(grid);
+   for (unsigned int y = 0; y < ROWS; y++)
+     {
+        UNIT_CHECK(_row_cleared(grid, y, 0, COLS - 1));
+        UNIT_CHECK(_span_is(grid, y, 0, COLS - 1));
+     }
+   grid_free(grid);
+}
+
+static void
+_test_scroll_rows(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   if (! grid) { UNIT_CHECK(grid != NULL); return; }
+   _grid_fill(grid);
+
+   /* Scroll rows 1 to 3 up by one: row 1 takes the cells of row 2 */
+   const Eina_Unicode *const row2 = grid_row_codepoints_get(grid, 2);
+   const Eina_Unicode *const row1 = grid_row_codepoints_get(grid, 1);
+   grid_scroll(grid, 1, 3, 0, COLS - 1, 1);
+   UNIT_CHECK(_row_is(grid, 0, 0, COLS - 1, 0));
+   UNIT_CHECK(_row_is(grid, 1, 0, COLS - 1, 2));
+   UNIT_CHECK(_row_is(grid, 2, 0, COLS - 1, 3));
+   UNIT_CHECK(_row_cleared(grid, 3, 0, COLS - 1));
+   UNIT_CHECK(_row_is(grid, 4, 0, COLS - 1, 4));
+
+   /* No cell was moved: the rows were rotated, and the storage of the row
+    * that went around was reused for the cleared one */
+   UNIT_CHECK(grid_row_codepoints_get(grid, 1) == row2);
+   UNIT_CHECK(grid_row_codepoints_get(grid, 3) == row1);
+
+   /* The scrolled region is dirty, and nothing else */
+   UNIT_CHECK(_span_empty(grid, 0) && _span_empty(grid, 4));
+   for (unsigned int y = 1; y <= 3; y++)
+     UNIT_CHECK(_span_is(grid, y, 0, COLS - 1));
+
+   /* Scroll the whole grid down by two */
+   _grid_fill(grid);
+   grid_scroll(grid, 0, ROWS - 1, 0, COLS - 1, -2);
+   UNIT_CHECK(_row_cleared(grid, 0, 0, COLS - 1));
+   UNIT_CHECK(_row_cleared(grid, 1, 0, COLS - 1));
+   for (unsigned int y = 2; y < ROWS; y++)
+     UNIT_CHECK(_row_is(grid, y, 0, COLS - 1, y - 2));
+
+   /* Rotated rows are kept in order when resizing */
+   UNIT_CHECK(grid_resize(grid, COLS + 2, ROWS));
+   for (unsigned int y = 2; y < ROWS; y++)
+     {
+        UNIT_CHECK(_row_is(grid, y, 0, COLS - 1, y - 2));
+        UNIT_CHECK(_row_cleared(grid, y, COLS, COLS + 1));
+     }
+
+   /* Scrolling by the height of the region or more clears it */
+   _grid_fill(grid);
+   grid_scroll(grid, 1, 2, 0, grid->cols - 1, 5);
+   UNIT_CHECK(_row_is(grid, 0, 0, COLS - 1, 0));
+   UNIT_CHECK(_row_cleared(grid, 1, 0, grid->cols - 1));
+   UNIT_CHECK(_row_cleared(grid, 2, 0, grid->cols - 1));
+   UNIT_CHECK(_row_is(grid, 3, 0, COLS - 1, 3));
+   grid_free(grid);
+}
+
+static void
+_test_scroll_partial(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   if (! grid) { UNIT_CHECK(grid != NULL); return; }
+   _grid_fill(grid);
+
+   /* Scroll columns 2 to 5 of rows 0 to 3 up by one: the cells outside of
+    * these columns stay where they are */
+   const Eina_Unicode *const row0 = grid_row_codepoints_get(grid, 0);
+   grid_scroll(grid, 0, 3, 2, 5, 1);
+   UNIT_CHECK(grid_row_codepoints_get(grid, 0) == row0);
+   for (unsigned int y = 0; y < 3; y++)
+     {
+        UNIT_CHECK(_row_is(grid, y, 0, 1, y));
+        UNIT_CHECK(_row_is(grid, y, 2, 5, y + 1));
+        UNIT_CHECK(_row_is(grid, y, 6, COLS - 1, y));
+        UNIT_CHECK(_span_is(grid, y, 2, 5));
+     }
+   UNIT_CHECK(_row_is(grid, 3, 0, 1, 3));
+   UNIT_CHECK(_row_cleared(grid, 3, 2, 5));
+   UNIT_CHECK(_row_is(grid, 3, 6, COLS - 1, 3));
+   UNIT_CHECK(_span_is(grid, 3, 2, 5));
+   UNIT_CHECK(_span_empty(grid, 4));
+
+   /* And down by two */
+   _grid_fill(grid);
+   grid_scroll(grid, 1, 4, 0, 3, -2);
+   UNIT_CHECK(_row_cleared(grid, 1, 0, 3));
+   UNIT_CHECK(_row_cleared(grid, 2, 0, 3));
+   UNIT_CHECK(_row_is(grid, 3, 0, 3, 1));
+   UNIT_CHECK(_row_is(grid, 4, 0, 3, 2));
+   for (unsigned int y = 1; y < ROWS; y++)
+     UNIT_CHECK(_row_is(grid, y, 4, COLS - 1, y));
+   UNIT_CHECK(_span_empty(grid, 0));
+
+   /* A region outside of the grid is ignored */
+   grid_dirty_reset(grid);
+   grid_scroll(grid, 0, ROWS, 0, COLS - 1, 1);
+   UNIT_CHECK(! grid->has_dirty);
+   grid_free(grid);
+}
+
+static void
+_test_attr_dirty(void)
+{
+   s_grid *const grid = grid_new(COLS, ROWS);
+   if (! grid) { UNIT_CHECK(grid != NULL); return; }
+   _grid_fill(grid);
+
+   const Eina_Unicode text[] = { 'x' };
+   grid_put(grid, 1, 0, text, 1, 9);
+   grid_put(grid, 5, 0, text, 1, 9);
+   grid_put(grid, 3, 4, text, 1, 9);
+   grid_dirty_reset(grid);
+
+   /* Each row is dirtied on the span covering the cells using the attribute */
+   grid_attr_dirty(grid, 9);
+   UNIT_CHECK(grid->has_dirty);
+   UNIT_CHECK(_span_is(grid, 0, 1, 5));
+   UNIT_CHECK(_span_is(grid, 4, 3, 3));
+   for (unsigned int y = 1; y < 4; y++)
+     UNIT_CHECK(_span_empty(grid, y));
+
+   grid_dirty_reset(grid);
+   grid_attr_dirty(grid, 42);
+   UNIT_CHECK(! grid->has_dirty);
+   grid_free(grid);
+}
+
+int
+main(void)
+{
+   eina_init();
+   _eovim_log_domain = eina_log_domain_register("test_grid", EINA_COLOR_RED);
+
+   _test_new();
+   _test_put();
+   _test_clear();
+   _test_scroll_rows();
+   _test_scroll_partial();
+   _test_attr_dirty();
+
+   eina_log_domain_unregister(_eovim_log_domain);
+   eina_shutdown();
+   return UNIT_RESULT();
+}
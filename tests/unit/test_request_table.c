@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests of the table of pending requests: requests are found by their
+ * identifier whatever happened to the other ones, and the size of the table
+ * follows the number of pending requests, not the range of identifiers.
+ */
+
+#include "eovim/types.h"
+#include "eovim/request_table.h"
+#include "eovim/log.h"
+#include "unit.h"
+
+int _eovim_log_domain = -1;
+
+static uint32_t
+_table_size(const s_request_table *table)
+{
+   return (table->slots) ? table->mask + 1 : 0;
+}
+
+static Eina_Bool
+_has(const s_request_table *table,
+     uint32_t uid)
+{
+   const s_request *const req = request_table_find(table, uid);
+   return (req != NULL) && req->pending && (req->uid == uid);
+}
+
+static void
+_test_empty(void)
+{
+   s_request_table table = { NULL, 0, 0 };
+   UNIT_CHECK(request_table_find(&table, 0) == NULL);
+   UNIT_CHECK(request_table_find(&table, 42) == NULL);
+
+   s_request *const req = request_table_add(&table, 42);
+   UNIT_CHECK(req != NULL);
+   UNIT_CHECK(table.count == 1);
+   UNIT_CHECK(_table_size(&table) == REQUEST_TABLE_MIN_SIZE);
+   UNIT_CHECK(_has(&table, 42));
+   UNIT_CHECK(request_table_find(&table, 43) == NULL);
+
+   request_table_del(&table, request_table_find(&table, 42));
+   UNIT_CHECK(table.count == 0);
+   UNIT_CHECK(request_table_find(&table, 42) == NULL);
+   request_table_clear(&table);
+   UNIT_CHECK(table.slots == NULL);
+}
+
+static void
+_test_pinned(void)
+{
+   /*
+    * One request is never answered, while a lot of others are sent and
+    * answered one after the other. The table shall not grow.
+    */
+   s_request_table table = { NULL, 0, 0 };
+   UNIT_CHECK(request_table_add(&table, 0) != NULL);
+
+   for (uint32_t uid = 1; uid < 100000; uid++)
+     {
+        s_request *const req = request_table_add(&table, uid);
+        UNIT_CHECK(req != NULL);
+        if (! req) { break; }
+        UNIT_CHECK(_has(&table, uid));
+        request_table_del(&table, request_table_find(&table, uid));
+     }
+
+   UNIT_CHECK(table.count == 1);
+   UNIT_CHECK(_table_size(&table) == REQUEST_TABLE_MIN_SIZE);
+   UNIT_CHECK(_has(&table, 0));
+   request_table_clear(&table);
+}
+
+static void
+_test_burst(void)
+{
+   /*
+    * A lot of requests are pending at once. The table grows to hold them,
+    * and shrinks back when they are answered, out of order.
+    */
+   s_request_table table = { NULL, 0, 0 };
+   const uint32_t first = UINT32_MAX - 500; /* Identifiers wrap around */
+   const uint32_t count = 5000;
+
+   for (uint32_t i = 0; i < count; i++)
+     UNIT_CHECK(request_table_add(&table, first + i) != NULL);
+   UNIT_CHECK(table.count == count);
+   UNIT_CHECK(_table_size(&table) * 3 >= count * 4);
+   for (uint32_t i = 0; i < count; i++)
+     UNIT_CHECK(_has(&table, first + i));
+
+   /* Odd identifiers are answered first */
+   for (uint32_t i = 1; i < count; i += 2)
+     request_table_del(&table, request_table_find(&table, first + i));
+   UNIT_CHECK(table.count == count / 2);
+   for (uint32_t i = 0; i < count; i++)
+     {
+        if (i % 2) UNIT_CHECK(request_table_find(&table, first + i) == NULL);
+        else UNIT_CHECK(_has(&table, first + i));
+     }
+
+   for (uint32_t i = 0; i < count; i += 2)
+     request_table_del(&table, request_table_find(&table, first + i));
+   UNIT_CHECK(table.count == 0);
+   UNIT_CHECK(_table_size(&table) == REQUEST_TABLE_MIN_SIZE);
+   request_table_clear(&table);
+}
+
+static void
+_test_collisions(void)
+{
+   /*
+    * Requests that share the same home slot follow each other in the
+    * table, and the last ones wrap around its end. Removing one of them
+    * shall not make the others unreachable.
+    */
+   s_request_table table = { NULL, 0, 0 };
+   const uint32_t home = REQUEST_TABLE_MIN_SIZE - 2;
+   for (uint32_t i = 0; i < 6; i++)
+     UNIT_CHECK(request_table_add(&table, home + i * REQUEST_TABLE_MIN_SIZE) != NULL);
+   /* The home slot of this one is taken by the third one */
+   UNIT_CHECK(request_table_add(&table, 0) != NULL);
+
+   request_table_del(&table, request_table_find(&table, home));
+   request_table_del(&table, request_table_find(&table,
+                                                home + 3 * REQUEST_TABLE_MIN_SIZE));
+   UNIT_CHECK(table.count == 5);
+   UNIT_CHECK(_has(&table, 0));
+   UNIT_CHECK(request_table_find(&table, home) == NULL);
+   UNIT_CHECK(request_table_find(&table, home + 3 * REQUEST_TABLE_MIN_SIZE) == NULL);
+   for (uint32_t i = 1; i < 6; i++)
+     if (i != 3) UNIT_CHECK(_has(&table, home + i * REQUEST_TABLE_MIN_SIZE));
+   request_table_clear(&table);
+}
+
+int
+main(void)
+{
+   eina_init();
+   _eovim_log_domain = eina_log_domain_register("test_request_table",
+                                                EINA_COLOR_RED);
+
+   _test_empty();
+   _test_pinned();
+   _test_burst();
+   _test_collisions();
+
+   eina_log_domain_unregister(_eovim_log_domain);
+   eina_shutdown();
+   return UNIT_RESULT();
+}
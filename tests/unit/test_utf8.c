@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests of the UTF-8 decoders. The scalar decoder is checked against known
+ * sequences, and the vectorized ones the CPU supports must decode exactly
+ * like it: valid text, truncated sequences, invalid bytes and random data.
+ * Inputs are in buffers of their exact size, so reading past their end can
+ * be caught by the memory checkers.
+ */
+
+#include "eovim/types.h"
+#include "eovim/utf8.h"
+#include "eovim/log.h"
+#include "unit.h"
+
+int _eovim_log_domain = -1;
+
+#define RANDOM_RUNS 2000u
+#define RANDOM_SIZE_MAX 300u
+
+static uint32_t _seed = 42;
+
+/* Deterministic pseudo-random numbers (xorshift32) */
+static uint32_t
+_random(void)
+{
+   _seed ^= _seed << 13;
+   _seed ^= _seed >> 17;
+   _seed ^= _seed << 5;
+   return _seed;
+}
+
+static unsigned int
+_decode_with(e_utf8_impl impl,
+             const char *str,
+             unsigned int size,
+             Eina_Unicode *out)
+{
+   utf8_impl_set(impl);
+   return utf8_decode(str, size, out);
+}
+
+/* Decode @p size bytes of @p data with every implementation, and check that
+ * they agree with the scalar one */
+static void
+_compare(const char *data,
+         unsigned int size)
+{
+   char *const str = malloc(size ? size : 1);
+   Eina_Unicode *const expected = malloc((size + 1) * sizeof(Eina_Unicode));
+   Eina_Unicode *const got = malloc((size + 1) * sizeof(Eina_Unicode));
+   if ((! str) || (! expected) || (! got))
+     {
+        UNIT_CHECK(! "Failed to allocate memory");
+        goto end;
+     }
+   memcpy(str, data, size);
+
+   const unsigned int n = _decode_with(UTF8_IMPL_SCALAR, str, size, expected);
+   for (int impl = UTF8_IMPL_SCALAR + 1; impl < UTF8_IMPL_LAST; impl++)
+     {
+        if (! utf8_impl_set((e_utf8_impl)impl)) { continue; }
+        const unsigned int m = _decode_with((e_utf8_impl)impl, str, size, got);
+        const Eina_Bool same =
+           (m == n) && (memcmp(got, expected, n * sizeof(Eina_Unicode)) == 0);
+        if (! same)
+          fprintf(stderr, "%s and scalar disagree on %u bytes\n",
+                  utf8_impl_name_get((e_utf8_impl)impl), size);
+        UNIT_CHECK(same);
+     }
+end:
+   free(got);
+   free(expected);
+   free(str);
+}
+
+static void
+_test_scalar(void)
+{
+   static const struct {
+      const char *const str;
+      const Eina_Unicode cps[4];
+      const unsigned int count;
+   } vectors[] = {
+      { "a", { 'a' }, 1 },
+      { "\xc3\xa9", { 0xe9 }, 1 },
+      { "\xe2\x82\xac", { 0x20ac }, 1 },
+      { "\xf0\x9f\x98\x80", { 0x1f600 }, 1 },
+      /* Truncated: the lead byte and the continuation are both invalid */
+      { "\xe2\x82", { 0xfffd, 0xfffd }, 2 },
+      /* Overlong, surrogate and out of range */
+      { "\xc0\x80", { 0xfffd, 0xfffd }, 2 },
+      { "\xed\xa0\x80", { 0xfffd, 0xfffd, 0xfffd }, 3 },
+      { "\xf4\x90\x80\x80", { 0xfffd, 0xfffd, 0xfffd, 0xfffd }, 4 },
+      { "\xff" "a", { 0xfffd, 'a' }, 2 },
+   };
+   Eina_Unicode out[8];
+
+   for (unsigned int i = 0; i < EINA_C_ARRAY_LENGTH(vectors); i++)
+     {
+        const char *const str = vectors[i].str;
+        const unsigned int size = (unsigned int)strlen(str);
+        const unsigned int n = _decode_with(UTF8_IMPL_SCALAR, str, size, out);
+        UNIT_CHECK(n == vectors[i].count);
+        UNIT_CHECK(memcmp(out, vectors[i].cps,
+                          n * sizeof(Eina_Unicode)) == 0);
+     }
+}
+
+static void
+_test_truncated(void)
+{
+   /*
+    * A multi-bytes sequence is cut at each of its bytes, after ASCII runs
+    * of all the lengths around the vector widths, so the cut happens both
+    * in the vectorized loops and in their scalar tails.
+    */
+   static const char *const seqs[] = {
+      "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+   };
+   char buf[80];
+
+   for (unsigned int s = 0; s < EINA_C_ARRAY_LENGTH(seqs); s++)
+     {
+        const size_t len = strlen(seqs[s]);
+        for (unsigned int ascii = 0; ascii <= 40; ascii++)
+          for (unsigned int cut = 0; cut <= len; cut++)
+            {
+               memset(buf, 'x', ascii);
+               memcpy(&buf[ascii], seqs[s], cut);
+               _compare(buf, ascii + cut);
+            }
+     }
+}
+
+static void
+_test_invalid(void)
+{
+   static const char *const bad[] = {
+      "\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xed\xa0\x80",
+      "\xf4\x90\x80\x80", "\xf8\x88\x80\x80\x80", "\xfe", "\xff",
+      "\xc3" "a", "\xe2\x82" "a",
+   };
+   char buf[80];
+
+   for (unsigned int b = 0; b < EINA_C_ARRAY_LENGTH(bad); b++)
+     {
+        const size_t len = strlen(bad[b]);
+        for (unsigned int ascii = 0; ascii <= 40; ascii++)
+          {
+             /* The invalid sequence, between two ASCII runs */
+             memset(buf, 'y', sizeof(buf));
+             memcpy(&buf[ascii], bad[b], len);
+             _compare(buf, (unsigned int)sizeof(buf));
+          }
+     }
+}
+
+static void
+_test_random(void)
+{
+   static const char *const pieces[] = {
+      "abcdefghijklmnopqrstuvwxyz0123456789", " ", "\t", "\xc3\xa9",
+      "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xe5\x90\xbe",
+   };
+   char buf[RANDOM_SIZE_MAX];
+
+   for (unsigned int run = 0; run < RANDOM_RUNS; run++)
+     {
+        const unsigned int size = _random() % RANDOM_SIZE_MAX;
+
+        /* Random bytes: mostly invalid */
+        for (unsigned int i = 0; i < size; i++)
+          buf[i] = (char)(_random() & 0xff);
+        _compare(buf, size);
+
+        /* Mostly ASCII, with multi-bytes characters here and there. It is
+         * cut anywhere, so its end may be a truncated sequence. */
+        unsigned int len = 0;
+        while (len < size)
+          {
+             const char *const piece =
+                pieces[_random() % EINA_C_ARRAY_LENGTH(pieces)];
+             const unsigned int plen = (unsigned int)strlen(piece);
+             const unsigned int take = (len + plen <= size) ? plen : size - len;
+             memcpy(&buf[len], piece, take);
+             len += take;
+          }
+        _compare(buf, size);
+     }
+}
+
+int
+main(void)
+{
+   eina_init();
+   _eovim_log_domain = eina_log_domain_register("test_utf8", EINA_COLOR_RED);
+   utf8_init();
+
+   for (int impl = UTF8_IMPL_SCALAR; impl < UTF8_IMPL_LAST; impl++)
+     if (utf8_impl_set((e_utf8_impl)impl))
+       printf("Testing the %s decoder\n", utf8_impl_name_get((e_utf8_impl)impl));
+
+   _test_scalar();
+   _test_truncated();
+   _test_invalid();
+   _test_random();
+
+   utf8_shutdown();
+   eina_log_domain_unregister(_eovim_log_domain);
+   eina_shutdown();
+   return UNIT_RESULT();
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2017 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __EOVIM_UNIT_H__
+#define __EOVIM_UNIT_H__
+
+#include <stdio.h>
+
+/*
+ * Minimal helpers for the unit tests: a failed check is reported, and the
+ * test goes on, so one run shows all the failures. UNIT_RESULT() is the
+ * exit status of the test.
+ */
+
+static unsigned int _unit_failures = 0;
+
+#define UNIT_CHECK(Cond) \
+   do { \
+      if (! (Cond)) { \
+         fprintf(stderr, "%s:%d: check failed: %s\n", \
+                 __FILE__, __LINE__, #Cond); \
+         _unit_failures++; \
+      } \
+   } while (0)
+
+#define UNIT_RESULT() \
+   ((_unit_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif /* ! __EOVIM_UNIT_H__ */